@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Manoj Rajagopalan, Ari Grant, Sugih Jamin
+ *
+*/
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <deque>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "distrib.h"
+
+typedef unsigned int uint32;
+
+// Message types.  A message is a header of two words, the type and
+// the number of payload words, followed by the payload.
+enum {
+  MSG_JOB = 1,  // w h sphere.c sphere.r eye aa_enabled aa_max_depth
+                // aa_threshold
+  MSG_TILE,     // id x0 y0 tw th
+  MSG_RESULT,   // id x0 y0 tw th primary secondary shadow
+                // shadow_cache_hits sample_time refine_time,
+                // then tw*th rgb colors
+  MSG_DONE      // no payload
+};
+
+#define JOB_WORDS 12
+#define TILE_WORDS 5
+#define RESULT_HEADER_WORDS 11
+
+// Upper bound on a message's payload, to catch garbage on the wire
+#define MAX_MSG_WORDS (1 << 26)
+
+// Give up on a worker that stalls this long in the middle of a message
+#define RECV_TIMEOUT 10
+
+static inline uint32
+float_word(float f)
+{
+  uint32 u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float
+word_float(uint32 u)
+{
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static bool
+write_all(int fd, void const *buf, size_t len)
+{
+  char const *p = (char const *)buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool
+read_all(int fd, void *buf, size_t len)
+{
+  char *p = (char *)buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static bool
+send_msg(int fd, uint32 type, vector<uint32> const& words)
+{
+  vector<uint32> buf(2 + words.size());
+  buf[0] = htonl(type);
+  buf[1] = htonl((uint32)words.size());
+  for (size_t i = 0; i < words.size(); i++) {
+    buf[2+i] = htonl(words[i]);
+  }
+  return write_all(fd, &buf[0], buf.size()*sizeof(uint32));
+}
+
+static bool
+recv_msg(int fd, uint32 *type, vector<uint32> *words)
+{
+  uint32 header[2];
+  if (!read_all(fd, header, sizeof(header))) {
+    return false;
+  }
+  *type = ntohl(header[0]);
+  uint32 const n = ntohl(header[1]);
+  if (n > MAX_MSG_WORDS) {
+    return false;
+  }
+  words->resize(n);
+  if (n > 0 && !read_all(fd, &(*words)[0], n*sizeof(uint32))) {
+    return false;
+  }
+  for (uint32 i = 0; i < n; i++) {
+    (*words)[i] = ntohl((*words)[i]);
+  }
+  return true;
+}
+
+/*
+ * Worker
+ */
+
+static int
+connect_to(char const *host, int port)
+{
+  struct addrinfo hints, *res, *ai;
+  char service[16];
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof(service), "%d", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0) {
+    return -1;
+  }
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+bool
+run_worker(char const *host, int port)
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  int fd = connect_to(host, port);
+  if (fd < 0) {
+    cerr << "worker: unable to connect to " << host << ":" << port << endl;
+    return false;
+  }
+
+  int w = 0, h = 0;
+  uint32 type;
+  vector<uint32> in, out;
+  vector<Colorf> tile;
+
+  while (recv_msg(fd, &type, &in)) {
+    if (type == MSG_JOB && in.size() == JOB_WORDS) {
+      w = in[0];
+      h = in[1];
+      reflecting_sphere.c = XVec3f(word_float(in[2]), word_float(in[3]),
+                                   word_float(in[4]));
+      reflecting_sphere.r = word_float(in[5]);
+      eye_pos = XVec3f(word_float(in[6]), word_float(in[7]),
+                       word_float(in[8]));
+      aa_enabled = in[9] != 0;
+      aa_max_depth = in[10];
+      aa_threshold = word_float(in[11]);
+
+    } else if (type == MSG_TILE && in.size() == TILE_WORDS && w > 0) {
+      int const x0 = in[1], y0 = in[2], tw = in[3], th = in[4];
+      tile.resize(tw*th);
+      ray_stats.reset();
+      render_tile(w, h, x0, y0, tw, th, &tile[0]);
+
+      out.resize(RESULT_HEADER_WORDS + 3*tw*th);
+      for (int k = 0; k < TILE_WORDS; k++) {
+        out[k] = in[k];
+      }
+      out[5] = ray_stats.primary;
+      out[6] = ray_stats.secondary;
+      out[7] = ray_stats.shadow;
+      out[8] = ray_stats.shadow_cache_hits;
+      out[9] = float_word(ray_stats.sample_time);
+      out[10] = float_word(ray_stats.refine_time);
+      for (int k = 0; k < tw*th; k++) {
+        out[RESULT_HEADER_WORDS+3*k] = float_word(tile[k].red());
+        out[RESULT_HEADER_WORDS+3*k+1] = float_word(tile[k].green());
+        out[RESULT_HEADER_WORDS+3*k+2] = float_word(tile[k].blue());
+      }
+      if (!send_msg(fd, MSG_RESULT, out)) {
+        break;
+      }
+
+    } else {
+      // MSG_DONE or something we don't understand
+      break;
+    }
+  }
+
+  close(fd);
+  return true;
+}
+
+/*
+ * Coordinator
+ */
+
+struct Tile {
+  int x0, y0, tw, th;
+  int holders;   // number of workers currently rendering this tile
+  bool done;
+};
+
+struct Worker {
+  int fd;
+  int tile;      // tile being rendered, -1 if idle
+  double start;  // when the tile was handed out
+};
+
+static bool
+send_tile(Worker *wk, vector<Tile> *tiles, int t)
+{
+  Tile& tile = (*tiles)[t];
+  vector<uint32> words(TILE_WORDS);
+  words[0] = t;
+  words[1] = tile.x0;
+  words[2] = tile.y0;
+  words[3] = tile.tw;
+  words[4] = tile.th;
+  if (!send_msg(wk->fd, MSG_TILE, words)) {
+    return false;
+  }
+  wk->tile = t;
+  wk->start = now_seconds();
+  tile.holders++;
+  return true;
+}
+
+// Copy a tile's pixels into the w-wide framebuffer
+static void
+store_tile(Tile const& tile, Colorf const *pixels, int w, Colorf *fb)
+{
+  for (int j = 0; j < tile.th; j++) {
+    for (int i = 0; i < tile.tw; i++) {
+      fb[(tile.y0+j)*w + tile.x0+i] = pixels[j*tile.tw+i];
+    }
+  }
+}
+
+bool
+render_distributed(int w, int h, Colorf *fb, int port, int nlocal,
+                   int tile_size, double straggler_timeout)
+{
+  signal(SIGPIPE, SIG_IGN);
+
+  int lfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (lfd < 0) {
+    perror("socket");
+    return false;
+  }
+  int on = 1;
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(lfd, 64) < 0) {
+    perror("coordinator");
+    close(lfd);
+    return false;
+  }
+  socklen_t addrlen = sizeof(addr);
+  getsockname(lfd, (struct sockaddr *)&addr, &addrlen);
+  port = ntohs(addr.sin_port);
+  cerr << "coordinator: listening on port " << port << endl;
+
+  vector<pid_t> children;
+  for (int k = 0; k < nlocal; k++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(lfd);
+      _exit(run_worker("127.0.0.1", port) ? 0 : 1);
+    } else if (pid > 0) {
+      children.push_back(pid);
+    } else {
+      perror("fork");
+    }
+  }
+
+  // The scene is sent once to each worker, when it connects.
+  vector<uint32> job(JOB_WORDS);
+  job[0] = w;
+  job[1] = h;
+  job[2] = float_word(reflecting_sphere.c.x());
+  job[3] = float_word(reflecting_sphere.c.y());
+  job[4] = float_word(reflecting_sphere.c.z());
+  job[5] = float_word(reflecting_sphere.r);
+  job[6] = float_word(eye_pos.x());
+  job[7] = float_word(eye_pos.y());
+  job[8] = float_word(eye_pos.z());
+  job[9] = aa_enabled;
+  job[10] = aa_max_depth;
+  job[11] = float_word(aa_threshold);
+
+  vector<Tile> tiles;
+  deque<int> pending;
+  for (int y0 = 0; y0 < h; y0 += tile_size) {
+    for (int x0 = 0; x0 < w; x0 += tile_size) {
+      Tile tile;
+      tile.x0 = x0;
+      tile.y0 = y0;
+      tile.tw = min(tile_size, w-x0);
+      tile.th = min(tile_size, h-y0);
+      tile.holders = 0;
+      tile.done = false;
+      pending.push_back((int)tiles.size());
+      tiles.push_back(tile);
+    }
+  }
+
+  vector<Worker> workers;
+  vector<Colorf> pixels;
+  vector<uint32> words;
+  int ndone = 0;
+  double tile_time = 0.0;  // total worker time of finished tiles
+  double last_worker = now_seconds();
+  double const t0 = now_seconds();
+
+  while (ndone < (int)tiles.size()) {
+    vector<struct pollfd> pfds(1 + workers.size());
+    pfds[0].fd = lfd;
+    pfds[0].events = POLLIN;
+    for (size_t k = 0; k < workers.size(); k++) {
+      pfds[k+1].fd = workers[k].fd;
+      pfds[k+1].events = POLLIN;
+    }
+    if (poll(&pfds[0], pfds.size(), 100) < 0 && errno != EINTR) {
+      perror("poll");
+      break;
+    }
+
+    // results, or workers going away
+    for (size_t k = 0; k < workers.size(); k++) {
+      Worker& wk = workers[k];
+      if (!(pfds[k+1].revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+      uint32 type;
+      if (!recv_msg(wk.fd, &type, &words) || type != MSG_RESULT ||
+          words.size() < RESULT_HEADER_WORDS || (int)words[0] != wk.tile) {
+        // dead or confused worker: drop it, the tile is requeued below
+        close(wk.fd);
+        wk.fd = -1;
+        continue;
+      }
+      Tile& tile = tiles[wk.tile];
+      tile.holders--;
+      ray_stats.primary += words[5];
+      ray_stats.secondary += words[6];
+      ray_stats.shadow += words[7];
+      ray_stats.shadow_cache_hits += words[8];
+      ray_stats.sample_time += word_float(words[9]);
+      ray_stats.refine_time += word_float(words[10]);
+      if (!tile.done && 
+          words.size() == RESULT_HEADER_WORDS + 3*(size_t)(tile.tw*tile.th)) {
+        pixels.resize(tile.tw*tile.th);
+        for (int i = 0; i < tile.tw*tile.th; i++) {
+          pixels[i] = Colorf(word_float(words[RESULT_HEADER_WORDS+3*i]),
+                             word_float(words[RESULT_HEADER_WORDS+3*i+1]),
+                             word_float(words[RESULT_HEADER_WORDS+3*i+2]));
+        }
+        store_tile(tile, &pixels[0], w, fb);
+        tile.done = true;
+        ndone++;
+        tile_time += now_seconds() - wk.start;
+      }
+      wk.tile = -1;
+    }
+
+    // new workers
+    if (pfds[0].revents & POLLIN) {
+      int fd = accept(lfd, NULL, NULL);
+      if (fd >= 0) {
+        struct timeval tv;
+        tv.tv_sec = RECV_TIMEOUT;
+        tv.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        if (send_msg(fd, MSG_JOB, job)) {
+          Worker wk;
+          wk.fd = fd;
+          wk.tile = -1;
+          wk.start = 0.0;
+          workers.push_back(wk);
+        } else {
+          close(fd);
+        }
+      }
+    }
+
+    double const now = now_seconds();
+    double timeout = straggler_timeout;
+    if (timeout <= 0.0) {
+      timeout = ndone > 0 ? max(1.0, 4.0*tile_time/ndone) : 10.0;
+    }
+
+    // hand out tiles: the queue first, then copies of stragglers
+    for (size_t k = 0; k < workers.size(); k++) {
+      Worker& wk = workers[k];
+      if (wk.fd < 0 || wk.tile >= 0) {
+        continue;
+      }
+      int t = -1;
+      if (!pending.empty()) {
+        t = pending.front();
+        pending.pop_front();
+      } else {
+        double oldest = now - timeout;
+        for (size_t m = 0; m < workers.size(); m++) {
+          Worker const& other = workers[m];
+          if (other.fd >= 0 && other.tile >= 0 && other.start < oldest &&
+              !tiles[other.tile].done && tiles[other.tile].holders < 2) {
+            t = other.tile;
+            oldest = other.start;
+          }
+        }
+      }
+      if (t >= 0 && !send_tile(&wk, &tiles, t)) {
+        if (tiles[t].holders == 0) {
+          pending.push_front(t);
+        }
+        close(wk.fd);
+        wk.fd = -1;
+      }
+    }
+
+    // forget dead workers, requeueing their tiles
+    for (size_t k = 0; k < workers.size(); ) {
+      Worker const& wk = workers[k];
+      if (wk.fd >= 0) {
+        k++;
+        continue;
+      }
+      if (wk.tile >= 0) {
+        Tile& tile = tiles[wk.tile];
+        tile.holders--;
+        if (!tile.done && tile.holders == 0) {
+          pending.push_front(wk.tile);
+        }
+      }
+      cerr << "coordinator: lost a worker" << endl;
+      workers.erase(workers.begin()+k);
+    }
+
+    // with nobody to do the work, do it ourselves
+    if (!workers.empty()) {
+      last_worker = now;
+    } else if (!pending.empty() && now - last_worker > timeout) {
+      int const t = pending.front();
+      pending.pop_front();
+      Tile& tile = tiles[t];
+      pixels.resize(tile.tw*tile.th);
+      render_tile(w, h, tile.x0, tile.y0, tile.tw, tile.th, &pixels[0]);
+      store_tile(tile, &pixels[0], w, fb);
+      tile.done = true;
+      ndone++;
+    }
+  }
+
+  vector<uint32> none;
+  for (size_t k = 0; k < workers.size(); k++) {
+    send_msg(workers[k].fd, MSG_DONE, none);
+    close(workers[k].fd);
+  }
+  close(lfd);
+
+  // Reap our local workers, giving stragglers a moment to notice
+  // we're done before killing them.
+  double const deadline = now_seconds() + 1.0;
+  for (size_t k = 0; k < children.size(); k++) {
+    while (waitpid(children[k], NULL, WNOHANG) == 0) {
+      if (now_seconds() > deadline) {
+        kill(children[k], SIGKILL);
+        waitpid(children[k], NULL, 0);
+        break;
+      }
+      usleep(10000);
+    }
+  }
+
+  cerr << "coordinator: " << tiles.size() << " tiles in " 
+       << now_seconds() - t0 << " s" << endl;
+  return true;
+}
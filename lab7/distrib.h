@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Manoj Rajagopalan, Ari Grant, Sugih Jamin
+ *
+ */
+#ifndef __DISTRIB_H__
+#define __DISTRIB_H__
+
+#include "tracer.h"
+
+/*
+ * Distributed tile rendering.  A coordinator splits the image into
+ * tiles and hands them out over TCP to worker processes, on this
+ * machine or others.  Each worker is sent the scene (sphere, eye and
+ * antialiasing settings) once when it connects, then renders one tile
+ * at a time and sends back its pixels and ray counts.
+ *
+ * Tiles held by a worker that disconnects or dies are put back in the
+ * queue.  Once the queue is empty, idle workers are also given copies
+ * of tiles that have been outstanding longer than the straggler
+ * timeout; whichever copy comes back first is used.
+ *
+ * All protocol words are 32 bits in network byte order, so workers
+ * may run on machines of different endianness.
+ */
+
+// Default edge length of the square tiles, in pixels
+#define DISTRIB_TILE_SIZE 32
+
+// Coordinator: listen on port (0 picks a free port, which is printed),
+// fork nlocal workers on localhost, and render the w x h image into fb
+// as in render().  Tiles outstanding longer than straggler_timeout
+// seconds are given to idle workers too; if straggler_timeout <= 0 it
+// is adapted to four times the average tile time.  If no worker is
+// connected, the coordinator renders the tiles itself.  ray_stats
+// accumulates the workers' ray counts and phase times.
+// Returns false if the coordinator could not listen on port.
+bool render_distributed(int w, int h, Colorf *fb, int port, int nlocal,
+                        int tile_size, double straggler_timeout);
+
+// Worker: connect to the coordinator at host:port and render tiles
+// until the coordinator is done.  Returns false if the connection
+// could not be made.
+bool run_worker(char const *host, int port);
+
+#endif // __DISTRIB_H__
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Manoj Rajagopalan, Ari Grant, Sugih Jamin
+ *
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "tracer.h"
+#include "distrib.h"
+
+/*
+ * Headless ray tracer: renders the scene without opening a window,
+ * writes the image out as TGA or PPM, and reports ray counts and
+ * timings so it can be used for benchmarking and regression tests.
+ */
+
+static unsigned char
+to_byte(float f)
+{
+  if (f <= 0.0f) return 0;
+  if (f >= 1.0f) return 255;
+  return (unsigned char)(f*255.0f + 0.5f);
+}
+
+// Uncompressed 24-bit TGA, stored bottom row first like fb.
+static bool
+write_tga(char const *path, int w, int h, Colorf const *fb)
+{
+  ofstream file(path, ofstream::out | ofstream::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  unsigned char header[18];
+  memset(header, 0, sizeof(header));
+  header[2] = 2;          // uncompressed, true-color image
+  header[12] = w & 0xff;
+  header[13] = (w >> 8) & 0xff;
+  header[14] = h & 0xff;
+  header[15] = (h >> 8) & 0xff;
+  header[16] = 24;        // bits-per-pixel
+  file.write((char *)header, sizeof(header));
+
+  vector<unsigned char> row(3*w);
+  for (int j = 0; j < h; j++) {
+    for (int i = 0; i < w; i++) {
+      Colorf c = fb[j*w+i];
+      // targa is BGR
+      row[3*i] = to_byte(c.blue());
+      row[3*i+1] = to_byte(c.green());
+      row[3*i+2] = to_byte(c.red());
+    }
+    file.write((char *)&row[0], row.size());
+  }
+  return file.good();
+}
+
+// Binary PPM, which is stored top row first.
+static bool
+write_ppm(char const *path, int w, int h, Colorf const *fb)
+{
+  ofstream file(path, ofstream::out | ofstream::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file << "P6\n" << w << " " << h << "\n255\n";
+  vector<unsigned char> row(3*w);
+  for (int j = h-1; j >= 0; j--) {
+    for (int i = 0; i < w; i++) {
+      Colorf c = fb[j*w+i];
+      row[3*i] = to_byte(c.red());
+      row[3*i+1] = to_byte(c.green());
+      row[3*i+2] = to_byte(c.blue());
+    }
+    file.write((char *)&row[0], row.size());
+  }
+  return file.good();
+}
+
+static void
+usage(char const *prog)
+{
+  cerr << "Usage: " << prog << " [-w width] [-h height] [-s x,y,z]"
+       << " [-a depth] [-t threshold] [-o image.{tga,ppm}]" << endl
+       << "         [-j workers] [-p port] [-b tile_size] [-T seconds]" << endl
+       << "       " << prog << " -c host:port" << endl
+       << "  -s: position of the reflecting sphere" << endl
+       << "  -a: enable adaptive antialiasing up to the given depth" << endl
+       << "  -t: color threshold for antialiasing subdivision" << endl
+       << "  -j: render tiles in this many local worker processes" << endl
+       << "  -p: also accept workers on this port" << endl
+       << "  -b: tile size for distributed rendering" << endl
+       << "  -T: seconds before a slow tile is given to another worker" << endl
+       << "  -c: run as a worker for the coordinator at host:port" << endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int opt;
+  int w = 640;
+  int h = 400;
+  char const *outfile = NULL;
+  bool distributed = false;
+  int nworkers = 0;
+  int port = 0;
+  int tile_size = DISTRIB_TILE_SIZE;
+  double straggler_timeout = 0.0;
+  char host[256];
+
+  while ((opt = getopt(argc, argv, "w:h:s:a:t:o:j:p:b:T:c:")) != -1) {
+    switch (opt) {
+    case 'w':
+      w = atoi(optarg);
+      break;
+    case 'h':
+      h = atoi(optarg);
+      break;
+    case 's':
+      if (sscanf(optarg, "%f,%f,%f", &reflecting_sphere.c.x(),
+                 &reflecting_sphere.c.y(), &reflecting_sphere.c.z()) != 3) {
+        cerr << "-s: sphere position must be given as x,y,z" << endl;
+        exit(-1);
+      }
+      break;
+    case 'a':
+      aa_enabled = true;
+      aa_max_depth = atoi(optarg);
+      break;
+    case 't':
+      aa_threshold = atof(optarg);
+      break;
+    case 'o':
+      outfile = optarg;
+      break;
+    case 'j':
+      distributed = true;
+      nworkers = atoi(optarg);
+      break;
+    case 'p':
+      distributed = true;
+      port = atoi(optarg);
+      break;
+    case 'b':
+      tile_size = atoi(optarg);
+      break;
+    case 'T':
+      straggler_timeout = atof(optarg);
+      break;
+    case 'c':
+      if (sscanf(optarg, "%255[^:]:%d", host, &port) != 2) {
+        cerr << "-c: coordinator must be given as host:port" << endl;
+        exit(-1);
+      }
+      return run_worker(host, port) ? 0 : -1;
+    default:
+      usage(argv[0]);
+      exit(-1);
+    }
+  }
+
+  if (w <= 0 || h <= 0 || aa_max_depth < 0 || tile_size <= 0) {
+    usage(argv[0]);
+    exit(-1);
+  }
+
+  vector<Colorf> fb(w*h);
+  double t0 = now_seconds();
+  if (distributed) {
+    if (!render_distributed(w, h, &fb[0], port, nworkers, tile_size,
+                            straggler_timeout)) {
+      exit(-1);
+    }
+  } else {
+    render(w, h, &fb[0]);
+  }
+  double t1 = now_seconds();
+
+  if (outfile) {
+    size_t len = strlen(outfile);
+    bool ok;
+    if (len > 4 && !strcmp(outfile+len-4, ".ppm")) {
+      ok = write_ppm(outfile, w, h, &fb[0]);
+    } else {
+      ok = write_tga(outfile, w, h, &fb[0]);
+    }
+    if (!ok) {
+      cerr << "Unable to write " << outfile << endl;
+      exit(-1);
+    }
+  }
+  double t2 = now_seconds();
+
+  double render_time = t1 - t0;
+  cout << "image:          " << w << "x" << h << endl;
+  cout << "primary rays:   " << ray_stats.primary << endl;
+  cout << "secondary rays: " << ray_stats.secondary << endl;
+  cout << "shadow rays:    " << ray_stats.shadow 
+       << " (" << ray_stats.shadow_cache_hits << " blocked by cached occluder)"
+       << endl;
+  cout << "total rays:     " << ray_stats.total() << endl;
+  cout << "sample time:    " << ray_stats.sample_time << " s" << endl;
+  cout << "refine time:    " << ray_stats.refine_time << " s" << endl;
+  cout << "render time:    " << render_time << " s" << endl;
+  cout << "write time:     " << t2 - t1 << " s" << endl;
+  cout << "rays/sec:       "
+       << (render_time > 0.0 ? ray_stats.total()/render_time : 0.0) << endl;
+
+  return 0;
+}
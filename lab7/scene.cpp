@@ -102,6 +102,27 @@ Sphere::is_intersecting(Ray const& ray) const
   return true;
 }
 
+bool
+Sphere::occludes(XVec3f const& p, XVec3f const& q) const
+{
+  // solve |p + t(q-p) - c| = r for t
+  XVec3f const d(q-p);
+  XVec3f const f(p-c);
+  double const a = d.dot(d);
+  double const b = 2.0*f.dot(d);
+  double const cc = f.dot(f) - r*r;
+  double const disc = b*b - 4.0*a*cc;
+  if (disc < 0.0 || a == 0.0) {
+    return false;
+  }
+  double const sq = sqrt(disc);
+  double const t0 = (-b - sq)/(2.0*a);
+  double const t1 = (-b + sq)/(2.0*a);
+
+  // does [t0, t1] overlap the open segment (0, 1)?
+  return (t1 > 1.0e-6 && t0 < 1.0 - 1.0e-6);
+}
+
 double 
 Sphere::intersect(Ray const& ray) const
 {
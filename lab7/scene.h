@@ -111,6 +111,11 @@ struct Sphere {
   
   // Does the given ray intersect the sphere?
   bool is_intersecting(Ray const& ray) const;
+
+  // Does the sphere block the line segment from p to q?
+  // Only intersections strictly between the two end points
+  // count, so a sphere behind p or beyond q does not occlude.
+  bool occludes(XVec3f const& p, XVec3f const& q) const;
   
   // point of intersection of ray and sphere
   // in terms of the 't' parameter of the ray.
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Manoj Rajagopalan, Ari Grant, Sugih Jamin
+ *
+*/
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <sys/time.h>
+using namespace std;
+
+#include "tracer.h"
+
+XVec3f eye_pos(0,0,900);
+Sphere reflecting_sphere(-100,-80,-100,75);
+
+Sphere const* const occluders[] = { &reflecting_sphere };
+int const num_occluders = sizeof(occluders)/sizeof(occluders[0]);
+
+XVec3f Xaxis(1.0,0.0,0.0);
+XVec3f Yaxis(0.0,1.0,0.0);
+XVec3f Zaxis(0.0,0.0,1.0);
+
+Colorf White(1.0,1.0,1.0);
+Colorf Black(0.0,0.0,0.0);
+
+bool aa_enabled = false;
+int aa_max_depth = 2;
+float aa_threshold = 0.1f;
+
+RayStats ray_stats;
+
+double
+now_seconds()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1.0e-6;
+}
+
+bool
+occluded(XVec3f const& p, XVec3f const& light_pos, int *last_occluder)
+{
+  ray_stats.shadow++;
+
+  int const last = *last_occluder;
+  if (last >= 0 && last < num_occluders &&
+      occluders[last]->occludes(p, light_pos)) {
+    ray_stats.shadow_cache_hits++;
+    return true;
+  }
+
+  for (int i = 0; i < num_occluders; i++) {
+    if (i != last && occluders[i]->occludes(p, light_pos)) {
+      *last_occluder = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+Colorf 
+raytrace(Ray const& ray, bool secondary, int *hit)
+{
+  double t;
+  // occluder that last shadowed light0, one per thread
+  static __thread int light0_occluder = -1;
+
+  if (secondary) {
+    ray_stats.secondary++;
+  } else {
+    ray_stats.primary++;
+  }
+  
+  // one diffuse light for the scene
+  static Light const light0(XVec3f(-300.0,200.0,900.0),   // location
+                            Black,       // ambient
+                            .45*White,   // diffuse
+                            Black,       // specular
+                            1, 1.0e-3, 1.0e-4); // attenuation
+        
+    // front and back walls: respond to diffuse lighting only, mostly red
+  static Material const fb_mat(Black, Colorf(1.0f, 0.1f, 0.1f), Black);
+  // left and right walls: respond to diffuse lighting only, mostly green
+  static Material const lr_mat(Black, Colorf(0.3f, 1.0f, 0.3f), Black);
+  // top and bottom walls: respond to diffuse lighting only, mostly blue
+  static Material const tb_mat(Black, Colorf(0.3f,0.3f, 1.0f), Black);
+
+  static Plane const walls[] = { 
+    Plane(-Zaxis, XVec3f(0,0,1000), fb_mat),   // back wall
+    Plane( Zaxis, XVec3f(0,0,-3000), fb_mat),  // front wall
+    Plane( Xaxis, XVec3f(-700,0,0), lr_mat),   // left wall
+    Plane(-Xaxis, XVec3f(700,0,0),  lr_mat),   // right wall
+    Plane( Yaxis, XVec3f(0,-600,0), tb_mat),   // floor
+    Plane(-Yaxis, XVec3f(0,600,0),  tb_mat) }; // ceiling
+        
+  if (secondary || !reflecting_sphere.is_intersecting(ray)) {
+                
+    /* YOUR CODE HERE
+     *          
+     * If this is a secondary ray (we've already touched the sphere)
+     * or the ray doesn't intersect the sphere then find out which wall
+     * the ray is intersecting and obtain its color. To do this,
+     * (1) call Plane::intersect(ray) for each of the walls so that you 
+     *     get the t parameter for the ray at which the intersection occurs. 
+     *     Negative t tells you that the plane is behind the origin of the 
+     *     ray (the eye). Also, t is an indicator of how far one must travel 
+     *     along the ray to reach the point of intersection.
+     * (2) Once you get the 't', computing the actual world point can be done
+     *     by calling Ray::pt(t). See scene.h
+     * (3) Only the 't' that is within the visible world is useful for
+     *     rendering.  Keep track of the wall corresponding to the visible
+     *     't' also.
+     * (4) Calculate the color at the intersection point of the ray and the 
+     *     wall by calling Light::pt(Pt, plane-normal, plane-material). 
+     *     See scene.h
+     * (5) Hard shadow: If the ray from light source to point on the wall 
+     *     intersects the sphere, then the sphere casts a shadow. Otherwise 
+     *     the wall reflects light in the usual way. You may want to 
+     *     implement the case where the ray intersects the sphere first 
+     *     and then come back here to implement this last task.
+    */
+    Colorf result;
+    double tzmin, tzmax, txmin, txmax, tymin, tymax;
+    double t_arr[6];
+    for (int i = 0; i < 6; i++) {
+      t_arr[i] = walls[i].intersect(ray);
+    }
+    tzmin = min(t_arr[0], t_arr[1]);
+    tzmax = max(t_arr[0], t_arr[1]);
+    txmin = min(t_arr[2], t_arr[3]);
+    txmax = max(t_arr[2], t_arr[3]);
+    tymin = min(t_arr[4], t_arr[5]);
+    tymax = max(t_arr[4], t_arr[5]);
+
+    double tmin = max(txmin, tymin);
+    tmin = max(tmin, tzmin);
+    double tmax = min(txmax, tymax);
+    tmax = min(tmax, tzmax);
+    if (tmin >= 0) {
+      t = min(tmax, tmin);
+    } else {
+      t = tmax;
+    }
+    XVec3f p = ray.pt(t);
+    int idx = 0;
+    for (int i = 0; i < 6; i++) {
+      if (t == t_arr[i]) {
+        idx = i;
+        break;
+      }
+    }
+    if (hit) {
+      *hit |= idx;
+    }
+    result = light0.pt(p, walls[idx].n, walls[idx].mat);
+    if (occluded(p, light0.o, &light0_occluder)) {
+      if (hit) {
+        *hit |= HIT_SHADOW;
+      }
+      return Black;
+    }
+
+    // if (!secondary) {
+    //   XVec3f n = walls[idx].n;
+    //   XVec3f r = ray.d - 2 * ray.d.dot(n) * n;
+    //   Ray reflect = Ray(p, r);
+    //   result += raytrace(reflect, true);
+    // }
+    return result;
+  } else {
+                
+    /* YOUR CODE HERE
+     * ray intersects sphere:
+     * (1) Determine the point of intersection. Use Sphere::intersect(ray)
+     * (2) Determine reflection vector.
+     * (3) Create the reflected ray with this point and direction.
+     * (4) recurse this function setting the "secondary" flag to true.
+    */
+    t = reflecting_sphere.intersect(ray); 
+    XVec3f dhat = ray.d;
+    dhat.normalize();
+    XVec3f p = ray.e + t * dhat;
+    XVec3f n = reflecting_sphere.unit_normal(p);
+    XVec3f r = ray.d - 2 * ray.d.dot(n) * n;
+    // r.normalize();
+    Ray reflect = Ray(p, r);
+
+    if (hit) {
+      *hit |= HIT_SPHERE;
+    }
+    return raytrace(reflect, true, hit);
+  }
+  // YOUR CODE HERE: Remove this line after implementing the above
+}
+
+/* A single ray sample: its color and what it hit */
+struct Sample {
+  Colorf c;
+  int hit;
+};
+
+// Trace the ray from the eye through screen point (x, y),
+// with the screen center at the origin.
+static Sample
+trace_sample(double x, double y)
+{
+  Sample s;
+  XVec3f const p(x, y, 0.0);
+  Ray const ray(eye_pos, p - eye_pos);
+
+  s.hit = 0;
+  s.c = raytrace(ray, false, &s.hit);
+  return s;
+}
+
+static bool
+samples_differ(Sample const& a, Sample const& b)
+{
+  if (a.hit != b.hit) {
+    return true;
+  }
+  for (int k = 0; k < 3; k++) {
+    if (fabs(a.c[k] - b.c[k]) > aa_threshold) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Color of the square with lower-left corner (x, y) and side size,
+ * given the samples at its corners: s[0] lower-left, s[1] lower-right,
+ * s[2] upper-left, s[3] upper-right.  If the corners agree, their
+ * average is used, otherwise the square is split into four and the
+ * five new samples (center and edge midpoints) are shared between
+ * the quadrants.
+ */
+static Colorf
+adaptive_sample(double x, double y, double size, Sample const s[4], int depth)
+{
+  if (depth >= aa_max_depth ||
+      !(samples_differ(s[0], s[1]) || samples_differ(s[0], s[2]) ||
+        samples_differ(s[0], s[3]) || samples_differ(s[1], s[2]) ||
+        samples_differ(s[1], s[3]) || samples_differ(s[2], s[3]))) {
+    return 0.25f*(s[0].c + s[1].c + s[2].c + s[3].c);
+  }
+
+  double const h = size/2.0;
+  Sample const b = trace_sample(x+h, y);        // bottom midpoint
+  Sample const l = trace_sample(x, y+h);        // left midpoint
+  Sample const m = trace_sample(x+h, y+h);      // center
+  Sample const r = trace_sample(x+size, y+h);   // right midpoint
+  Sample const t = trace_sample(x+h, y+size);   // top midpoint
+
+  Sample const ll[4] = { s[0], b, l, m };
+  Sample const lr[4] = { b, s[1], m, r };
+  Sample const ul[4] = { l, m, s[2], t };
+  Sample const ur[4] = { m, r, t, s[3] };
+
+  depth++;
+  return 0.25f*(adaptive_sample(x, y, h, ll, depth) +
+                adaptive_sample(x+h, y, h, lr, depth) +
+                adaptive_sample(x, y+h, h, ul, depth) +
+                adaptive_sample(x+h, y+h, h, ur, depth));
+}
+
+void
+render_tile(int w, int h, int x0, int y0, int tw, int th, Colorf *tile)
+{
+  int i, j;
+  int screen_center_x = w/2;
+  int screen_center_y = h/2;
+  double t0 = now_seconds();
+
+  if (!aa_enabled) {
+    for (j = y0; j < y0+th; j++) {
+      for (i = x0; i < x0+tw; i++) {
+        // Create a ray through the screen point
+        XVec3f const s(double(i-screen_center_x), double(j-screen_center_y), 0.0);
+        XVec3f const d(s - eye_pos);
+        Ray const ray(eye_pos, d);
+                        
+        // trace the ray and get the color
+        tile[(j-y0)*tw+(i-x0)] = raytrace(ray, false);
+      }
+    }
+    ray_stats.sample_time += now_seconds() - t0;
+    return;
+  }
+
+  // one ray per pixel corner, shared between neighboring pixels
+  vector<Sample> corners((tw+1)*(th+1));
+  for (j = 0; j <= th; j++) {
+    for (i = 0; i <= tw; i++) {
+      corners[j*(tw+1)+i] = trace_sample(x0+i-screen_center_x-0.5,
+                                         y0+j-screen_center_y-0.5);
+    }
+  }
+  double t1 = now_seconds();
+  ray_stats.sample_time += t1 - t0;
+
+  for (j = 0; j < th; j++) {
+    for (i = 0; i < tw; i++) {
+      Sample const s[4] = { corners[j*(tw+1)+i],
+                            corners[j*(tw+1)+i+1],
+                            corners[(j+1)*(tw+1)+i],
+                            corners[(j+1)*(tw+1)+i+1] };
+      tile[j*tw+i] = adaptive_sample(x0+i-screen_center_x-0.5,
+                                     y0+j-screen_center_y-0.5, 1.0, s, 0);
+    }
+  }
+  ray_stats.refine_time += now_seconds() - t1;
+}
+
+void
+render(int w, int h, Colorf *fb)
+{
+  render_tile(w, h, 0, 0, w, h, fb);
+}
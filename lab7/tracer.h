@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Manoj Rajagopalan, Ari Grant, Sugih Jamin
+ *
+ */
+#ifndef __TRACER_H__
+#define __TRACER_H__
+
+#include "xvec.h"
+#include "scene.h"
+
+/*
+ * The ray tracer proper, independent of any windowing system.
+ * Used by both the GLUT viewer (raytrace) and the headless
+ * renderer (raytrace_cli).
+ */
+
+extern XVec3f eye_pos;
+extern Sphere reflecting_sphere;
+
+// Everything that can cast a shadow
+extern Sphere const* const occluders[];
+extern int const num_occluders;
+
+extern Colorf White;
+extern Colorf Black;
+
+// Adaptive antialiasing: rays are shot through pixel corners and a
+// pixel is subdivided only if its corner samples disagree by more
+// than aa_threshold (in any color channel) or hit different objects.
+extern bool aa_enabled;
+extern int aa_max_depth;     // each level splits a (sub)pixel into 4
+extern float aa_threshold;
+
+// Hit identifiers returned by raytrace(): the wall index (0-5),
+// or'ed with HIT_SPHERE if the ray was reflected off the sphere
+// and HIT_SHADOW if the wall point is in shadow.
+#define HIT_SPHERE 0x08
+#define HIT_SHADOW 0x10
+
+/* Ray counts and per-phase wall-clock times (in seconds) of render() */
+struct RayStats {
+  unsigned long primary;    // rays from the eye
+  unsigned long secondary;  // rays reflected off the sphere
+  unsigned long shadow;     // rays toward the light
+  unsigned long shadow_cache_hits; // shadow rays blocked by the
+                                   // light's last occluder
+  double sample_time;       // one ray per pixel (or per pixel corner)
+  double refine_time;       // adaptive antialiasing subdivision
+
+  RayStats() { reset(); }
+  void reset() {
+    primary = secondary = shadow = shadow_cache_hits = 0;
+    sample_time = refine_time = 0.0;
+  }
+  unsigned long total() const { return primary+secondary+shadow; }
+};
+
+extern RayStats ray_stats;
+
+// Color seen along the given ray.  If hit is not NULL, the
+// identifier of what the ray hit is or'ed into it.
+Colorf raytrace(Ray const& ray, bool secondary, int *hit=NULL);
+
+// Render a w x h image into fb, stored row by row,
+// bottom row first: pixel (i, j) is fb[j*w+i].
+void render(int w, int h, Colorf *fb);
+
+// Render the tw x th tile of a w x h image whose lower-left pixel is
+// (x0, y0) into tile, stored row by row like fb in render().
+void render_tile(int w, int h, int x0, int y0, int tw, int th, Colorf *tile);
+
+// Is the segment from p to the light at light_pos blocked?  Stops at
+// the first occluder found.  *last_occluder caches the index of the
+// occluder that last blocked this light, which is tried first since
+// neighboring points are usually shadowed by the same object; the
+// cache should be kept per light and per thread.
+bool occluded(XVec3f const& p, XVec3f const& light_pos, int *last_occluder);
+
+// Wall-clock time in seconds
+double now_seconds();
+
+#endif // __TRACER_H__
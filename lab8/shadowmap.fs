@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2010, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant, Sugih Jamin
+ *
+*/
+#version 120
+
+/* the depth of the occluders seen from the light, one
+ * face of the cube map for each axis */
+uniform samplerCube shadowMap;
+
+/* the near and far planes each face was drawn with */
+uniform float shadowNear;
+uniform float shadowFar;
+
+/* how much farther from the light than the nearest
+ * occluder a fragment has to be to be in its shadow */
+uniform float shadowBias;
+
+/* how the shadow map is looked up: 0 for hard shadows, 1 to
+ * filter it over a fixed area (percentage-closer filtering), 2 to
+ * first search it for blockers and filter over the penumbra they
+ * would cast (percentage-closer soft shadows), so that shadows are
+ * hard where the occluder meets them and softer farther away */
+uniform int shadowFilter;
+
+/* how many samples of the disk below to filter with, and
+ * how wide the light the penumbrae come from is */
+uniform int shadowSamples;
+uniform float lightSize;
+
+#define MAX_SAMPLES 32
+
+/* a Poisson disk of unit radius, ordered so that
+ * the first few samples already cover all of it */
+const vec2 poissonDisk[MAX_SAMPLES] = vec2[MAX_SAMPLES](
+  vec2(-0.0050, 0.0207), vec2(-0.3593, -0.9098), vec2(0.6448, -0.7271), vec2(-0.5964, 0.7939),
+  vec2(0.8980, 0.3455), vec2(-0.9216, -0.1971), vec2(0.1115, 0.9699), vec2(0.5236, -0.1967),
+  vec2(-0.3776, 0.3530), vec2(-0.2088, -0.3924), vec2(0.4891, 0.8247), vec2(0.5042, 0.4116),
+  vec2(-0.9617, 0.1971), vec2(0.2844, -0.4934), vec2(0.9240, -0.0158), vec2(0.0943, 0.3385),
+  vec2(0.2854, -0.8171), vec2(-0.2063, 0.9686), vec2(-0.6035, -0.7129), vec2(-0.4734, -0.2281),
+  vec2(-0.6586, 0.4847), vec2(-0.7004, 0.0302), vec2(-0.1106, -0.7267), vec2(0.6343, 0.1320),
+  vec2(-0.7169, -0.4260), vec2(-0.3125, 0.0547), vec2(0.3304, 0.1440), vec2(-0.3216, 0.6658),
+  vec2(0.2202, -0.1810), vec2(0.8050, -0.3060), vec2(0.1805, 0.6762), vec2(0.7158, 0.6262)
+);
+
+varying vec4 litColor;
+varying vec4 shadowColor;
+varying vec3 lightToVertex;
+
+/* the depth the fragment would have in the face of the cube map
+ * it falls in, which is the one of its largest axis, if it were
+ * offset closer to the light along that axis */
+float
+faceDepth(vec3 v, float offset)
+{
+  vec3 a = abs(v);
+  float z = max(a.x, max(a.y, a.z)) - offset;
+  float ndc = (shadowFar + shadowNear) / (shadowFar - shadowNear) -
+    2.0 * shadowFar * shadowNear / ((shadowFar - shadowNear) * z);
+  return 0.5 * ndc + 0.5;
+}
+
+/* the distance along its face's axis of a depth in the map */
+float
+faceDistance(float depth)
+{
+  float ndc = 2.0 * depth - 1.0;
+  return 2.0 * shadowFar * shadowNear /
+    (shadowFar + shadowNear - ndc * (shadowFar - shadowNear));
+}
+
+/* the direction from the light to sample i of the disk, rotated
+ * by r and spread radius wide across v, where t and b are the
+ * unit vectors across v.  each sample is compared at its own
+ * depth, so that samples falling in another face of the cube
+ * map are compared along that face's axis */
+vec3
+diskSample(vec3 v, vec3 t, vec3 b, mat2 r, float radius, int i)
+{
+  vec2 o = radius * (r * poissonDisk[i]);
+  return v + o.x * t + o.y * b;
+}
+
+void 
+main(void)
+{
+  float depth = faceDepth(lightToVertex, shadowBias);
+  float lit;
+
+  if (shadowFilter == 0) {
+    float occluder = textureCube(shadowMap, lightToVertex).r;
+    lit = depth > occluder ? 0.0 : 1.0;
+  } else {
+    vec3 v = lightToVertex;
+    vec3 n = normalize(v);
+    vec3 t = normalize(cross(n, abs(n.y) < 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 b = cross(n, t);
+
+    /* turn the disk by a different angle at each pixel,
+       which trades banding for noise */
+    float a = 6.2831853 * fract(sin(dot(gl_FragCoord.xy, vec2(12.9898, 78.233))) * 43758.5453);
+    mat2 r = mat2(cos(a), sin(a), -sin(a), cos(a));
+
+    /* a penumbra as wide as half the light, unless it is found
+       from the average distance to the blockers in the region
+       the light could be blocked from */
+    float radius = 0.5 * lightSize;
+    if (shadowFilter == 2) {
+      float receiver = faceDistance(depth);
+      float blockers = 0.0;
+      int found = 0;
+      for (int i = 0; i < MAX_SAMPLES; i++) {
+        if (i >= shadowSamples) {
+          break;
+        }
+        vec3 s = diskSample(v, t, b, r, lightSize, i);
+        float occluder = textureCube(shadowMap, s).r;
+        if (occluder < faceDepth(s, shadowBias)) {
+          blockers += faceDistance(occluder);
+          found++;
+        }
+      }
+      if (found == 0) {
+        gl_FragColor = litColor;
+        return;
+      }
+      blockers /= float(found);
+      radius = 0.5 * lightSize * (receiver - blockers) / blockers;
+    }
+
+    lit = 0.0;
+    for (int i = 0; i < MAX_SAMPLES; i++) {
+      if (i >= shadowSamples) {
+        break;
+      }
+      vec3 s = diskSample(v, t, b, r, radius, i);
+      lit += faceDepth(s, shadowBias) > textureCube(shadowMap, s).r ? 0.0 : 1.0;
+    }
+    lit /= float(shadowSamples);
+  }
+
+  gl_FragColor = mix(shadowColor, litColor, lit);
+}
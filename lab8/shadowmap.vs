@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2010, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant, Sugih Jamin
+ *
+*/
+#version 120
+
+/* light 0 is lit per-vertex, as the fixed pipeline does, with the
+ * color standing in for the ambient and diffuse material.  in shadow
+ * the color is as dark as the projected shadows, but never lighter
+ * than lit.  the fragment shader picks between the two by the
+ * shadow map */
+varying vec4 litColor;
+varying vec4 shadowColor;
+
+/* from the light to the vertex, in eye coordinates */
+varying vec3 lightToVertex;
+
+void 
+main(void) 
+{
+  vec4 position = gl_ModelViewMatrix * gl_Vertex;
+  gl_Position = gl_ProjectionMatrix * position;
+
+  vec3 normal = normalize(gl_NormalMatrix * gl_Normal);
+  vec3 l = gl_LightSource[0].position.xyz - position.xyz;
+  float d = length(l);
+  float attenuation = 1.0 / (gl_LightSource[0].constantAttenuation +
+                             gl_LightSource[0].linearAttenuation * d +
+                             gl_LightSource[0].quadraticAttenuation * d * d);
+
+  litColor = gl_LightModel.ambient * gl_Color +
+    attenuation * (gl_LightSource[0].ambient +
+                   max(dot(normal, l/d), 0.0) * gl_LightSource[0].diffuse) * gl_Color;
+  shadowColor = min(litColor, 0.3 * gl_Color);
+  shadowColor.a = litColor.a = gl_Color.a;
+
+  lightToVertex = -l;
+}
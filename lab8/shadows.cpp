@@ -21,7 +21,13 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
 #include <iostream>
+#include <fstream>
+#include <vector>
 using namespace std;
 
 #ifdef __APPLE__
@@ -29,6 +35,8 @@ using namespace std;
 #include <GLUT/glut.h>
 #define GL_RGB16F GL_RGB16F_ARB
 #define GL_RGB32F GL_RGB32F_ARB
+#define GL_TIME_ELAPSED GL_TIME_ELAPSED_EXT
+#define glGetQueryObjectui64v glGetQueryObjectui64vEXT
 #else
 #include <GL/glew.h>
 #include <GL/glut.h>
@@ -36,6 +44,7 @@ using namespace std;
 
 #include "xvec.h"
 #include "xmat.h"
+#include "shaders.h"
 
 int width = 600;
 int height = 600;
@@ -56,11 +65,59 @@ bool softShadows = false;
 /* clip shadows to reciever */
 bool stencilClipping = false;
 
+/* whether shadows come from a shadow map instead of being
+ * projected onto each wall, and the program that samples it */
+bool shadowMapping = false;
+bool shadersSupported = false;
+GLuint shadowProgram = 0;
+
+/* the size of each face of the shadow map, and the near and
+ * far planes the occluders are drawn into it with.  the far
+ * plane reaches the farthest corner of the room from anywhere
+ * inside it */
+#define SHADOW_MAP_SIZE 512
+#define SHADOW_NEAR 0.02f
+#define SHADOW_FAR 3.5f
+
+/* how much farther from the light than the nearest occluder
+ * a fragment has to be to be in its shadow, so that surfaces
+ * do not shadow themselves */
+#define SHADOW_BIAS 0.01f
+
+/* how shadows are softened from the shadow map in a single pass,
+ * instead of by jittering the light: not at all, by filtering it
+ * over a fixed area (percentage-closer filtering), or over the
+ * penumbra found by first searching it for blockers (percentage-
+ * closer soft shadows) */
+typedef enum { HARD_FILTER=0, PCF_FILTER, PCSS_FILTER } shadow_filter_t;
+#define NUM_FILTERS 3
+const char *filterNames[NUM_FILTERS] = { "Unfiltered", "PCF", "PCSS" };
+int shadowFilter = HARD_FILTER;
+
+/* how many samples of the shadow map each fragment is filtered
+ * over, at most as many as shadowmap.fs has in its Poisson disk */
+int shadowSamples = 16;
+#define MAX_SHADOW_SAMPLES 32
+
 /* The number of times and the amount by which the light is moved
  * along each axis.  This produces the soft shadows */
 int numJitters = 2;
 float jitterAmount = 0.009f;
 
+/* the number of samples per pixel the scene is antialiased with,
+ * by drawing it into a multisampled framebuffer object once and
+ * resolving that, rather than jittering the frustum and
+ * accumulating as accpersp.c does.  0 turns it off */
+int msaaSamples = 0;
+
+/* whether soft shadows are spread over frames: each frame adds
+ * TEMPORAL_SAMPLES more of the jittered light positions to the
+ * history of the ones before, until all numJitters*3 are in, and
+ * the history starts over when anything in the scene changes */
+bool temporalShadows = false;
+#define TEMPORAL_SAMPLES 2
+int historySamples = 0;
+
 /* whether to draw the whole scene */
 int clippedTo = FRONT_WALL;
 
@@ -90,6 +147,288 @@ pointInPlane(GLfloat *point, GLfloat *plane)
   return (n.dot(p)+plane[3] < .05);
 }
 
+/* The passes of a frame that are timed.  Each is timed on the CPU,
+ * and on the GPU by a GL_TIME_ELAPSED query around it when the
+ * driver has timer queries (Mesa's software driver does).  Queries
+ * cannot nest, so only passes that time nothing inside them are
+ * timed, and a pass drawn more than once in a frame adds up. */
+typedef enum { WALL_PASS=0, STENCIL_PASS, PROJECTION_PASS, OCCLUDER_PASS,
+               SHADOW_MAP_PASS, RESOLVE_PASS, ACCUM_PASS, BLIT_PASS } pass_t;
+#define NUM_PASSES 8
+const char *passNames[NUM_PASSES] = {
+  "walls", "stencil", "projection", "occluders",
+  "shadow map", "resolve", "accumulation", "blit"
+};
+
+/* whether the averages of the pass times are printed
+ * every TIMER_WINDOW frames or drawn over the scene */
+typedef enum { TIMING_OFF=0, TIMING_PRINT, TIMING_OVERLAY } timing_t;
+#define NUM_TIMINGS 3
+int timing = TIMING_OFF;
+
+/* the number of frames the times are averaged over */
+#define TIMER_WINDOW 60
+
+/* when open, every frame's times go in as a row, and
+ * when timerFrames is not 0 the program quits once that
+ * many frames are in */
+ofstream timerCSV;
+int timerFrames = 0;
+
+/* the times of the frame being drawn and of the last TIMER_WINDOW,
+ * in milliseconds.  the last entry is the whole frame, on the GPU
+ * the sum of the passes.  scenePasses counts scenes drawn */
+bool gpuTimers = false;
+bool frameTimed = false;
+int timedFrames = 0;
+int averagedFrames = 0;
+int scenePasses;
+double frameStart;
+double passStart;
+double cpuTimes[NUM_PASSES+1];
+double gpuTimes[NUM_PASSES+1];
+double cpuHistory[TIMER_WINDOW][NUM_PASSES+1];
+double gpuHistory[TIMER_WINDOW][NUM_PASSES+1];
+int passHistory[TIMER_WINDOW];
+
+/* a query for each pass timed this frame, made as needed
+   and used again every frame, and which pass each was for */
+vector<GLuint> timerQueries;
+vector<int> timerPasses;
+int timerQueriesUsed;
+
+/* wall clock time in seconds */
+double
+timer_now()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1.0e-6;
+}
+
+/* see whether the driver counts GPU time */
+void
+timer_init()
+{
+  GLint bits = 0;
+
+  glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &bits);
+  gpuTimers = bits > 0;
+  if (!gpuTimers) {
+    cerr << "No GPU timer queries, timing on the CPU only" << endl;
+  }
+
+  return;
+}
+
+void
+timer_frame_begin()
+{
+  frameTimed = timing != TIMING_OFF || timerCSV.is_open();
+  if (!frameTimed) {
+    return;
+  }
+
+  for (int i = 0; i <= NUM_PASSES; i++) {
+    cpuTimes[i] = gpuTimes[i] = 0.0;
+  }
+  scenePasses = 0;
+  timerQueriesUsed = 0;
+  frameStart = timer_now();
+
+  return;
+}
+
+/* start timing pass, which has to be ended
+   before another pass can be started */
+void
+timer_begin(int pass)
+{
+  if (!frameTimed) {
+    return;
+  }
+
+  if (gpuTimers) {
+    if (timerQueriesUsed == (int)timerQueries.size()) {
+      GLuint query;
+      glGenQueries(1, &query);
+      timerQueries.push_back(query);
+      timerPasses.push_back(pass);
+    }
+    timerPasses[timerQueriesUsed] = pass;
+    glBeginQuery(GL_TIME_ELAPSED, timerQueries[timerQueriesUsed++]);
+  }
+  passStart = timer_now();
+
+  return;
+}
+
+void
+timer_end(int pass)
+{
+  if (!frameTimed) {
+    return;
+  }
+
+  if (gpuTimers) {
+    glEndQuery(GL_TIME_ELAPSED);
+  }
+  cpuTimes[pass] += 1000.0*(timer_now() - passStart);
+
+  return;
+}
+
+/* the average times over the last TIMER_WINDOW frames
+   (or as many as there have been) and scene passes */
+void
+timer_averages(double *cpu, double *gpu, double *passes)
+{
+  int n = averagedFrames < TIMER_WINDOW ? averagedFrames : TIMER_WINDOW;
+
+  *passes = 0.0;
+  for (int i = 0; i <= NUM_PASSES; i++) {
+    cpu[i] = gpu[i] = 0.0;
+  }
+  for (int f = 0; f < n; f++) {
+    for (int i = 0; i <= NUM_PASSES; i++) {
+      cpu[i] += cpuHistory[f][i]/n;
+      gpu[i] += gpuHistory[f][i]/n;
+    }
+    *passes += (double)passHistory[f]/n;
+  }
+
+  return;
+}
+
+/* one line of the table of times, for pass or the whole frame */
+void
+timer_line(char *line, int size, int pass, double cpu, double gpu)
+{
+  const char *name = pass < NUM_PASSES ? passNames[pass] : "frame";
+
+  if (gpuTimers) {
+    snprintf(line, size, "%14s %8.2f ms cpu %8.2f ms gpu", name, cpu, gpu);
+  } else {
+    snprintf(line, size, "%14s %8.2f ms cpu", name, cpu);
+  }
+
+  return;
+}
+
+/* collect the GPU times, which are in once the frame is finished,
+ * and keep the frame's times for the averages and the CSV file */
+void
+timer_frame_end()
+{
+  if (!frameTimed) {
+    return;
+  }
+
+  cpuTimes[NUM_PASSES] = 1000.0*(timer_now() - frameStart);
+  for (int i = 0; i < timerQueriesUsed; i++) {
+    GLuint64 ns;
+    glGetQueryObjectui64v(timerQueries[i], GL_QUERY_RESULT, &ns);
+    gpuTimes[timerPasses[i]] += ns*1.0e-6;
+    gpuTimes[NUM_PASSES] += ns*1.0e-6;
+  }
+
+  int f = averagedFrames++ % TIMER_WINDOW;
+  memcpy(cpuHistory[f], cpuTimes, sizeof(cpuTimes));
+  memcpy(gpuHistory[f], gpuTimes, sizeof(gpuTimes));
+  passHistory[f] = scenePasses;
+
+  if (timerCSV.is_open()) {
+    timerCSV << timedFrames << "," << scenePasses;
+    for (int i = 0; i <= NUM_PASSES; i++) {
+      timerCSV << "," << cpuTimes[i] << ",";
+      if (gpuTimers) {
+        timerCSV << gpuTimes[i];
+      }
+    }
+    timerCSV << endl;
+  }
+  timedFrames++;
+
+  if (timing == TIMING_PRINT && averagedFrames % TIMER_WINDOW == 0) {
+    char line[80];
+    double cpu[NUM_PASSES+1], gpu[NUM_PASSES+1], passes;
+    timer_averages(cpu, gpu, &passes);
+    cerr << "average of " << TIMER_WINDOW << " frames, "
+         << passes << " scene passes:" << endl;
+    for (int i = 0; i <= NUM_PASSES; i++) {
+      timer_line(line, sizeof(line), i, cpu[i], gpu[i]);
+      cerr << line << endl;
+    }
+  }
+  frameTimed = false;
+
+  return;
+}
+
+/* write every frame's times to the CSV file at path from now on */
+void
+timer_csv_open(const char *path)
+{
+  timerCSV.open(path);
+  if (!timerCSV.good()) {
+    cerr << "Cannot write " << path << endl;
+    exit(-1);
+  }
+
+  timerCSV << "frame,scene_passes";
+  for (int i = 0; i <= NUM_PASSES; i++) {
+    const char *name = i < NUM_PASSES ? passNames[i] : "frame";
+    timerCSV << "," << name << " cpu ms," << name << " gpu ms";
+  }
+  timerCSV << endl;
+
+  return;
+}
+
+/* draw the average times over the top left of the window */
+void
+timer_overlay()
+{
+  char line[80];
+  double cpu[NUM_PASSES+1], gpu[NUM_PASSES+1], passes;
+
+  timer_averages(cpu, gpu, &passes);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(0.0, width, 0.0, height, -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glPushAttrib(GL_ENABLE_BIT|GL_CURRENT_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_TEXTURE_2D);
+  glColor3f(0.0f, 0.0f, 0.0f);
+
+  for (int i = 0; i <= NUM_PASSES+1; i++) {
+    if (i == 0) {
+      snprintf(line, sizeof(line), "%14.1f scene passes", passes);
+    } else {
+      timer_line(line, sizeof(line), i-1, cpu[i-1], gpu[i-1]);
+    }
+    glRasterPos2i(10, height - 20 - 15*i);
+    for (char *c = line; *c; c++) {
+      glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    }
+  }
+
+  glPopAttrib();
+  glPopMatrix(); // GL_MODELVIEW
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+
+  return;
+}
+
 /* draw a wall */
 void
 drawWall(int wall)
@@ -286,11 +625,13 @@ drawScene()
   positionAndDrawLight();
         
   // draw the walls, to set depth boundaries
+  timer_begin(WALL_PASS);
   for (i = FLOOR; i <= REAR_WALL; i++) {
     if (clippedTo == FRONT_WALL || i == clippedTo) {
       drawWall(i);
     }
   }
+  timer_end(WALL_PASS);
 
   if (stencilClipping) {
     // enable stencil test for fragment selection
@@ -323,11 +664,13 @@ drawScene()
       glStencilOp(GL_ZERO, GL_ZERO, GL_REPLACE);
 
       // draw the wall into stencil buffer only, not depth and color buffers
+      timer_begin(STENCIL_PASS);
       glDisable(GL_DEPTH_TEST);
       glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
       drawWall(i);
       glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
       glEnable(GL_DEPTH_TEST);
+      timer_end(STENCIL_PASS);
 
       /* TASK 2: YOUR CODE HERE: Clipped Shadows
        *
@@ -340,7 +683,9 @@ drawScene()
 
       // shadows: draw the occluders in black,
       // projected onto the specified plane/wall
+      timer_begin(PROJECTION_PASS);
       drawShadows(walls[i]);
+      timer_end(PROJECTION_PASS);
     }
   }
     
@@ -350,26 +695,402 @@ drawScene()
   }
   
   // draw the occluders normally
+  timer_begin(OCCLUDER_PASS);
   drawOccluders(false);
+  timer_end(OCCLUDER_PASS);
 
   return;
 }
 
-int
-fbo_accum_init()
+/* One attachment of a render target: a texture, when it is sampled
+ * later, or else a renderbuffer, with its internal format.  target
+ * is GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP for a texture, 0 for a
+ * renderbuffer. */
+typedef struct {
+  GLenum attachment;
+  GLenum format;
+  GLenum target;
+  GLuint id;
+} rt_attachment_t;
+
+#define RT_MAX_ATTACHMENTS 3
+
+/* An offscreen render target: a framebuffer object and its
+ * attachments.  It is made the first time it is used and then kept
+ * from frame to frame, and only made again when the size it is
+ * wanted at changes.  width and height are 0 while it is not made.
+ * samples is the number of samples per pixel of its renderbuffers,
+ * 0 for ones that are not multisampled. */
+typedef struct {
+  const char *name;
+  int numAttachments;
+  rt_attachment_t attachments[RT_MAX_ATTACHMENTS];
+  int samples;
+  GLuint fbo;
+  int width;
+  int height;
+} render_target_t;
+
+/* The target soft shadows are accumulated in: the scene is drawn
+ * into the texture, which is then blended into the floating-point
+ * accumulation buffer */
+render_target_t accumTarget = {
+  "accumulation", 3,
+  { { GL_COLOR_ATTACHMENT0, GL_RGBA, GL_TEXTURE_2D, 0 },
+    { GL_COLOR_ATTACHMENT1, GL_RGB32F, 0, 0 },
+    { GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH_STENCIL, 0, 0 } },
+  0, 0, 0, 0
+};
+
+/* The shadow map: the depth of the occluders seen from the light,
+ * drawn into each face of the cube map in turn */
+render_target_t shadowTarget = {
+  "shadow map", 1,
+  { { GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24, GL_TEXTURE_CUBE_MAP, 0 } },
+  0, 0, 0, 0
+};
+
+/* The multisampled target the scene is antialiased in, in one pass,
+ * and then resolved out of with a blit.  its samples are set to
+ * msaaSamples, and it is let go of to be made again when they
+ * change */
+render_target_t msaaTarget = {
+  "multisample", 2,
+  { { GL_COLOR_ATTACHMENT0, GL_RGBA8, 0, 0 },
+    { GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH_STENCIL, 0, 0 } },
+  0, 0, 0, 0
+};
+
+/* every render target, to let go of them all on the way out */
+render_target_t *renderTargets[] = { &accumTarget, &shadowTarget, &msaaTarget };
+#define NUM_RENDER_TARGETS (int)(sizeof(renderTargets)/sizeof(renderTargets[0]))
+
+/* delete the framebuffer object and attachments of rt */
+void
+rt_release(render_target_t *rt)
+{
+  if (rt->fbo) {
+    glDeleteFramebuffers(1, &rt->fbo);
+    rt->fbo = 0;
+  }
+  for (int i = 0; i < rt->numAttachments; i++) {
+    rt_attachment_t *a = &rt->attachments[i];
+    if (a->id && a->target) {
+      glDeleteTextures(1, &a->id);
+    } else if (a->id) {
+      glDeleteRenderbuffers(1, &a->id);
+    }
+    a->id = 0;
+  }
+  rt->width = rt->height = 0;
+
+  return;
+}
+
+void
+rt_release_all()
+{
+  for (int i = 0; i < NUM_RENDER_TARGETS; i++) {
+    rt_release(renderTargets[i]);
+  }
+
+  return;
+}
+
+/* make the framebuffer object and attachments of rt at w by h,
+ * leaving it bound.  a cube map is attached by its first face.
+ * this is the only place the framebuffer is checked for
+ * completeness */
+void
+rt_make(render_target_t *rt, int w, int h)
 {
-  GLuint fbod;
-  GLuint tbod;
-  GLuint rbod[2];
   GLint maxsize;
   GLenum gl_error;
-  
+  bool color = false;
+
   glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxsize);
-  if (width > maxsize || height > maxsize) {
+  if (w > maxsize || h > maxsize) {
     cerr << "Window size > max renderbuffer size" << endl;
     exit(-1);
   }
-    
+
+  glGenFramebuffers(1, &rt->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, rt->fbo);
+
+  for (int i = 0; i < rt->numAttachments; i++) {
+    rt_attachment_t *a = &rt->attachments[i];
+    if (a->attachment != GL_DEPTH_ATTACHMENT &&
+        a->attachment != GL_DEPTH_STENCIL_ATTACHMENT) {
+      color = true;
+    }
+    if (a->target) {
+      /* the external format only has to go with the internal one,
+         since no pixels are passed in.  depth is not filtered,
+         since it is compared against rather than looked at */
+      bool depth = a->attachment == GL_DEPTH_ATTACHMENT;
+      bool cube = a->target == GL_TEXTURE_CUBE_MAP;
+      GLenum face = cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : GL_TEXTURE_2D;
+      glGenTextures(1, &a->id);
+      glBindTexture(a->target, a->id);
+      glTexParameteri(a->target, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+      glTexParameteri(a->target, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+      glTexParameteri(a->target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(a->target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      if (cube) {
+        glTexParameteri(a->target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+      }
+      for (int f = 0; f < (cube ? 6 : 1); f++) {
+        glTexImage2D(face+f, 0, a->format, w, h, 0,
+                     depth ? GL_DEPTH_COMPONENT : GL_RGBA,
+                     depth ? GL_FLOAT : GL_UNSIGNED_BYTE, 0);
+      }
+      glFramebufferTexture2D(GL_FRAMEBUFFER, a->attachment, face, a->id, 0);
+    } else {
+      glGenRenderbuffers(1, &a->id);
+      glBindRenderbuffer(GL_RENDERBUFFER, a->id);
+      if (rt->samples) {
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, rt->samples,
+                                         a->format, w, h);
+      } else {
+        glRenderbufferStorage(GL_RENDERBUFFER, a->format, w, h);
+      }
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, a->attachment,
+                                GL_RENDERBUFFER, a->id);
+    }
+    if ((gl_error = glGetError()) != GL_NO_ERROR) {
+      cerr << rt->name << " attachment " << i << ": [" 
+           << gl_error << "] " << gluErrorString(gl_error) << endl;
+      exit(-1);
+    }
+  }
+
+  /* a depth-only target draws and reads no color */
+  if (!color) {
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+  }
+
+  if ((gl_error = glCheckFramebufferStatus(GL_FRAMEBUFFER)) !=
+      GL_FRAMEBUFFER_COMPLETE) {
+    cerr << rt->name << " framebuffer incomplete [0x" << hex << gl_error
+         << dec << "]" << endl;
+    exit(-1);
+  }
+  rt->width = w;
+  rt->height = h;
+
+  return;
+}
+
+/* bind rt as the framebuffer, at w by h.  it is only made
+ * when it is first used or when the size changes */
+GLuint
+rt_bind(render_target_t *rt, int w, int h)
+{
+  if (rt->width != w || rt->height != h) {
+    rt_release(rt);
+    rt_make(rt, w, h);
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, rt->fbo);
+  }
+
+  return(rt->fbo);
+}
+
+/* the texture or renderbuffer at attachment of rt */
+GLuint
+rt_attachment(render_target_t *rt, GLenum attachment)
+{
+  for (int i = 0; i < rt->numAttachments; i++) {
+    if (rt->attachments[i].attachment == attachment) {
+      return(rt->attachments[i].id);
+    }
+  }
+
+  return(0);
+}
+
+/* attach face (0 to 5, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X
+ * on) of the cube map at attachment of the bound rt */
+void
+rt_face(render_target_t *rt, GLenum attachment, int face)
+{
+  glFramebufferTexture2D(GL_FRAMEBUFFER, attachment,
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X+face,
+                         rt_attachment(rt, attachment), 0);
+
+  return;
+}
+
+/* draw the depth of the occluders seen from the light into each
+ * face of the shadow map, once per face however many walls there
+ * are.  the faces are aligned with the eye coordinate axes, which
+ * is where the shader looks them up, and the framebuffer, viewport
+ * and matrices are put back as they were */
+void
+drawShadowMap()
+{
+  /* the direction each face looks in and its up
+     vector, as the cube map lays the faces out */
+  static const GLfloat faces[6][6] = {
+    {  1.0f,  0.0f,  0.0f,   0.0f, -1.0f,  0.0f },
+    { -1.0f,  0.0f,  0.0f,   0.0f, -1.0f,  0.0f },
+    {  0.0f,  1.0f,  0.0f,   0.0f,  0.0f,  1.0f },
+    {  0.0f, -1.0f,  0.0f,   0.0f,  0.0f, -1.0f },
+    {  0.0f,  0.0f,  1.0f,   0.0f, -1.0f,  0.0f },
+    {  0.0f,  0.0f, -1.0f,   0.0f, -1.0f,  0.0f }
+  };
+  GLint fbo, viewport[4];
+  GLfloat view[16], light[4];
+
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  glGetFloatv(GL_MODELVIEW_MATRIX, view);
+  glGetLightfv(GL_LIGHT0, GL_POSITION, light);
+
+  rt_bind(&shadowTarget, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+  glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluPerspective(90.0, 1.0, SHADOW_NEAR, SHADOW_FAR);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+
+  /* only depth is drawn */
+  glPushAttrib(GL_ENABLE_BIT);
+  glDisable(GL_LIGHTING);
+
+  for (int i = 0; i < 6; i++) {
+    const GLfloat *f = faces[i];
+    rt_face(&shadowTarget, GL_DEPTH_ATTACHMENT, i);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glLoadIdentity();
+    gluLookAt(light[0], light[1], light[2],
+              light[0]+f[0], light[1]+f[1], light[2]+f[2],
+              f[3], f[4], f[5]);
+    glMultMatrixf(view);
+    drawOccluders(true);
+  }
+
+  glPopAttrib();
+  glPopMatrix(); // GL_MODELVIEW
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+  return;
+}
+
+/* draw the scene shadowed by the shadow map instead of by
+ * projecting the occluders onto each wall: the occluders are
+ * drawn once into the map and once more into the scene, and
+ * the shadows fall on the occluders themselves too.  they
+ * never leave the walls, so they need no stencil clipping */
+void
+drawShadowMappedScene()
+{
+  int i;
+  glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
+
+  /* position light and draw a sphere there */
+  positionAndDrawLight();
+
+  timer_begin(SHADOW_MAP_PASS);
+  drawShadowMap();
+  timer_end(SHADOW_MAP_PASS);
+
+  glUseProgram(shadowProgram);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, rt_attachment(&shadowTarget, GL_DEPTH_ATTACHMENT));
+  glActiveTexture(GL_TEXTURE0);
+  glUniform1i(glGetUniformLocation(shadowProgram, "shadowMap"), 1);
+  glUniform1f(glGetUniformLocation(shadowProgram, "shadowNear"), SHADOW_NEAR);
+  glUniform1f(glGetUniformLocation(shadowProgram, "shadowFar"), SHADOW_FAR);
+  glUniform1f(glGetUniformLocation(shadowProgram, "shadowBias"), SHADOW_BIAS);
+  glUniform1i(glGetUniformLocation(shadowProgram, "shadowFilter"), shadowFilter);
+  glUniform1i(glGetUniformLocation(shadowProgram, "shadowSamples"), shadowSamples);
+  /* the jittered light positions span this far along the
+     diagonal, so filtered penumbrae are as wide as accumulated */
+  glUniform1f(glGetUniformLocation(shadowProgram, "lightSize"),
+              sqrtf(3.0f)*numJitters*jitterAmount);
+
+  timer_begin(WALL_PASS);
+  for (i = FLOOR; i <= REAR_WALL; i++) {
+    if (clippedTo == FRONT_WALL || i == clippedTo) {
+      drawWall(i);
+    }
+  }
+  timer_end(WALL_PASS);
+  timer_begin(OCCLUDER_PASS);
+  drawOccluders(false);
+  timer_end(OCCLUDER_PASS);
+
+  glUseProgram(0);
+
+  return;
+}
+
+/* draw the scene with whichever shadows are chosen */
+void
+drawShadowedScene()
+{
+  scenePasses++;
+  if (shadowMapping) {
+    drawShadowMappedScene();
+  } else {
+    drawScene();
+  }
+
+  return;
+}
+
+/* draw the scene with the framebuffer fbo bound.  when it is
+ * antialiased, it is drawn into the multisampled target instead,
+ * which is then resolved into fbo's draw buffer, so that the
+ * scene is drawn once however many samples there are */
+void
+drawSceneInto(GLuint fbo)
+{
+  if (!msaaSamples) {
+    drawShadowedScene();
+    return;
+  }
+
+  msaaTarget.samples = msaaSamples;
+  rt_bind(&msaaTarget, width, height);
+  drawShadowedScene();
+
+  timer_begin(RESOLVE_PASS);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, msaaTarget.fbo);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  timer_end(RESOLVE_PASS);
+
+  return;
+}
+
+/* put the light at the s-th of its numJitters*3 jittered
+ * positions, each one jitterAmount along one more axis */
+void
+jitterLight(int s)
+{
+  for (int j = 0; j < 3; j++) {
+    lightPos[j] = lightPos0[j] + jitterAmount*(s/3 + (j <= s%3 ? 1 : 0));
+  }
+
+  return;
+}
+
+int
+fbo_accum_init()
+{
   /* TASK 4: YOUR CODE HERE
    *
    * Generate a framebuffer object with a texture object
@@ -382,42 +1103,16 @@ fbo_accum_init()
    * renderbuffer object as GL_DEPTH_STENCIL_ATTACHMENT.
    * Be sure to check that your framebuffer status is 
    * GL_FRAMEBUFFER_COMPLETE.
+   *
+   * The framebuffer object is kept in accumTarget from frame
+   * to frame, and only made again when the window size changes.
    */
-  glGenFramebuffers(1, &fbod);
-  glBindFramebuffer(GL_FRAMEBUFFER, fbod);
-
-  glGenTextures(1, &tbod);
-  glBindTexture(GL_TEXTURE_2D, tbod);
-  // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-  // glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tbod, 0);
+  GLuint fbod = rt_bind(&accumTarget, width, height);
 
-  glGenRenderbuffers(2, rbod);
-  glBindRenderbuffer(GL_RENDERBUFFER, rbod[0]);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB32F, width, height);
-  if ((gl_error = glGetError()) != GL_NO_ERROR) {
-    cerr << "RenderbufferStorage: [" 
-         << gl_error << "] " << glGetString(gl_error) << endl;
-    exit(-1);
-  }
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-                            GL_RENDERBUFFER, rbod[0]);
-
-  glBindRenderbuffer(GL_RENDERBUFFER, rbod[1]);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_STENCIL, width, height);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-                            GL_RENDERBUFFER, rbod[1]);
-
-  if ((gl_error = glCheckFramebufferStatus(GL_FRAMEBUFFER)) !=
-      GL_FRAMEBUFFER_COMPLETE) {
-    cerr << "Framebuffer incomplete [0x" << hex << gl_error << "] "
-         << glGetString(gl_error) << endl;
-    exit(-1);
-  }
+  /* the scene drawn into the texture is
+     what is blended into the accumulation buffer */
+  glBindTexture(GL_TEXTURE_2D, rt_attachment(&accumTarget, GL_COLOR_ATTACHMENT0));
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
   // clear accumulation buffer
   glDrawBuffer(GL_COLOR_ATTACHMENT1);
@@ -432,9 +1127,10 @@ fbo_accum_init()
 }
   
 // assume COLOR_ATTACHMENT0 is a texture object and is the draw buffer
-// and COLOR_ATTACHMENT1 is the accumulation buffer
+// and COLOR_ATTACHMENT1 is the accumulation buffer.  the buffer
+// keeps keep (a blend factor) times what it had
 void
-fbo_accum(float weight)
+fbo_blend(float weight, GLenum keep)
 {
   float quad[4][2] = {
     { -1.0, 1.0 },
@@ -486,7 +1182,7 @@ fbo_accum(float weight)
    */
   glEnable(GL_BLEND);
   glBlendColor(0.0, 0.0, 0.0, weight);
-  glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE);
+  glBlendFunc(GL_CONSTANT_ALPHA, keep);
   glBlendEquation(GL_FUNC_ADD);
 
   /* TASK 4: YOUR CODE HERE
@@ -509,6 +1205,16 @@ fbo_accum(float weight)
   return;
 }
 
+void
+fbo_accum(float weight)
+{
+  timer_begin(ACCUM_PASS);
+  fbo_blend(weight, GL_ONE);
+  timer_end(ACCUM_PASS);
+
+  return;
+}
+
 void
 fbo_accum_return(GLuint fbod)
 {
@@ -537,9 +1243,68 @@ fbo_accum_return(GLuint fbod)
   return;
 }
   
+/* everything the picture depends on, to tell when the
+   history of temporal soft shadows no longer matches it */
+#define NUM_SCENE_KEYS 17
+void
+sceneKeys(GLfloat *keys)
+{
+  GLfloat k[NUM_SCENE_KEYS] = {
+    rotation, lightPos0[0], lightPos0[1], lightPos0[2], viewoffset,
+    (GLfloat)numJitters, jitterAmount, (GLfloat)clippedTo,
+    (GLfloat)stencilClipping, (GLfloat)shadowMapping, (GLfloat)shadowFilter,
+    (GLfloat)shadowSamples, (GLfloat)wallTessellation,
+    (GLfloat)width, (GLfloat)height, (GLfloat)softShadows,
+    (GLfloat)msaaSamples
+  };
+  memcpy(keys, k, sizeof(k));
+
+  return;
+}
+
+/* soft shadows spread over frames.  the accumulation buffer holds
+ * the average of the first historySamples jittered light positions,
+ * and each frame draws the next few and averages them in, weighting
+ * the n-th by 1/n.  once all of them are in, the frame is just the
+ * history.  it starts over when the scene changes */
+void
+drawTemporalShadows()
+{
+  static GLfloat history[NUM_SCENE_KEYS];
+  GLfloat keys[NUM_SCENE_KEYS];
+
+  sceneKeys(keys);
+  if (memcmp(keys, history, sizeof(keys))) {
+    memcpy(history, keys, sizeof(keys));
+    historySamples = 0;
+  }
+
+  GLuint fbod = rt_bind(&accumTarget, width, height);
+  glBindTexture(GL_TEXTURE_2D, rt_attachment(&accumTarget, GL_COLOR_ATTACHMENT0));
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+  for (int i = 0; i < TEMPORAL_SAMPLES && historySamples < numJitters*3; i++) {
+    jitterLight(historySamples);
+    drawSceneInto(fbod);
+    historySamples++;
+    timer_begin(ACCUM_PASS);
+    fbo_blend(1.0f/historySamples, GL_ONE_MINUS_CONSTANT_ALPHA);
+    timer_end(ACCUM_PASS);
+  }
+
+  timer_begin(BLIT_PASS);
+  fbo_accum_return(fbod);
+  timer_end(BLIT_PASS);
+
+  return;
+}
+
 void
 display()
 {
+  timer_frame_begin();
+
   /* prepare the modelview with an offset backward */
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
@@ -551,8 +1316,9 @@ display()
   
   /* if soft shadows are desired, jitter the light position,
      each time accumulating the contents of the framebuffer,
-     then copy the accumulation buffer into the framebuffer */
-  if (softShadows) {
+     then copy the accumulation buffer into the framebuffer.
+     a filtered shadow map is soft in a single pass */
+  if (softShadows && !(shadowMapping && shadowFilter != HARD_FILTER)) {
     /* TASK 3: YOUR CODE HERE: Soft Shadows
      *
      * Jitter the light position using the global variables numJitters
@@ -572,26 +1338,40 @@ display()
      * buffer calls, so you should be able to replace them with a
      * one-to-one mapping.)
     */
-    GLuint fbod = fbo_accum_init(); 
-    for (int i = 0; i < numJitters; i++) {
-      for (int j = 0; j < 3; j++) {
-        lightPos[j] += jitterAmount;
-        drawScene();
+    if (temporalShadows) {
+      drawTemporalShadows();
+    } else {
+      GLuint fbod = fbo_accum_init(); 
+      for (int s = 0; s < numJitters*3; s++) {
+        jitterLight(s);
+        drawSceneInto(fbod);
         fbo_accum(1.0 / numJitters / 3.0);         
       }
-    }
 
-    fbo_accum_return(fbod);
+      timer_begin(BLIT_PASS);
+      fbo_accum_return(fbod);
+      timer_end(BLIT_PASS);
+    }
   } else {
     /* for hard shadows, just draw the scene */
     /* clear the buffers */
-    drawScene();
+    drawSceneInto(0);
+  }
+
+  /* the history is only good for as long as
+     it is drawn into every frame */
+  if (!softShadows || !temporalShadows) {
+    historySamples = 0;
   }
 
   /* with really soft shadows, the application may
      slow greatly, so wait for the pending operations
      to finish */
   glFinish();
+  timer_frame_end();
+  if (timing == TIMING_OVERLAY) {
+    timer_overlay();
+  }
 
   /* and then swap the framebuffer into view */
   glutSwapBuffers();
@@ -599,6 +1379,60 @@ display()
   return;
 }
 
+/* draw frames frames with soft shadows made each way there is,
+ * by accumulating jittered projected or shadow-mapped passes each
+ * frame or over frames, or by filtering the shadow map in one
+ * pass, and print how long a frame takes each way */
+void
+compareSoftShadows(int frames)
+{
+  struct {
+    const char *name;
+    bool soft;
+    bool temporal;
+    bool mapped;
+    int filter;
+  } methods[] = {
+    { "accumulated, projected", true, false, false, HARD_FILTER },
+    { "accumulated, shadow map", true, false, true, HARD_FILTER },
+    { "temporal, projected", true, true, false, HARD_FILTER },
+    { "PCF, shadow map", false, false, true, PCF_FILTER },
+    { "PCSS, shadow map", false, false, true, PCSS_FILTER }
+  };
+  bool soft = softShadows;
+  bool temporal = temporalShadows;
+  bool mapped = shadowMapping;
+  int filter = shadowFilter;
+
+  cerr << numJitters*3 << " jittered passes, " << shadowSamples
+       << " filter samples:" << endl;
+  for (int i = 0; i < (int)(sizeof(methods)/sizeof(methods[0])); i++) {
+    if (methods[i].mapped && !shadersSupported) {
+      continue;
+    }
+    softShadows = methods[i].soft;
+    temporalShadows = methods[i].temporal;
+    shadowMapping = methods[i].mapped;
+    shadowFilter = methods[i].filter;
+
+    /* the first frame makes the render targets it needs */
+    display();
+    int start = glutGet(GLUT_ELAPSED_TIME);
+    for (int f = 0; f < frames; f++) {
+      display();
+    }
+    float ms = (float)(glutGet(GLUT_ELAPSED_TIME) - start)/frames;
+    cerr << "  " << methods[i].name << ": " << ms << " ms/frame" << endl;
+  }
+
+  softShadows = soft;
+  temporalShadows = temporal;
+  shadowMapping = mapped;
+  shadowFilter = filter;
+
+  return;
+}
+
 void
 kbd(unsigned char key, int x, int y)
 {
@@ -606,6 +1440,7 @@ kbd(unsigned char key, int x, int y)
     /* quit on 'escape' */
   case 'q':
   case '\033':
+    rt_release_all();
     exit(0);
     break;
     
@@ -688,6 +1523,74 @@ kbd(unsigned char key, int x, int y)
     cerr << (softShadows ? "Soft" : "Hard" ) << " Shadows" << endl;
     break;
     
+    /* toggles projected/shadow-mapped shadows */
+  case 'm':
+    if (!shadersSupported) {
+      cerr << "Shadow mapping needs the shadowmap shaders" << endl;
+      break;
+    }
+    shadowMapping = !shadowMapping;
+    cerr << (shadowMapping ? "Shadow-mapped" : "Projected") << " Shadows" << endl;
+    break;
+    
+    /* cycles the single-pass filtering of the shadow map */
+  case 'p':
+    if (!shadersSupported) {
+      cerr << "Shadow mapping needs the shadowmap shaders" << endl;
+      break;
+    }
+    shadowMapping = true;
+    shadowFilter = (shadowFilter+1) % NUM_FILTERS;
+    cerr << filterNames[shadowFilter] << " Shadow Map" << endl;
+    break;
+
+    /* fewer/more shadow map samples to filter over */
+  case '[':
+    if (shadowSamples > 1) {
+      shadowSamples--;
+      cerr << "shadowSamples: " << shadowSamples << endl;
+    }
+    break;
+
+  case ']':
+    if (shadowSamples < MAX_SHADOW_SAMPLES) {
+      shadowSamples++;
+      cerr << "shadowSamples: " << shadowSamples << endl;
+    }
+    break;
+
+    /* cycles between not showing the pass
+       times, printing them, and drawing them */
+  case 'i':
+    timing = (timing+1) % NUM_TIMINGS;
+    averagedFrames = 0;
+    break;
+
+    /* cycles antialiasing through off, 2, 4, and 8
+       samples, as far as the driver goes */
+  case 'n': {
+    GLint maxSamples;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    msaaSamples = msaaSamples ? 2*msaaSamples : 2;
+    if (msaaSamples > 8 || msaaSamples > maxSamples) {
+      msaaSamples = 0;
+    }
+    rt_release(&msaaTarget);
+    cerr << "msaaSamples: " << msaaSamples << endl;
+    break;
+  }
+
+    /* time each way of making soft shadows */
+  case 'b':
+    compareSoftShadows(10);
+    break;
+    
+    /* toggles spreading soft shadows over frames */
+  case 'v':
+    temporalShadows = !temporalShadows;
+    cerr << (temporalShadows ? "Temporal" : "Per-frame") << " Soft Shadows" << endl;
+    break;
+    
     /* toggle the visibility of the walls/ceiling */
   case 'x':
     clippedTo++;
@@ -749,6 +1652,18 @@ kbd(unsigned char key, int x, int y)
   return;
 }
 
+/* keep track of the window size, which the
+   render targets are made again to match */
+void
+reshape(int w, int h)
+{
+  width = w;
+  height = h;
+  glViewport(0, 0, w, h);
+
+  return;
+}
+
 void
 initGL()
 {
@@ -783,6 +1698,24 @@ initGL()
   return;
 }
 
+/* keep drawing frames while they are timed into
+   the CSV file, until there are enough of them */
+void
+idle()
+{
+  if (timedFrames >= timerFrames) {
+    rt_release_all();
+    exit(0);
+  }
+  glutPostRedisplay();
+
+  return;
+}
+
+/* glshadows [timings.csv [frames [keys]]] writes the pass times of
+ * every frame to timings.csv.  given a number of frames, it draws
+ * that many after pressing keys, say "mp" for a PCF shadow map,
+ * and quits, to collect times without anyone at the keyboard */
 int
 main (int argc, char *argv[])
 {
@@ -813,16 +1746,30 @@ main (int argc, char *argv[])
   cout <<  "Status: Using GLEW " << glewGetString(GLEW_VERSION) << endl;
 #endif /* __APPLE__ */
 
-  /* set the GLUT callbacks. there is
-     no reshape callback since the
-     default one provided by GLUT does
-     all that is needed here (it simply
-     updates the viewport) */
+  /* set the GLUT callbacks. the reshape
+     callback updates the viewport like the
+     default one and keeps track of the size */
   glutDisplayFunc(display);
   glutKeyboardFunc(kbd);
+  glutReshapeFunc(reshape);
         
   /* prepare OpenGL state */
   initGL();
+
+  /* shadow mapping is only offered if its shaders
+     (shadowmap.vs and shadowmap.fs) load */
+  shadersSupported = InitShaders("shadowmap", "shadowmap", &shadowProgram);
+
+  timer_init();
+  if (argc > 1) {
+    timer_csv_open(argv[1]);
+  }
+  if (argc > 2 && (timerFrames = atoi(argv[2])) > 0) {
+    for (char *key = argc > 3 ? argv[3] : (char *)""; *key; key++) {
+      kbd(*key, 0, 0);
+    }
+    glutIdleFunc(idle);
+  }
         
   /* enter GLUT's event loop */
   glutMainLoop();
@@ -17,12 +17,19 @@
  * Authors: Ari Grant
  *
 */
+// the buffer functions are part of OpenGL 1.5, but
+// linux headers only declare them when asked to
+#ifndef __APPLE__
+#define GL_GLEXT_PROTOTYPES
+#endif
+
 #ifdef __APPLE__
 #include <GLUT/glut.h>
 #else
 #include <GL/glut.h>
 #endif
 
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
@@ -36,487 +43,591 @@ using namespace std;
 #define TOLERANCE 1E-10
 
 
-// the maximum number of faces
-// that can contain a vertex
-#define MAX_FACES_PER_VERTEX 16
+// windows comes with just OpenGL 1.1 and there is no
+// extension loader here, so it draws straight from the
+// arrays in memory instead of from buffers
+#ifndef _WIN32
+#define USE_BUFFERS
+#endif
 
+// what changed in the mesh since the buffers were filled:
+// only the positions, every part of the vertices, the quads
+#define CHANGED_POSITIONS 1
+#define CHANGED_VERTICES 2
+#define CHANGED_QUADS 4
 
-// the maximum number of edges that can contain
-// a vertex. this number should be the same as
-// the number of faces, but two faces may share
-// an edge but not the actual vertices (that
-// meaning that they have copies of the same
-// vertex, which is needed if face-normals are
-// used, opposed to vertex-normals)
-#define MAX_EDGES_PER_VERTEX 2*MAX_FACES_PER_VERTEX
+// the most memory the kept levels not being shown
+// may take, unless set otherwise
+#define LEVEL_BUDGET (64 << 20)
 
 
-// since the mesh class only supports quads,
-// a face will have 4 vertices and 4 edges
-#define VERTICES_PER_FACE 4
-#define EDGES_PER_FACE VERTICES_PER_FACE
+// the memory taken up by the contents of a vector
+template <typename T>
+static size_t
+vectorBytes(const std::vector<T> &v)
+{
+	return v.capacity()*sizeof(T);
+}
 
 
-// since the mesh will always have good topology
-// and be closed, there will be two faces sharing
-// every edge in the mesh
-#define FACES_PER_EDGE 2
+// the memory taken up by a level
+static size_t
+subdivisionBytes(const SubdivisionLevel &level)
+{
+	return vectorBytes(level.positions) + vectorBytes(level.normals)
+		+ vectorBytes(level.colors) + vectorBytes(level.quads)
+		+ vectorBytes(level.cornerNormals) + vectorBytes(level.cornerColors)
+		+ vectorBytes(level.quadEdges) + vectorBytes(level.edgePoints)
+		+ vectorBytes(level.edgeFaces) + vectorBytes(level.pointStart)
+		+ vectorBytes(level.pointFaces) + vectorBytes(level.pointEdges);
+}
 
 
-// average two vertices
-Vertex 
-averageVertices(Vertex a, Vertex b)
+// the vertices and quads to draw a level with, in
+// arrays no bigger than they need to be
+static void
+levelVertices(const SubdivisionLevel &level, std::vector<Vertex> &vertices,
+			  std::vector<Quad> &quads)
 {
-	Vertex result;
-	
-	// average position, normal, and color
-	result.position = (a.position + b.position)/2.0f;
-	result.normal = (a.normal + b.normal)/2.0f;
-	result.color = (a.color + b.color)/2.0f;
-	
-	return result;
+	std::vector<Vertex>(level.pointCount()).swap(vertices);
+	for( unsigned int i = 0; i < vertices.size(); ++i )
+	{
+		vertices[i].position = level.positions[i];
+		vertices[i].normal = level.normals[i];
+		vertices[i].color = level.colors[i];
+	}
+	std::vector<Quad>(level.quads).swap(quads);
+
+  return;
 }
 
 
-// average four vertices
-Vertex 
-averageVertices(Vertex a, Vertex b, Vertex c, Vertex d)
+Mesh::Mesh()
+	: _vertexBuffer(0), _triangleBuffer(0), _edgeBuffer(0), _changed(0),
+	  _levels(0), _adaptive(false), _showLimit(false),
+	  _budget(LEVEL_BUDGET), _version(0), _clock(0)
 {
-	return averageVertices(averageVertices(a,b),averageVertices(c,d));
 }
 
 
-// perform subdivision on the mesh
-void Mesh::subdivide()
+Mesh::~Mesh()
 {
-	// new temporary vectors to build the subdivided mesh;
-	// if any problems occurs during the subdivide, then the
-	// original mesh with remain intact
-	std::vector<Vertex> newVertices;
-	std::vector<Quad> newQuads;
+#ifdef USE_BUFFERS
+	if( _vertexBuffer != 0 )
+	{
+		glDeleteBuffers(1, &_vertexBuffer);
+		glDeleteBuffers(1, &_triangleBuffer);
+		glDeleteBuffers(1, &_edgeBuffer);
+	}
+#endif
+}
 
-	// to create the new vertices
-	Vertex v;
-	
-	// for every face in the mesh
-	for( unsigned int i = 0; i < _quads.size(); ++i )
+
+// weld the mesh into the control cage
+bool
+Mesh::buildCage()
+{
+	// split the vertices into arrays of
+	// positions, normals, and colors
+	unsigned int nVerts = _vertices.size();
+	std::vector<XVec3f> positions(nVerts), normals(nVerts), colors(nVerts);
+	for( unsigned int i = 0; i < nVerts; ++i )
 	{
-		// get the face center
-		Vertex faceCenter = centerOfQuad(i);
-		
-		// add the new vertex to the mesh
-		newVertices.push_back(faceCenter);
-		
-		// get the current quad
-		Quad currentQuad = _quads[i];
-				
-		// for each edge of the face
-		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
-		{
-			// get the two vertex coordinates of the
-			// edge, this will be indices (0,1), (1,2),
-			// (2,3), or (3,0) in the given quad
-			unsigned int k = (j+1) % EDGES_PER_FACE;
-			unsigned int vertex0 = currentQuad(j);
-			unsigned int vertex1 = currentQuad(k);
-			
-			// get the actual edge positions
-			XVec3f v0 = _vertices[vertex0].position;
-			XVec3f v1 = _vertices[vertex1].position;
-			
-			// find the other face with this edge
-			// the number of faces that will be found
-			unsigned int faceCount = 0;
-			
-			// the buffer that will contain the indices
-			// of the faces that contain the edge from
-			// v0 t0 v1
-			unsigned int faces[FACES_PER_EDGE];
-			facesWithEdge(v0, v1, faceCount, faces, FACES_PER_EDGE);
-			
-			// if the edge is not shared by two faces,
-			// stop the subdivision, the mesh stinks!
-			if( faceCount != 2 )
-				return;
-			
-			// get the face that shares this edge
-			//	that is not this face
-			unsigned otherFace = faces[0];
-			if( otherFace == i )
-				otherFace = faces[1];
-			
-			// get the center of the other face
-			Vertex otherFaceCenter = centerOfQuad(otherFace);
-			
-			// TASK 0 //
-			// currently the new edge center is the average of the endpoints
-			// change it to be the average of the two endpoints and the cneters
-			// of the two faces containing the edge. all of what you need is
-			// already prepared, but you should look around and see how it is done
-			Vertex edgeCenter = averageVertices(_vertices[_quads[i](j)],_vertices[_quads[i](k)],
-												faceCenter, otherFaceCenter);
-
-			// add the new averaged edge center to the mesh
-			newVertices.push_back(edgeCenter);
-			
-			// update one end of the edge. the other end will
-			// be taken care of by the other edges, since they
-			// form a closed loop (quad)
-			Vertex updatedVertex = newVertexForSmooth(vertex1);
-			
-			// add the updated vertex to the mesh
-			newVertices.push_back(updatedVertex);
-		}
-		
-		// add the four new faces to the mesh
-		//
-		// the new vertices are added as:
-		//
-		//     add face center vertex
-		//     for each edge:
-		//         add vertex at center of edge
-		//         add vertex at end of edge
-		//
-		// thus the new vertices array will have,
-		// as the last nine vertices, those that
-		// make four new faces. let n be the number
-		// of vertices im the array at this point;
-		// then n-9,n-8,...,n-2, and n-1 will form
-		// a shape with topology shown below
-		//
-		//       (n-3)   (n-4)   (n-5)    
-		//         *-------*-------*
-		//         |       |       |
-		//         |       |       |
-		//         |       |(n-9)  |
-		//   (n-2) *-------*-------* (n-6)
-		//         |       |       |
-		//         |       |       |
-		//         |       |       |
-		//         *-------*-------*
-		//       (n-1)   (n-8)   (n-7)
-		//
-		// so, add the four new faces
-		unsigned int nVerts = newVertices.size();
-		newQuads.push_back(Quad(nVerts-9, nVerts-8, nVerts-7, nVerts-6));
-		newQuads.push_back(Quad(nVerts-9, nVerts-6, nVerts-5, nVerts-4));
-		newQuads.push_back(Quad(nVerts-9, nVerts-4, nVerts-3, nVerts-2));
-		newQuads.push_back(Quad(nVerts-9, nVerts-2, nVerts-1, nVerts-8));
+		positions[i] = _vertices[i].position;
+		normals[i] = _vertices[i].normal;
+		colors[i] = _vertices[i].color;
 	}
 	
-	// clear the mesh vertices and quads
-	_vertices.clear();
-	_quads.clear();
-	
-	// set the mesh to be the new subdivided version
-	_vertices = newVertices;
-	_quads = newQuads;
+	// weld the mesh and find its adjacency. if the mesh
+	// is not closed, stop the subdivision, the mesh stinks!
+	// the original mesh will remain intact
+	return _subdivider.build(positions, normals, colors, _quads, _cage);
+}
+
+
+// set the mesh to the points and quads of a level
+void
+Mesh::show(const SubdivisionLevel &level)
+{
+	levelVertices(level, _vertices, _quads);
+	_changed |= CHANGED_VERTICES | CHANGED_QUADS;
 
   return;
 }
 
 
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
-		// functions for subdivision
-// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+// set the mesh to _refined, on the limit surface if asked to
+void
+Mesh::showRefined()
+{
+	show(_refined);
+	if( !_showLimit )
+		return;
+	
+	std::vector<XVec3f> positions, normals;
+	_subdivider.limitPoints(_refined, positions, normals);
+	for( unsigned int i = 0; i < _vertices.size(); ++i )
+	{
+		_vertices[i].position = positions[i];
+		_vertices[i].normal = normals[i];
+	}
+
+  return;
+}
 
 
-// returns the center vertex of a given quad
-Vertex 
-Mesh::centerOfQuad(unsigned int quad)
+// keep the level being shown in the pyramid
+void
+Mesh::keepShown()
 {
-	// average the four vertices of the given quad
-	return averageVertices(_vertices[_quads[quad](0)],
-						   _vertices[_quads[quad](1)],
-						   _vertices[_quads[quad](2)],
-						   _vertices[_quads[quad](3)]);
+	if( _pyramid.size() <= _levels )
+		_pyramid.resize(_levels + 1);
+	
+	CachedLevel &cached = _pyramid[_levels];
+	cached.level.swap(_refined);
+	cached.stencils.swap(_stencils);
+	cached.vertices.swap(_vertices);
+	cached.quads.swap(_quads);
+	cached.kept = true;
+	cached.onLimit = _levels > 0 && _showLimit;
+	cached.version = _version;
+	cached.lastShown = ++_clock;
+
+  return;
 }
 
 
-// returns true if the given face contains the
-// vertex and if so sets index to be which one
-// it is, so one of 0, 1, 2, or 3
-bool 
-Mesh::faceHasVertex(unsigned int face, XVec3f &vertex, unsigned int &index)
+// subdivide down to level of the pyramid from the
+// deepest level above it that is still kept
+void
+Mesh::computeLevel(unsigned int level)
 {
-	// for each vertex in the face
-    for( unsigned int i = 0; i < VERTICES_PER_FACE; i++ )
-		// check if it is in the same location as vertex
-		if( _vertices[_quads[face](i)].position.dist(vertex) < TOLERANCE )
-		{
-			//if so, record the index, and return true
-			index = i;
-			return true;
-		}
-	// this face does not contain the vertex
-	return false;
+	if( _pyramid.size() <= level )
+		_pyramid.resize(level + 1);
 	
+	// the level before the first subdivision is only ever
+	// dropped when the cage moves, and then it is the cage
+	if( level == 0 )
+	{
+		CachedLevel &cage = _pyramid[0];
+		levelVertices(_cage, cage.vertices, cage.quads);
+		cage.kept = true;
+		cage.onLimit = false;
+		cage.version = _version;
+		return;
+	}
+	
+	unsigned int from = level - 1;
+	while( from > 0 && !_pyramid[from].kept )
+		from--;
+	
+	// a level kept from before the cage moved
+	// catches up with it before going on
+	if( from > 0 && _pyramid[from].version != _version )
+	{
+		CachedLevel &stale = _pyramid[from];
+		if( stale.stencils.pointCount() == 0 )
+			buildStencils(from, stale.stencils);
+		_subdivider.applyStencils(stale.stencils, _cage.positions, stale.level.positions);
+		levelVertices(stale.level, stale.vertices, stale.quads);
+		stale.onLimit = false;
+		stale.version = _version;
+	}
+	
+	// every level on the way down is kept too, with its
+	// stencils if the level above has them
+	for( unsigned int l = from + 1; l <= level; ++l )
+	{
+		const CachedLevel &coarse = _pyramid[l - 1];
+		const SubdivisionLevel &coarseLevel = l == 1 ? _cage : coarse.level;
+		CachedLevel &fine = _pyramid[l];
+		
+		_subdivider.refine(coarseLevel, fine.level);
+		fine.stencils = StencilTable();
+		if( l > 1 && coarse.stencils.pointCount() > 0 )
+			_subdivider.refineStencils(coarseLevel, coarse.stencils, fine.stencils);
+		levelVertices(fine.level, fine.vertices, fine.quads);
+		fine.kept = true;
+		fine.onLimit = false;
+		fine.version = _version;
+		fine.lastShown = ++_clock;
+	}
+
+  return;
 }
 
 
-// fills the array edges with a list of edges containing
-// the given vertex where maxEdges is the size of the array.
-// count will be the number of edges that were found
-void 
-Mesh::edgesWithVertex(XVec3f &v, unsigned int &count, unsigned int *edges, unsigned int maxEdges)
+// move a kept level into the mesh, catching
+// it up with the cage if the cage moved since
+void
+Mesh::takeLevel(unsigned int level)
 {
-	// no edges found yet
-	count = 0;
-	
-	// to record which index of a face is the vertex
-	unsigned int index;
+	CachedLevel &cached = _pyramid[level];
+	_refined.swap(cached.level);
+	_stencils.swap(cached.stencils);
+	_vertices.swap(cached.vertices);
+	_quads.swap(cached.quads);
+	cached.kept = false;
+	cached.lastShown = ++_clock;
+	_levels = level;
+	_changed |= CHANGED_VERTICES | CHANGED_QUADS;
+	
+	if( level == 0 )
+		return;
 	
-	// for every face
-	for( unsigned int m = 0; m < _quads.size(); ++m )
+	if( cached.version != _version )
 	{
-		// see if the face contains the vertex
-		if( faceHasVertex(m, v, index) )
-		{
-			// record the edge from v to the right
-			// if it has not already been found
-			bool edgeAlreadyFound = false;
-			for( unsigned int s = 0; s < count; ++s )
-			{
-				// check if the two vertices are both in the same location as the vertices in the edge
-				if( (_vertices[edges[2*s]].position.dist(_vertices[_quads[m](index)].position) < TOLERANCE
-					 && _vertices[edges[2*s+1]].position.dist(_vertices[_quads[m]((index+1) % 4)].position) < TOLERANCE)
-				   ||
-				    (_vertices[edges[2*s+1]].position.dist(_vertices[_quads[m](index)].position) < TOLERANCE
-					 && _vertices[edges[2*s]].position.dist(_vertices[_quads[m]((index+1) % 4)].position) < TOLERANCE) )
-					edgeAlreadyFound = true;
-			}
-			if( !edgeAlreadyFound )
-			{
-				edges[2*count] = _quads[m](index);
-				edges[2*count+1] = _quads[m]((index+1) % 4);
-				count++;
-			}
-			
-			// record the edge from v to the left
-			// if it has not already been found
-			edgeAlreadyFound = false;
-			for( unsigned int s = 0; s < count; ++s )
-			{
-				// check if the two vertices are both in the same location as the vertices in the edge
-				if( (_vertices[edges[2*s]].position.dist(_vertices[_quads[m](index)].position) < TOLERANCE
-					 && _vertices[edges[2*s+1]].position.dist(_vertices[_quads[m]((index-1) % 4)].position) < TOLERANCE)
-				   ||
-				   (_vertices[edges[2*s+1]].position.dist(_vertices[_quads[m](index)].position) < TOLERANCE
-					&& _vertices[edges[2*s]].position.dist(_vertices[_quads[m]((index-1) % 4)].position) < TOLERANCE) )
-					edgeAlreadyFound = true;
-			}
-			if( !edgeAlreadyFound )
-			{
-				edges[2*count] = _quads[m](index);
-				edges[2*count+1] = _quads[m]((index-1) % 4);
-				count++;
-			}
-			
-			// if the buffer is full, stop
-			if( count >= maxEdges - 2 )
-				return;
-		}
+		if( _stencils.pointCount() == 0 )
+			buildStencils(_levels, _stencils);
+		_subdivider.applyStencils(_stencils, _cage.positions, _refined.positions);
+		showRefined();
 	}
+	else if( cached.onLimit != _showLimit )
+		showRefined();
 
   return;
 }
 
-// fills the array faces with a list of faces containing
-// the given edge from v0 to v1 where maxaFaces is the
-// size of the array. count will be the number of faces
-// that were found
-void 
-Mesh::facesWithEdge(XVec3f &v0, XVec3f &v1, unsigned int &count, unsigned int *faces, unsigned int maxFaces)
+
+// drop the levels shown least recently until within the
+// budget. the level before the first subdivision is tiny
+// and cannot be subdivided again, so it is never dropped
+void
+Mesh::trimLevels()
 {
-	// no faces found yet
-	count = 0;
-	
-	// to record which index of a face is the vertex
-	unsigned int dummy;
-	
-	// for every face
-	for( unsigned int m = 0; m < _quads.size(); ++m )
+	while( levelBytes() > _budget )
 	{
-		// check if the face contains both vertices
-		if( faceHasVertex(m, v0, dummy) && faceHasVertex(m, v1, dummy) )
+		unsigned int oldest = 0;
+		for( unsigned int l = 1; l < _pyramid.size(); ++l )
 		{
-			// if so, record the face
-			faces[count] = m;
-			count++;
-			
-			// if the buffer is full, stop
-			if( count == maxFaces )
-				return;
+			if( _pyramid[l].kept &&
+				(oldest == 0 || _pyramid[l].lastShown < _pyramid[oldest].lastShown) )
+				oldest = l;
 		}
+		if( oldest == 0 )
+			break;
+		
+		// swapping with empty ones frees the memory
+		CachedLevel &dropped = _pyramid[oldest];
+		SubdivisionLevel().swap(dropped.level);
+		StencilTable().swap(dropped.stencils);
+		std::vector<Vertex>().swap(dropped.vertices);
+		std::vector<Quad>().swap(dropped.quads);
+		dropped.kept = false;
 	}
 
   return;
 }
 
 
-// fills the array faces with a list of faces containing
-// the given vertex where maxFaces is the size of the array.
-// count will be the number of faces that were found
-void 
-Mesh::facesWithVertex(XVec3f &v, unsigned int &count,
-						   unsigned int *faces, unsigned int maxFaces)
+// the kept levels follow the cage when they are shown next,
+// except the one before the first subdivision, which is
+// worked out again from the cage
+void
+Mesh::cageMoved()
 {
-	// no faces found yet
-	count = 0;
-	
-	// to record which index of a face is the vertex
-	unsigned int dummy;
-	
-	// for every face
-	for( unsigned int m = 0; m < _quads.size(); ++m )
+	_version++;
+	if( _pyramid.size() > 0 && _pyramid[0].kept )
 	{
-		// check if the face contains the vertex
-		if( faceHasVertex(m, v, dummy) )
-		{
-			// if so, record the face
-			faces[count] = m;
-			count++;
-			
-			// if the buffer is full, stop
-			if( count == maxFaces )
-				return;
-		}
+		std::vector<Vertex>().swap(_pyramid[0].vertices);
+		std::vector<Quad>().swap(_pyramid[0].quads);
+		_pyramid[0].kept = false;
 	}
 
   return;
 }
 
 
-// averages all of the face centers of
-// faces containing the given vertex
-Vertex 
-Mesh::averageFacesAroundVertex(unsigned int vertex)
-{	
-	Vertex result;
-	
-	// get the vertex position
-	XVec3f vert = _vertices[vertex].position;
-	
-	// the number of faces that will be found
-	unsigned int count = 0;
-	
-	// the buffer to contain the face indices
-	static unsigned int faces[MAX_FACES_PER_VERTEX];
-	
-	// fill the buffer with the face indices
-	facesWithVertex(vert, count, faces, MAX_FACES_PER_VERTEX);
- // TASK 2 //
- // set result to be the average of the face centers
- // of all of the faces that were found
-	for (int i = 0; i < count; i++) {
-		result.position += centerOfQuad(faces[i]).position;
-		result.normal += centerOfQuad(faces[i]).normal;
-		result.color += centerOfQuad(faces[i]).color;
+// forget every kept level
+void
+Mesh::dropLevels()
+{
+	std::deque<CachedLevel> dropped;
+	_pyramid.swap(dropped);
+
+  return;
+}
+
+
+// the memory taken by the kept levels not being shown
+size_t
+Mesh::levelBytes() const
+{
+	size_t bytes = 0;
+	for( unsigned int l = 0; l < _pyramid.size(); ++l )
+	{
+		const CachedLevel &cached = _pyramid[l];
+		if( !cached.kept )
+			continue;
+		
+		bytes += subdivisionBytes(cached.level) + vectorBytes(cached.stencils.start)
+			+ vectorBytes(cached.stencils.index) + vectorBytes(cached.stencils.weight)
+			+ vectorBytes(cached.vertices) + vectorBytes(cached.quads);
 	}
-	result.position /= (float)count;
-	result.normal /= (float)count;
-	result.color /= (float)count;
-	return result;
+	return bytes;
 }
 
-// averages all of the edge midpoints of
-// edges containing the given vertex
-Vertex 
-Mesh::averageEdgesAroundVertex(unsigned int vertex)
-{	
-	Vertex result;
+
+// set the budget for the kept levels and drop any past it
+void
+Mesh::setLevelBudget(size_t bytes)
+{
+	_budget = bytes;
+	trimLevels();
+
+  return;
+}
+
+
+// show uniform subdivision level, subdividing down to it if needed
+void
+Mesh::showLevel(unsigned int level)
+{
+	if( _quads.size() == 0 || (level == _levels && !_adaptive) )
+		return;
 	
-	// get the vertex position
-	XVec3f vert = _vertices[vertex].position;
+	// the first subdivision makes the mesh the control cage
+	if( _cage.pointCount() == 0 && (level == 0 || !buildCage()) )
+		return;
 	
-	// the number of edges that will be found
-	unsigned int count = 0;
+	// keep the level being shown. an adaptively
+	// subdivided mesh is not one of the levels
+	if( !_adaptive )
+		keepShown();
+	_adaptive = false;
 	
-	// the buffer that will contain the edges found
-	static unsigned int edges[MAX_EDGES_PER_VERTEX] = { 0 };
+	if( _pyramid.size() <= level || !_pyramid[level].kept )
+		computeLevel(level);
+	takeLevel(level);
+	trimLevels();
+
+  return;
+}
+
+
+// perform subdivision on the mesh, levels times over
+void
+Mesh::subdivide(unsigned int levels)
+{
+	if( levels == 0 )
+		return;
 	
-	// fill the buffer with vertex index-pairs
-	edgesWithVertex(vert, count, edges, MAX_EDGES_PER_VERTEX);
-	// TASK 4 //
-	// set result to be the average of the midpoints of
-	// all of the edges that were found.
-	// the buffer will NOT contain duplicate edges
+	// an adaptively subdivided mesh goes on from the cage
+	showLevel(_adaptive ? levels : _levels + levels);
 
-	for (int i = 0; i < count * 2; i++) {
-		result.position += _vertices[edges[i]].position;
-		result.normal += _vertices[edges[i]].normal;
-		result.color += _vertices[edges[i]].color;
-	}
-	cout << endl;
-	result.position /= (float)(count * 2);
-	result.normal /= (float)(count * 2);
-	result.color /= (float)(count * 2);
-	return result;
+  return;
 }
 
 
-// returns the bumber of faces/edges containing
-// the given vertex. the number of faces and
-// edges is guaranteed to be the same
-unsigned int 
-Mesh::edgesAndFacesForVertex(unsigned int vertex)
+// the level at which the edges of the mesh look about size pixels long
+unsigned int
+Mesh::levelForDistance(float distance, float pixelScale, float size,
+					   unsigned int maxLevel) const
 {
-	unsigned int count = 0;
-	XVec3f v = _vertices[vertex].position;
-	unsigned int dummy;
-	for( unsigned int m = 0; m < _quads.size(); ++m )
+	// the average length of an edge of the cage, or of
+	// the mesh itself if it was never subdivided
+	float length = 0.0f;
+	unsigned int edges = 0;
+	if( _cage.pointCount() > 0 )
 	{
-		if( faceHasVertex(m, v, dummy) )
-			count++;
+		for( unsigned int e = 0; e < _cage.edgeCount(); ++e )
+		{
+			XVec3f a = _cage.positions[_cage.edgePoints[2*e]];
+			length += a.dist(_cage.positions[_cage.edgePoints[2*e+1]]);
+		}
+		edges = _cage.edgeCount();
+	}
+	else
+	{
+		for( unsigned int i = 0; i < _quads.size(); ++i )
+		{
+			for( unsigned int j = 0; j < 4; ++j )
+			{
+				XVec3f a = _vertices[_quads[i](j)].position;
+				length += a.dist(_vertices[_quads[i]((j+1)%4)].position);
+			}
+		}
+		edges = 4*_quads.size();
+	}
+	if( edges == 0 || distance <= 0.0f || size <= 0.0f )
+		return 0;
+	
+	// every level halves the edges
+	float pixels = length/edges*pixelScale/distance;
+	unsigned int level = 0;
+	while( level < maxLevel && pixels > size )
+	{
+		pixels *= 0.5f;
+		level++;
 	}
+	return level;
+}
+
 
-	return count;
+// subdivide the mesh only where criteria asks for it
+void
+Mesh::subdivideAdaptive(const AdaptiveCriteria &criteria)
+{
+	if( _quads.size() == 0 )
+		return;
+	
+	// the first subdivision makes the mesh the control cage
+	if( _cage.pointCount() == 0 && !buildCage() )
+		return;
+	
+	// keep the uniform level being shown in the pyramid
+	if( !_adaptive )
+		keepShown();
+	_levels = 0;
+	_adaptive = true;
+	_criteria = criteria;
+	
+	SubdivisionLevel adapted;
+	_subdivider.refineAdaptive(_cage, _criteria, adapted);
+	show(adapted);
+
+  return;
 }
 
 
-// returns the position of a given vertex by weighting
-// its position from its old location along with the
-// faces and edges containing it
-Vertex 
-Mesh::newVertexForSmooth(unsigned int vertex)
+// where the limit surface is at vertex i
+bool
+Mesh::limitAtVertex(unsigned int i, LimitPoint &limit)
 {
-	// get the number of edges/faces containing the vertex
-	unsigned int count = edgesAndFacesForVertex(vertex);
-
-	// get the average location of the face
-	// centers that contain the given vertex
-	Vertex averageFaces = averageFacesAroundVertex(vertex);
-	
-	// get the average location of the edge
-	// midpoints that contain the given vertex
-	Vertex averageEdges = averageEdgesAroundVertex(vertex);
-	
-	// get the old location of the vertex
-	Vertex oldVertex = _vertices[vertex];
-	
-	// the new vertex
-	// TASK 1 //
-	// set result to be the average of the face centers
- 
-	Vertex result = averageFaces;
-
-	// TASK 3 //
-	// set result to be the average of the edge midpoints
- 
- 	result = averageEdges;
-	// TASK 5 //
-	// set result to be a weighted combination of averageFaces,
-	// averageEdges, and oldVertex. You will have to set the
-	// position, normal, and color separately.
-	// Vertex result = oldVertex;
-
- 	result.position = (averageFaces.position + 2 * averageEdges.position 
- 						+ (count - 3) * oldVertex.position) / count;
- 	result.normal = (averageFaces.normal + 2 * averageEdges.normal 
- 						+ (count - 3) * oldVertex.normal) / count;
- 	result.color = (averageFaces.color + 2 * averageEdges.color 
- 						+ (count - 3) * oldVertex.color) / count;
-	return result;
+	if( _levels == 0 || i >= _refined.pointCount() )
+		return false;
+	
+	_subdivider.limitOfPoint(_refined, i, limit);
+	return true;
+}
+
+
+// where the limit surface is at (u,v) of quad i
+bool
+Mesh::limitAtQuad(unsigned int i, float u, float v, LimitPoint &limit)
+{
+	if( _levels == 0 || i >= _refined.quadCount() )
+		return false;
+	
+	_subdivider.limitOfQuad(_refined, i, u, v, limit);
+	return true;
+}
+
+
+// show a uniformly subdivided mesh on the limit surface or not
+void
+Mesh::setShowLimit(bool showLimit)
+{
+	_showLimit = showLimit;
+	if( _levels > 0 )
+		showRefined();
+
+  return;
+}
+
+
+// split the quads into triangles and find their edges, then fill
+// the buffers again with whatever changed since the last draw
+void
+Mesh::updateBuffers()
+{
+	if( _changed & CHANGED_QUADS )
+	{
+		// two triangles per quad, leaving out the
+		// ones that collapsed to a line or a point
+		_triangles.clear();
+		_triangles.reserve(6*_quads.size());
+		for( unsigned int i = 0; i < _quads.size(); ++i )
+		{
+			const Quad &q = _quads[i];
+			for( unsigned int t = 1; t < 3; ++t )
+			{
+				unsigned int a = q(0), b = q(t), c = q(t+1);
+				if( a == b || b == c || c == a )
+					continue;
+				_triangles.push_back(a);
+				_triangles.push_back(b);
+				_triangles.push_back(c);
+			}
+		}
+		
+		// every side of every quad as the two points at its ends,
+		// smaller one first, packed into one number so that the
+		// sides shared by two quads sort next to each other
+		std::vector<unsigned long long> sides;
+		sides.reserve(4*_quads.size());
+		for( unsigned int i = 0; i < _quads.size(); ++i )
+		{
+			for( unsigned int j = 0; j < 4; ++j )
+			{
+				unsigned long long a = _quads[i](j), b = _quads[i]((j+1)%4);
+				if( a == b )
+					continue;
+				sides.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+			}
+		}
+		std::sort(sides.begin(), sides.end());
+		sides.erase(std::unique(sides.begin(), sides.end()), sides.end());
+		
+		_edges.resize(2*sides.size());
+		for( unsigned int e = 0; e < sides.size(); ++e )
+		{
+			_edges[2*e] = (unsigned int)(sides[e] >> 32);
+			_edges[2*e+1] = (unsigned int)(sides[e] & 0xffffffffu);
+		}
+	}
+	
+#ifdef USE_BUFFERS
+	if( _vertexBuffer == 0 )
+	{
+		glGenBuffers(1, &_vertexBuffer);
+		glGenBuffers(1, &_triangleBuffer);
+		glGenBuffers(1, &_edgeBuffer);
+		_changed |= CHANGED_VERTICES | CHANGED_QUADS;
+	}
+	
+	if( _changed & CHANGED_QUADS )
+	{
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _triangles.size()*sizeof(unsigned int),
+					 _triangles.empty() ? NULL : &_triangles[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _edgeBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _edges.size()*sizeof(unsigned int),
+					 _edges.empty() ? NULL : &_edges[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	
+	// the positions, normals, and colors each take one block of
+	// the buffer, so that the positions can be sent on their own
+	if( _changed & (CHANGED_VERTICES | CHANGED_POSITIONS) )
+	{
+		unsigned int nVerts = _vertices.size();
+		size_t block = nVerts*sizeof(XVec3f);
+		std::vector<XVec3f> staged(nVerts);
+		
+		glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+		if( _changed & CHANGED_VERTICES )
+		{
+			glBufferData(GL_ARRAY_BUFFER, 3*block, NULL, GL_DYNAMIC_DRAW);
+			
+			for( unsigned int i = 0; i < nVerts; ++i )
+				staged[i] = _vertices[i].normal;
+			glBufferSubData(GL_ARRAY_BUFFER, block, block, &staged[0]);
+			
+			for( unsigned int i = 0; i < nVerts; ++i )
+				staged[i] = _vertices[i].color;
+			glBufferSubData(GL_ARRAY_BUFFER, 2*block, block, &staged[0]);
+		}
+		
+		for( unsigned int i = 0; i < nVerts; ++i )
+			staged[i] = _vertices[i].position;
+		glBufferSubData(GL_ARRAY_BUFFER, 0, block, &staged[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+#endif
+	_changed = 0;
+
+  return;
 }
 
 
@@ -527,63 +638,84 @@ Mesh::draw(bool withWireframe)
 	// if there is no mesh, get out!
 	if( _vertices.size() == 0 || _quads.size() == 0 )
 		return;
+	
+	// bring the buffers up to date with the mesh
+	if( _changed != 0 )
+		updateBuffers();
 
 	// enable arrays for vertex positions, normals, and colors.
-	// because the std::vector is tightly packed, the vertoces
-	// array can be passed in with a stride offset simply as
-	// size of an individual vertex
-	//
-	// stare at the next six lines carefully and understand
-	// what it is that they are doing. this is a very common
-	// use since it allows one to have a vertex object, an
-	// array of them, and a simple mechanism to send the
-	// entire batch to the OpenGL pipeline
-	glEnableClientState(GL_VERTEX_ARRAY);   
-	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (float *)&_vertices[0]);
-		
+	// the buffer keeps each of them in one block, one after the
+	// other, so the pointers are offsets into the buffer. without
+	// buffers, the std::vector is tightly packed, so the vertices
+	// array is passed in with a stride of the size of a vertex
+	const unsigned int *triangles, *edges;
+	glEnableClientState(GL_VERTEX_ARRAY);
 	glEnableClientState(GL_NORMAL_ARRAY);
-	glNormalPointer(GL_FLOAT, sizeof(Vertex), (float *)&(_vertices[0].normal));
-		
 	glEnableClientState(GL_COLOR_ARRAY);
+#ifdef USE_BUFFERS
+	size_t block = _vertices.size()*sizeof(XVec3f);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+	glVertexPointer(3, GL_FLOAT, 0, (char *)NULL);
+	glNormalPointer(GL_FLOAT, 0, (char *)NULL + block);
+	glColorPointer(3, GL_FLOAT, 0, (char *)NULL + 2*block);
+	triangles = NULL;
+	edges = NULL;
+#else
+	glVertexPointer(3, GL_FLOAT, sizeof(Vertex), (float *)&_vertices[0]);
+	glNormalPointer(GL_FLOAT, sizeof(Vertex), (float *)&(_vertices[0].normal));
 	glColorPointer(3, GL_FLOAT, sizeof(Vertex), (float *)(_vertices[0].color));
+	triangles = &_triangles[0];
+	edges = &_edges[0];
+#endif
 	
+	// save the polygon and enable state
+	glPushAttrib(GL_POLYGON_BIT | GL_ENABLE_BIT);
+	
+	// push the triangles back a little under the wireframe
+	// to avoid z-fighting, since the lines are not polygons
+	// and a polygon offset would not move them
+	if( withWireframe )
+	{
+		glPolygonOffset(1.0f, 1.0f);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+	}
 	
 	// with the vertex positions, normals, and colors arrays
-	// setup, draw the quads using the coordinates 4-tuples
-	// stored in the _quads array
-	glDrawElements(GL_QUADS, (GLint)_quads.size()*4, GL_UNSIGNED_INT, (unsigned int *)&_quads[0]);
+	// setup, draw the triangles the quads were split into
+#ifdef USE_BUFFERS
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _triangleBuffer);
+#endif
+	glDrawElements(GL_TRIANGLES, (GLint)_triangles.size(), GL_UNSIGNED_INT, triangles);
 	
 	
 	// draw the wireframe if requested
 	if( withWireframe )
 	{
-		// save the polygon and enable state
-		glPushAttrib(GL_POLYGON_BIT | GL_ENABLE_BIT);
-		
-		// set the polygon draw mode to line, for wireframe
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		
 		// turn off lighting so wireframe is flat-colored
 		glDisable(GL_LIGHTING);
 		
-		// set a polygon offset to avoid z-fighting
-		glPolygonOffset(-1.0f, -5.0f);
-		glEnable(GL_POLYGON_OFFSET_LINE);
-
 		// draw the wireframe with a dark gray
 		glDisableClientState(GL_COLOR_ARRAY);
 		glColor3f(0.3f, 0.3f, 0.3f);
 		
-		// draw the wireframe
-		glDrawElements(GL_QUADS, (GLint)_quads.size()*4, GL_UNSIGNED_INT, (unsigned int *)&_quads[0]);
-		
-		// return the polygon and enable state
-		glPopAttrib();
+		// draw every edge once
+#ifdef USE_BUFFERS
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _edgeBuffer);
+#endif
+		glDrawElements(GL_LINES, (GLint)_edges.size(), GL_UNSIGNED_INT, edges);
 	}
 	
+	// return the polygon and enable state
+	glPopAttrib();
+	
 	// disable vertex arrays
+#ifdef USE_BUFFERS
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
 
   return;
 }
@@ -595,27 +727,98 @@ frand()
   return rand()/(float)RAND_MAX; 
 }
 
+// work out the weights of the cage points making up the points
+// of a level, by subdividing the cage down to it again
+void
+Mesh::buildStencils(unsigned int levels, StencilTable &stencils)
+{
+	SubdivisionLevel coarse = _cage;
+	SubdivisionLevel fine;
+	StencilTable fineStencils;
+	
+	stencils.identity(_cage.pointCount());
+	for( unsigned int l = 0; l < levels; ++l )
+	{
+		_subdivider.refine(coarse, fine);
+		_subdivider.refineStencils(coarse, stencils, fineStencils);
+		coarse.swap(fine);
+		stencils.swap(fineStencils);
+	}
+
+  return;
+}
+
+// a funky random displacement for a vertex
+static XVec3f
+randomDisplacement(XVec3f currentVertex)
+{
+	// make some random numbers
+	float a = 0.1f*frand()-0.05f;
+	float b = 0.1f*sinf(a);
+	float c = 0.1f*sinf(b)*a+b;
+	float y = currentVertex.y();
+	float y2 = y*y;
+	
+	// create a funky displacement
+	return XVec3f(a,b,c)
+		+ currentVertex * y2 * 0.03f * (0.5f + a)
+		+ XVec3f(0.05f*sinf(10.0f*y), 0.05f*cosf(currentVertex.x()+y), 0.0f);
+}
+
 // randomize the vertices in the mesh
 void 
 Mesh::randomize()
 {	
+	// an adaptively subdivided mesh moves the points of
+	// its control cage and is subdivided again
+	if( _adaptive )
+	{
+		for( unsigned int p = 0; p < _cage.pointCount(); ++p )
+			_cage.positions[p] += randomDisplacement(_cage.positions[p]);
+		cageMoved();
+		
+		SubdivisionLevel adapted;
+		_subdivider.refineAdaptive(_cage, _criteria, adapted);
+		show(adapted);
+		
+		return;
+	}
+	
+	// a subdivided mesh moves the points of its control
+	// cage and then follows them using the stencils
+	if( _levels > 0 )
+	{
+		if( _stencils.pointCount() == 0 )
+			buildStencils(_levels, _stencils);
+		
+		for( unsigned int p = 0; p < _cage.pointCount(); ++p )
+			_cage.positions[p] += randomDisplacement(_cage.positions[p]);
+		cageMoved();
+		
+		_subdivider.applyStencils(_stencils, _cage.positions, _refined.positions);
+		if( _showLimit )
+			showRefined();
+		else
+		{
+			for( unsigned int i = 0; i < _vertices.size(); ++i )
+				_vertices[i].position = _refined.positions[i];
+			_changed |= CHANGED_POSITIONS;
+		}
+		
+		return;
+	}
+	
+	// the mesh itself becomes a different cage
+	// the next time it is subdivided
+	_cage = SubdivisionLevel();
+	dropLevels();
+	
 	// for every vertex
 	for( unsigned int i = 0; i < _vertices.size(); ++i )
 	{
 		// get the vertex
 		XVec3f currentVertex = _vertices[i].position;
-		
-		// make some random numbers
-		float a = 0.1f*frand()-0.05f;
-		float b = 0.1f*sinf(a);
-		float c = 0.1f*sinf(b)*a+b;
-		float y = currentVertex.y();
-		float y2 = y*y;
-		
-		// create a funky displacement
-		XVec3f disp = XVec3f(a,b,c)
-			+ currentVertex * y2 * 0.03f * (0.5f + a)
-			+ XVec3f(0.05f*sinf(10.0f*y), 0.05f*cosf(currentVertex.x()+y), 0.0f);
+		XVec3f disp = randomDisplacement(currentVertex);
 		
 		// find any vertex at the same location and displace it as well
 		for( unsigned int j = 0; j < _vertices.size(); ++j ) {
@@ -626,6 +829,24 @@ Mesh::randomize()
 		// displace the vertex
 		_vertices[i].position += disp;
 	}
+	_changed |= CHANGED_POSITIONS;
+
+  return;
+}
+
+// forget the mesh and everything subdivided from it
+void
+Mesh::reset()
+{
+	std::vector<Vertex>().swap(_vertices);
+	std::vector<Quad>().swap(_quads);
+	_levels = 0;
+	_adaptive = false;
+	_changed |= CHANGED_VERTICES | CHANGED_QUADS;
+	_cage = SubdivisionLevel();
+	_refined = SubdivisionLevel();
+	_stencils = StencilTable();
+	dropLevels();
 
   return;
 }
@@ -635,8 +856,7 @@ void
 Mesh::toCube()
 {
 	// clear out the old data	
-	_vertices.clear();
-	_quads.clear();
+	reset();
 	
 	// seed rand for randomization of vertices */
 	srand(4);
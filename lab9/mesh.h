@@ -21,7 +21,9 @@
 #define __MESH_H__
 
 #include <vector>
+#include <deque>
 #include "xvec.h"
+#include "subdivider.h"
 
 // the basic vertex object
 typedef struct Vertex
@@ -41,21 +43,79 @@ typedef XVec4ui Quad;
 class Mesh
 {
 public:
-	Mesh() {}
-	~Mesh() {}
-	
-	// perform subdivision on the mesh
-	void subdivide();
-	
-	// draw the mesh
+	Mesh();
+	~Mesh();
+	
+	// perform subdivision on the mesh, levels times over
+	void subdivide(unsigned int levels = 1);
+	
+	// show uniform subdivision level (0 is the mesh as it was before
+	// it was subdivided). levels that were shown before are kept, so
+	// going back to one is instant, and a missing one is subdivided
+	// from the deepest level above it that is still kept
+	void showLevel(unsigned int level);
+	unsigned int level() const { return _levels; }
+	
+	// the level at which the edges of the mesh look about size pixels
+	// long from distance away, but no deeper than maxLevel. pixelScale
+	// is how many pixels something one unit long covers one unit away
+	unsigned int levelForDistance(float distance, float pixelScale,
+								  float size, unsigned int maxLevel) const;
+	
+	// the most memory the kept levels not being shown may take, in
+	// bytes. past it the levels shown least recently are dropped
+	void setLevelBudget(size_t bytes);
+	size_t levelBudget() const { return _budget; }
+	size_t levelBytes() const;
+	
+	// subdivide the mesh only where criteria asks for it, starting
+	// over from the control cage if the mesh is already subdivided.
+	// subdivide() goes on from the cage after this
+	void subdivideAdaptive(const AdaptiveCriteria &criteria);
+	
+	// the number of threads to subdivide with,
+	// 0 means one per processor
+	void setSubdivisionThreads(unsigned int threads) { _subdivider.setThreads(threads); }
+	unsigned int subdivisionThreads() const { return _subdivider.threads(); }
+	
+	// where the limit surface of the subdivided mesh is, at
+	// vertex i or at (u,v) of quad i, with (0,0) at the first
+	// corner of the quad and (1,0) at the second. returns false
+	// if the mesh is not uniformly subdivided
+	bool limitAtVertex(unsigned int i, LimitPoint &limit);
+	bool limitAtQuad(unsigned int i, float u, float v, LimitPoint &limit);
+	
+	// whether a uniformly subdivided mesh is shown with its
+	// vertices moved to the limit surface, with its normals
+	void setShowLimit(bool showLimit);
+	bool showsLimit() const { return _showLimit; }
+	
+	// draw the mesh. it is drawn from buffers on the graphics card,
+	// which are filled again only with what changed since the last draw
 	void draw(bool withWireframe);
 	
-	// randomize the vertex locations
+	// randomize the vertex locations. once the mesh is
+	// subdivided, this moves its control cage instead
 	void randomize();
 	
 	// become a cube
 	void toCube();
 	
+	// read the mesh from a Wavefront OBJ file or a PLY file (binary
+	// or ascii), by the extension of path, or write it to one. faces
+	// that are not quads are split into quads. returns false, leaving
+	// the mesh as it was, if the file can't be read or written
+	bool load(const char *path);
+	bool loadOBJ(const char *path);
+	bool loadPLY(const char *path);
+	bool save(const char *path) const;
+	bool saveOBJ(const char *path) const;
+	bool savePLY(const char *path) const;
+	
+	// the size of the mesh
+	unsigned int vertexCount() const { return _vertices.size(); }
+	unsigned int quadCount() const { return _quads.size(); }
+	
 private:
 	// coordinate array of vertices
 	std::vector<Vertex> _vertices;
@@ -63,64 +123,107 @@ private:
 	// the list of quads in the mesh
 	std::vector<Quad> _quads;
 	
-	
-	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
-			// functions for subdivision
-	// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
-	
-	
-	// returns the center vertex of a given quad
-	Vertex centerOfQuad(unsigned int quad);
-	
-	
-	// returns true if the given face contains the
-	// vertex and if so sets index to be which one
-	// it is, so one of 0, 1, 2, or 3
-	bool faceHasVertex(unsigned int face, XVec3f &vertex, unsigned int &index);
-	
-	
-	// returns the bumber of faces/edges containing
-	// the given vertex. the number of faces and
-	// edges is guaranteed to be the same
-	unsigned int edgesAndFacesForVertex(unsigned int vertex);
-	
-	
-	// fills the array edges with a list of edges containing
-	// the given vertex where maxEdges is the size of the array.
-	// count will be the number of edges that were found
-	void edgesWithVertex(XVec3f &v, unsigned int &count,
-						 unsigned int *edges, unsigned int maxEdges);
-	
-	
-	// fills the array faces with a list of faces containing
-	// the given edge from v0 to v1 where maxaFaces is the
-	// size of the array. count will be the number of faces
-	// that were found
-	void facesWithEdge(XVec3f &v0, XVec3f &v1, unsigned int &count,
-					   unsigned int *faces, unsigned int maxFaces);
-	
-	
-	// fills the array faces with a list of faces containing
-	// the given vertex where maxFaces is the size of the array.
-	// count will be the number of faces that were found
-	void facesWithVertex(XVec3f &pt, unsigned int &count,
-						 unsigned int *faces, unsigned int maxFaces);
-	
-	
-	// averages all of the face centers of
-	// faces containing the given vertex
-	Vertex averageFacesAroundVertex(unsigned int vertex);
-	
-	
-	// averages all of the edge midpoints of
-	// edges containing the given vertex
-	Vertex averageEdgesAroundVertex(unsigned int vertex);
-	
-	
-	// returns the position of a given vertex by weighting
-	// its position from its old location along with the
-	// faces and edges containing it
-	Vertex newVertexForSmooth(unsigned int vertex);
+	// the quads split into triangles, and every edge of
+	// the quads once, for drawing the mesh and its wireframe
+	std::vector<unsigned int> _triangles;
+	std::vector<unsigned int> _edges;
+	
+	// the buffers the vertices (the positions, then the normals,
+	// then the colors), triangles, and edges are drawn from, 0
+	// until the first draw, and what changed since they were filled
+	unsigned int _vertexBuffer;
+	unsigned int _triangleBuffer;
+	unsigned int _edgeBuffer;
+	unsigned int _changed;
+	
+	
+	// subdivides the mesh in parallel
+	Subdivider _subdivider;
+	
+	// once subdivided, the control cage the mesh was subdivided
+	// from, the current level, how many levels down it is, and
+	// the weights of the cage points making up its points. the
+	// weights are worked out the first time the cage moves, and
+	// kept up with further subdivision from then on
+	SubdivisionLevel _cage;
+	SubdivisionLevel _refined;
+	unsigned int _levels;
+	StencilTable _stencils;
+	
+	// whether the mesh was last subdivided adaptively, and how
+	bool _adaptive;
+	AdaptiveCriteria _criteria;
+	
+	// whether to show the limit surface
+	bool _showLimit;
+	
+	// a uniform level kept to be shown again: the level to subdivide
+	// further from, its stencils once worked out, and the vertices and
+	// quads to draw it with. the level being shown lives in _refined,
+	// _stencils, _vertices, and _quads instead, and is traded back
+	// when another level is shown. version is the edit of the cage
+	// the points were last moved to
+	typedef struct CachedLevel
+	{
+		CachedLevel() : kept(false), onLimit(false), version(0), lastShown(0) {}
+		
+		SubdivisionLevel level;
+		StencilTable stencils;
+		std::vector<Vertex> vertices;
+		std::vector<Quad> quads;
+		bool kept;
+		bool onLimit;
+		unsigned long version;
+		unsigned long lastShown;
+		
+	} CachedLevel;
+	
+	// the kept levels by how many times they were subdivided, a
+	// deque so that adding deeper levels does not copy the rest
+	std::deque<CachedLevel> _pyramid;
+	
+	// the budget for the kept levels in bytes, the count of
+	// edits made to the cage, and the count of levels shown
+	size_t _budget;
+	unsigned long _version;
+	unsigned long _clock;
+	
+	// forget the mesh and everything subdivided from it
+	void reset();
+	
+	// weld the mesh into _cage, false if it can't be subdivided
+	bool buildCage();
+	
+	// work out the stencils for a level of the cage
+	void buildStencils(unsigned int levels, StencilTable &stencils);
+	
+	// set the mesh to the points and quads of a level
+	void show(const SubdivisionLevel &level);
+	
+	// keep the level being shown in the pyramid
+	void keepShown();
+	
+	// subdivide down to level of the pyramid
+	void computeLevel(unsigned int level);
+	
+	// move a kept level into the mesh
+	void takeLevel(unsigned int level);
+	
+	// drop the levels shown least recently until within the budget
+	void trimLevels();
+	
+	// the cage moved, the kept levels are behind it
+	void cageMoved();
+	
+	// forget every kept level
+	void dropLevels();
+	
+	// set the mesh to _refined, on the limit surface if asked to
+	void showRefined();
+	
+	// work out the triangles and edges and fill the buffers again
+	// with whatever changed since the last draw
+	void updateBuffers();
 };
 
 #endif /* __MESH_H__ */
@@ -0,0 +1,1333 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "xvec.h"
+#include "mesh.h"
+
+// the color of vertices the file gives none
+#define DEFAULT_COLOR XVec3f(0.8f, 0.8f, 0.8f)
+
+// the most sides a face may have
+#define MAX_SIDES 255
+
+// no vertex, or no normal
+#define NO_INDEX 0xffffffffu
+
+// how much is written to a file at once
+#define WRITE_BUFFER (1 << 20)
+
+// the longest line of a PLY header, and the
+// longest name of an element or a property
+#define PLY_LINE 256
+#define PLY_NAME 32
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// reading files
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// the whole of a file in memory, mapped
+// straight from the file where it can be
+typedef struct MappedFile
+{
+	const char *data;
+	size_t size;
+	bool mapped;
+} MappedFile;
+
+
+// bring the file at path into memory
+static bool
+openFile(const char *path, MappedFile &file)
+{
+	file.data = NULL;
+	file.size = 0;
+	file.mapped = false;
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if( fd < 0 )
+		return false;
+
+	struct stat info;
+	if( fstat(fd, &info) != 0 )
+	{
+		close(fd);
+		return false;
+	}
+
+	file.size = info.st_size;
+	if( file.size > 0 )
+	{
+		void *data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if( data == MAP_FAILED )
+		{
+			close(fd);
+			return false;
+		}
+		madvise(data, file.size, MADV_SEQUENTIAL);
+		file.data = (const char *)data;
+		file.mapped = true;
+	}
+	close(fd);
+#else
+	// no mmap, read it all in one go instead
+	FILE *f = fopen(path, "rb");
+	if( f == NULL )
+		return false;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if( size > 0 )
+	{
+		char *data = (char *)malloc(size);
+		if( data == NULL || fread(data, 1, size, f) != (size_t)size )
+		{
+			free(data);
+			fclose(f);
+			return false;
+		}
+		file.data = data;
+		file.size = size;
+	}
+	fclose(f);
+#endif
+
+	return true;
+}
+
+
+// let go of a file brought in by openFile()
+static void
+closeFile(MappedFile &file)
+{
+#ifndef _WIN32
+	if( file.mapped )
+		munmap((void *)file.data, file.size);
+#else
+	free((void *)file.data);
+#endif
+	file.data = NULL;
+	file.size = 0;
+
+  return;
+}
+
+
+// ten to the power e
+static double
+powerOfTen(int e)
+{
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	if( e >= 0 && e <= 22 )
+		return powers[e];
+	return pow(10.0, e);
+}
+
+
+// read a decimal number at p and move p past it, false if there
+// is none. the digits are gathered into an integer and scaled
+// once at the end, which is a lot faster than strtod
+static bool
+parseNumber(const char *&p, const char *end, double &value)
+{
+	const char *s = p;
+	bool negative = false;
+	if( s < end && (*s == '-' || *s == '+') )
+	{
+		negative = *s == '-';
+		++s;
+	}
+
+	// digits past the eighteenth only move the decimal point
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	for( ; s < end && *s >= '0' && *s <= '9'; ++s, ++digits )
+	{
+		if( mantissa < 100000000000000000ULL )
+			mantissa = 10*mantissa + (*s - '0');
+		else
+			exponent++;
+	}
+	if( s < end && *s == '.' )
+	{
+		for( ++s; s < end && *s >= '0' && *s <= '9'; ++s, ++digits )
+		{
+			if( mantissa < 100000000000000000ULL )
+			{
+				mantissa = 10*mantissa + (*s - '0');
+				exponent--;
+			}
+		}
+	}
+	if( digits == 0 )
+		return false;
+
+	if( s < end && (*s == 'e' || *s == 'E') )
+	{
+		const char *e = s + 1;
+		bool negativeExponent = false;
+		if( e < end && (*e == '-' || *e == '+') )
+		{
+			negativeExponent = *e == '-';
+			++e;
+		}
+		if( e < end && *e >= '0' && *e <= '9' )
+		{
+			int power = 0;
+			for( ; e < end && *e >= '0' && *e <= '9'; ++e )
+			{
+				if( power < 10000 )
+					power = 10*power + (*e - '0');
+			}
+			exponent += negativeExponent ? -power : power;
+			s = e;
+		}
+	}
+
+	value = (double)mantissa;
+	if( exponent > 0 )
+		value *= powerOfTen(exponent);
+	else if( exponent < 0 )
+		value /= powerOfTen(-exponent);
+	if( negative )
+		value = -value;
+
+	p = s;
+	return true;
+}
+
+
+// read a whole number at p and move p past it, false if there is none
+static bool
+parseInteger(const char *&p, const char *end, long &value)
+{
+	const char *s = p;
+	bool negative = false;
+	if( s < end && (*s == '-' || *s == '+') )
+	{
+		negative = *s == '-';
+		++s;
+	}
+	if( s >= end || *s < '0' || *s > '9' )
+		return false;
+
+	long n = 0;
+	for( ; s < end && *s >= '0' && *s <= '9'; ++s )
+		n = 10*n + (*s - '0');
+	value = negative ? -n : n;
+
+	p = s;
+	return true;
+}
+
+
+// whether c separates words on a line
+static inline bool
+isBlank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+// move p past spaces and tabs, but not past the end of the line
+static inline void
+skipBlanks(const char *&p, const char *end)
+{
+	while( p < end && isBlank(*p) )
+		++p;
+}
+
+
+// move p to the start of the next line
+static inline void
+skipLine(const char *&p, const char *end)
+{
+	const char *newline = (const char *)memchr(p, '\n', end - p);
+	p = newline != NULL ? newline + 1 : end;
+}
+
+
+// read three numbers separated by blanks at p
+static bool
+parseTriple(const char *&p, const char *end, XVec3f &value)
+{
+	for( int i = 0; i < 3; ++i )
+	{
+		double x;
+		skipBlanks(p, end);
+		if( !parseNumber(p, end, x) )
+			return false;
+		value(i) = x;
+	}
+	return true;
+}
+
+
+// the faces of a file as lists of vertices, with how many sides
+// each has. faces are kept like this until all of them have been
+// read, since a single face with an odd number of sides changes
+// how all of them are made into quads
+typedef struct Polygons
+{
+	std::vector<unsigned char> sides;
+	std::vector<unsigned int> corners;
+	bool allQuads;
+	bool anyOdd;
+
+	Polygons() : allQuads(true), anyOdd(false) {}
+} Polygons;
+
+
+// add a face to polygons, false if it has too few or too many sides
+static bool
+addPolygon(Polygons &polygons, unsigned int sides)
+{
+	if( sides < 3 || sides > MAX_SIDES )
+		return false;
+
+	polygons.sides.push_back((unsigned char)sides);
+	polygons.allQuads = polygons.allQuads && sides == 4;
+	polygons.anyOdd = polygons.anyOdd || sides % 2 == 1;
+	return true;
+}
+
+
+// give every vertex without a normal the average of the
+// normals of the faces around it, weighted by their area
+static void
+fillNormals(std::vector<Vertex> &vertices, const Polygons &polygons)
+{
+	std::vector<unsigned char> missing(vertices.size());
+	bool anyMissing = false;
+	for( unsigned int i = 0; i < vertices.size(); ++i )
+	{
+		missing[i] = vertices[i].normal.dot() == 0.0f;
+		anyMissing = anyMissing || missing[i];
+	}
+	if( !anyMissing )
+		return;
+
+	const unsigned int *corners = polygons.corners.empty() ? NULL : &polygons.corners[0];
+	for( unsigned int f = 0; f < polygons.sides.size(); ++f )
+	{
+		unsigned int sides = polygons.sides[f];
+
+		// the sum of the crosses of the sides is twice the area
+		// of the face along its normal, even for a bent face
+		XVec3f normal(0.0f);
+		for( unsigned int j = 0; j < sides; ++j )
+		{
+			const XVec3f &a = vertices[corners[j]].position;
+			normal += a.cross(vertices[corners[(j+1)%sides]].position);
+		}
+		for( unsigned int j = 0; j < sides; ++j )
+		{
+			if( missing[corners[j]] )
+				vertices[corners[j]].normal += normal;
+		}
+		corners += sides;
+	}
+
+	for( unsigned int i = 0; i < vertices.size(); ++i )
+	{
+		if( missing[i] )
+			vertices[i].normal.normalize();
+	}
+
+  return;
+}
+
+
+// a vertex halfway between vertices a and b. the position is
+// worked out the same from either end, so that the vertices
+// neighboring faces make on the same edge weld together
+static Vertex
+midpoint(const Vertex &a, const Vertex &b)
+{
+	Vertex m;
+	m.position = (a.position + b.position)*0.5f;
+	m.normal = a.normal + b.normal;
+	m.normal.normalize();
+	m.color = (a.color + b.color)*0.5f;
+	return m;
+}
+
+
+// make the faces into quads. quads stay as they are and faces with
+// an even number of sides are split into a fan of quads, but if any
+// face has an odd number, every face is split into quads around its
+// center instead, so that the faces still meet edge to edge
+static void
+polygonsToQuads(std::vector<Vertex> &vertices, const Polygons &polygons,
+				std::vector<Quad> &quads)
+{
+	const unsigned int *corners = polygons.corners.empty() ? NULL : &polygons.corners[0];
+	unsigned int nFaces = polygons.sides.size();
+
+	if( polygons.allQuads )
+	{
+		quads.resize(nFaces);
+		for( unsigned int f = 0; f < nFaces; ++f )
+			quads[f] = Quad(corners[4*f], corners[4*f+1], corners[4*f+2], corners[4*f+3]);
+		return;
+	}
+
+	if( !polygons.anyOdd )
+	{
+		for( unsigned int f = 0; f < nFaces; ++f )
+		{
+			unsigned int sides = polygons.sides[f];
+			for( unsigned int j = 1; j + 2 < sides; j += 2 )
+				quads.push_back(Quad(corners[0], corners[j], corners[j+1], corners[j+2]));
+			corners += sides;
+		}
+		return;
+	}
+
+	// a vertex at the center of each face and one in the
+	// middle of each side, and a quad around every corner
+	for( unsigned int f = 0; f < nFaces; ++f )
+	{
+		unsigned int sides = polygons.sides[f];
+
+		Vertex center;
+		for( unsigned int j = 0; j < sides; ++j )
+		{
+			center.position += vertices[corners[j]].position;
+			center.normal += vertices[corners[j]].normal;
+			center.color += vertices[corners[j]].color;
+		}
+		center.position /= (float)sides;
+		center.normal.normalize();
+		center.color /= (float)sides;
+
+		unsigned int c = vertices.size();
+		vertices.push_back(center);
+		unsigned int firstMiddle = vertices.size();
+		for( unsigned int j = 0; j < sides; ++j )
+			vertices.push_back(midpoint(vertices[corners[j]], vertices[corners[(j+1)%sides]]));
+
+		for( unsigned int j = 0; j < sides; ++j )
+		{
+			unsigned int before = firstMiddle + (j + sides - 1)%sides;
+			quads.push_back(Quad(corners[j], firstMiddle + j, c, before));
+		}
+		corners += sides;
+	}
+
+  return;
+}
+
+
+// read a Wavefront OBJ file. positions may be followed by a color,
+// and faces may give normals, which make separate vertices of the
+// same position wherever they differ
+bool
+Mesh::loadOBJ(const char *path)
+{
+	MappedFile file;
+	if( !openFile(path, file) )
+	{
+		fprintf(stderr, "%s: can't read the file\n", path);
+		return false;
+	}
+
+	std::vector<XVec3f> positions, colors, normals;
+	std::vector<Vertex> vertices;
+	Polygons polygons;
+
+	// every position has a list of the vertices made at it, one per
+	// normal. firstVertex has the start of the list for each position,
+	// and nextVertex and vertexNormal the next one and the normal of each
+	std::vector<unsigned int> firstVertex, nextVertex, vertexNormal;
+
+	const char *p = file.data, *end = file.data + file.size;
+	unsigned int line = 1;
+	const char *error = NULL;
+	while( p < end && error == NULL )
+	{
+		skipBlanks(p, end);
+
+		if( end - p > 2 && p[0] == 'v' && isBlank(p[1]) )
+		{
+			// a position, maybe with a color
+			XVec3f position, color;
+			++p;
+			if( !parseTriple(p, end, position) )
+			{
+				error = "bad position";
+				break;
+			}
+			positions.push_back(position);
+			colors.push_back(parseTriple(p, end, color) ? color : DEFAULT_COLOR);
+			firstVertex.push_back(NO_INDEX);
+		}
+		else if( end - p > 3 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2]) )
+		{
+			XVec3f normal;
+			p += 2;
+			if( !parseTriple(p, end, normal) )
+			{
+				error = "bad normal";
+				break;
+			}
+			normals.push_back(normal);
+		}
+		else if( end - p > 2 && p[0] == 'f' && isBlank(p[1]) )
+		{
+			// corners are v, v/vt, v//vn, or v/vt/vn, counting from
+			// one, or back from the last one read if negative
+			unsigned int sides = 0;
+			++p;
+			for( ;; )
+			{
+				skipBlanks(p, end);
+				if( p >= end || *p == '\n' || *p == '#' )
+					break;
+
+				long v, vt, vn = 0;
+				if( !parseInteger(p, end, v) )
+				{
+					error = "bad face";
+					break;
+				}
+				if( p < end && *p == '/' )
+				{
+					++p;
+					if( p < end && *p != '/' && !parseInteger(p, end, vt) )
+					{
+						error = "bad face";
+						break;
+					}
+					if( p < end && *p == '/' )
+					{
+						++p;
+						if( !parseInteger(p, end, vn) )
+						{
+							error = "bad face";
+							break;
+						}
+					}
+				}
+
+				v = v < 0 ? (long)positions.size() + v : v - 1;
+				if( v < 0 || v >= (long)positions.size() )
+				{
+					error = "face uses a missing position";
+					break;
+				}
+				unsigned int n = NO_INDEX;
+				if( vn != 0 )
+				{
+					vn = vn < 0 ? (long)normals.size() + vn : vn - 1;
+					if( vn < 0 || vn >= (long)normals.size() )
+					{
+						error = "face uses a missing normal";
+						break;
+					}
+					n = vn;
+				}
+
+				// find the vertex for this position and normal, or make it
+				unsigned int i = firstVertex[v];
+				while( i != NO_INDEX && vertexNormal[i] != n )
+					i = nextVertex[i];
+				if( i == NO_INDEX )
+				{
+					i = vertices.size();
+					Vertex vertex;
+					vertex.position = positions[v];
+					vertex.color = colors[v];
+					if( n != NO_INDEX )
+						vertex.normal = normals[n];
+					vertices.push_back(vertex);
+					vertexNormal.push_back(n);
+					nextVertex.push_back(firstVertex[v]);
+					firstVertex[v] = i;
+				}
+				polygons.corners.push_back(i);
+				sides++;
+			}
+			if( error == NULL && !addPolygon(polygons, sides) )
+				error = "face with too few or too many sides";
+		}
+
+		// anything else (comments, texture coordinates,
+		// groups, materials) is passed over
+		if( error == NULL )
+		{
+			skipLine(p, end);
+			line++;
+		}
+	}
+	closeFile(file);
+
+	if( error == NULL && polygons.sides.empty() )
+		error = "no faces";
+	if( error != NULL )
+	{
+		fprintf(stderr, "%s:%u: %s\n", path, line, error);
+		return false;
+	}
+
+	// put the vertices in the order of their positions in the
+	// file rather than the order the faces first used them in,
+	// leaving out positions no face uses
+	std::vector<unsigned int> order(vertices.size());
+	std::vector<Vertex> ordered(vertices.size());
+	unsigned int next = 0;
+	for( unsigned int v = 0; v < firstVertex.size(); ++v )
+	{
+		for( unsigned int i = firstVertex[v]; i != NO_INDEX; i = nextVertex[i] )
+		{
+			order[i] = next;
+			ordered[next++] = vertices[i];
+		}
+	}
+	vertices.swap(ordered);
+	for( unsigned int i = 0; i < polygons.corners.size(); ++i )
+		polygons.corners[i] = order[polygons.corners[i]];
+
+	std::vector<Quad> quads;
+	fillNormals(vertices, polygons);
+	polygonsToQuads(vertices, polygons, quads);
+
+	reset();
+	_vertices.swap(vertices);
+	_quads.swap(quads);
+	return true;
+}
+
+
+// the kinds of values a PLY file holds
+#define PLY_NONE 0
+#define PLY_INT8 1
+#define PLY_UINT8 2
+#define PLY_INT16 3
+#define PLY_UINT16 4
+#define PLY_INT32 5
+#define PLY_UINT32 6
+#define PLY_FLOAT32 7
+#define PLY_FLOAT64 8
+
+// how the values of a PLY file are written
+#define PLY_ASCII 0
+#define PLY_LITTLE_ENDIAN 1
+#define PLY_BIG_ENDIAN 2
+
+// a property of an element of a PLY file. a list
+// has a count of type count before its values
+typedef struct PlyProperty
+{
+	char name[PLY_NAME];
+	int type;
+	int count;
+} PlyProperty;
+
+// an element of a PLY file, with how many of it there are
+typedef struct PlyElement
+{
+	char name[PLY_NAME];
+	unsigned long count;
+	std::vector<PlyProperty> properties;
+} PlyElement;
+
+
+// the kind of value named name, PLY_NONE if there is none
+static int
+plyType(const char *name)
+{
+	static const char *names[] = { "", "char", "uchar", "short", "ushort",
+								   "int", "uint", "float", "double" };
+	static const char *sizedNames[] = { "", "int8", "uint8", "int16", "uint16",
+										"int32", "uint32", "float32", "float64" };
+	for( int t = PLY_INT8; t <= PLY_FLOAT64; ++t )
+	{
+		if( strcmp(name, names[t]) == 0 || strcmp(name, sizedNames[t]) == 0 )
+			return t;
+	}
+	return PLY_NONE;
+}
+
+
+// read one value of a kind from a PLY file at p and move p past it
+static bool
+readPlyValue(const char *&p, const char *end, int format, int type, double &value)
+{
+	if( format == PLY_ASCII )
+	{
+		while( p < end && (isBlank(*p) || *p == '\n') )
+			++p;
+		return parseNumber(p, end, value);
+	}
+
+	static const int sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	int size = sizes[type];
+	if( end - p < size )
+		return false;
+
+	// the bytes in the order of this machine
+	unsigned char bytes[8];
+	unsigned int one = 1;
+	bool littleEndian = *(unsigned char *)&one == 1;
+	if( littleEndian == (format == PLY_LITTLE_ENDIAN) )
+		memcpy(bytes, p, size);
+	else
+	{
+		for( int b = 0; b < size; ++b )
+			bytes[b] = p[size - 1 - b];
+	}
+	p += size;
+
+	switch( type )
+	{
+		case PLY_INT8: { signed char v; memcpy(&v, bytes, 1); value = v; break; }
+		case PLY_UINT8: { unsigned char v; memcpy(&v, bytes, 1); value = v; break; }
+		case PLY_INT16: { short v; memcpy(&v, bytes, 2); value = v; break; }
+		case PLY_UINT16: { unsigned short v; memcpy(&v, bytes, 2); value = v; break; }
+		case PLY_INT32: { int v; memcpy(&v, bytes, 4); value = v; break; }
+		case PLY_UINT32: { unsigned int v; memcpy(&v, bytes, 4); value = v; break; }
+		case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); value = v; break; }
+		case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); value = v; break; }
+		default: return false;
+	}
+	return true;
+}
+
+
+// read the header of a PLY file, leaving p at the first element
+static bool
+readPlyHeader(const char *&p, const char *end, int &format,
+			  std::vector<PlyElement> &elements)
+{
+	format = -1;
+	bool first = true;
+	for( ;; )
+	{
+		if( p >= end )
+			return false;
+
+		// copy the line out to split it into words
+		char line[PLY_LINE];
+		const char *next = p;
+		skipLine(next, end);
+		size_t length = next - p;
+		if( length >= PLY_LINE )
+			return false;
+		memcpy(line, p, length);
+		line[length] = '\0';
+		p = next;
+
+		char *words[5];
+		int nWords = 0;
+		for( char *word = strtok(line, " \t\r\n"); word != NULL && nWords < 5;
+			 word = strtok(NULL, " \t\r\n") )
+			words[nWords++] = word;
+
+		if( first )
+		{
+			if( nWords != 1 || strcmp(words[0], "ply") != 0 )
+				return false;
+			first = false;
+		}
+		else if( nWords == 0 || strcmp(words[0], "comment") == 0 ||
+				 strcmp(words[0], "obj_info") == 0 )
+			continue;
+		else if( strcmp(words[0], "end_header") == 0 )
+			return format >= 0;
+		else if( strcmp(words[0], "format") == 0 && nWords >= 2 )
+		{
+			if( strcmp(words[1], "ascii") == 0 )
+				format = PLY_ASCII;
+			else if( strcmp(words[1], "binary_little_endian") == 0 )
+				format = PLY_LITTLE_ENDIAN;
+			else if( strcmp(words[1], "binary_big_endian") == 0 )
+				format = PLY_BIG_ENDIAN;
+			else
+				return false;
+		}
+		else if( strcmp(words[0], "element") == 0 && nWords == 3 )
+		{
+			PlyElement element;
+			strncpy(element.name, words[1], PLY_NAME - 1);
+			element.name[PLY_NAME - 1] = '\0';
+			element.count = strtoul(words[2], NULL, 10);
+			elements.push_back(element);
+		}
+		else if( strcmp(words[0], "property") == 0 && nWords >= 3 && !elements.empty() )
+		{
+			PlyProperty property;
+			const char *name;
+			if( strcmp(words[1], "list") == 0 && nWords == 5 )
+			{
+				property.count = plyType(words[2]);
+				property.type = plyType(words[3]);
+				name = words[4];
+				if( property.count == PLY_NONE || property.count >= PLY_FLOAT32 )
+					return false;
+			}
+			else
+			{
+				property.count = PLY_NONE;
+				property.type = plyType(words[1]);
+				name = words[2];
+			}
+			if( property.type == PLY_NONE )
+				return false;
+			strncpy(property.name, name, PLY_NAME - 1);
+			property.name[PLY_NAME - 1] = '\0';
+			elements.back().properties.push_back(property);
+		}
+		else
+			return false;
+	}
+}
+
+
+// what the property named name sets of a vertex: 0 to 2 are the
+// position, 3 to 5 the normal, 6 to 8 the color, and -1 nothing
+static int
+vertexField(const char *name)
+{
+	static const char *names[] = { "x", "y", "z", "nx", "ny", "nz",
+								   "red", "green", "blue" };
+	static const char *otherNames[] = { "x", "y", "z", "nx", "ny", "nz",
+										"r", "g", "b" };
+	for( int f = 0; f < 9; ++f )
+	{
+		if( strcmp(name, names[f]) == 0 || strcmp(name, otherNames[f]) == 0 )
+			return f;
+	}
+	return -1;
+}
+
+
+// read a PLY file, binary or ascii. vertices may have normals
+// and colors, and faces are lists of vertex indices
+bool
+Mesh::loadPLY(const char *path)
+{
+	MappedFile file;
+	if( !openFile(path, file) )
+	{
+		fprintf(stderr, "%s: can't read the file\n", path);
+		return false;
+	}
+
+	const char *p = file.data, *end = file.data + file.size;
+	int format;
+	std::vector<PlyElement> elements;
+	if( !readPlyHeader(p, end, format, elements) )
+	{
+		closeFile(file);
+		fprintf(stderr, "%s: bad PLY header\n", path);
+		return false;
+	}
+
+	std::vector<Vertex> vertices;
+	Polygons polygons;
+	const char *error = NULL;
+	for( unsigned int e = 0; e < elements.size() && error == NULL; ++e )
+	{
+		const PlyElement &element = elements[e];
+		bool isVertex = strcmp(element.name, "vertex") == 0;
+		bool isFace = strcmp(element.name, "face") == 0;
+		unsigned int nProperties = element.properties.size();
+
+		// which part of a vertex each property sets, and whether
+		// colors come as bytes that need scaling down
+		std::vector<int> fields(nProperties, -1);
+		if( isVertex )
+		{
+			vertices.reserve(element.count);
+			for( unsigned int k = 0; k < nProperties; ++k )
+			{
+				if( element.properties[k].count == PLY_NONE )
+					fields[k] = vertexField(element.properties[k].name);
+			}
+		}
+		if( isFace )
+		{
+			polygons.sides.reserve(element.count);
+			polygons.corners.reserve(4*element.count);
+		}
+
+		for( unsigned long i = 0; i < element.count && error == NULL; ++i )
+		{
+			Vertex vertex;
+			vertex.color = DEFAULT_COLOR;
+			for( unsigned int k = 0; k < nProperties; ++k )
+			{
+				const PlyProperty &property = element.properties[k];
+				double value;
+				if( property.count == PLY_NONE )
+				{
+					if( !readPlyValue(p, end, format, property.type, value) )
+					{
+						error = "the file ends early";
+						break;
+					}
+					int field = fields[k];
+					if( field >= 6 && property.type < PLY_FLOAT32 )
+						value /= property.type <= PLY_UINT8 ? 255.0 : 65535.0;
+					if( field >= 6 )
+						vertex.color(field - 6) = value;
+					else if( field >= 3 )
+						vertex.normal(field - 3) = value;
+					else if( field >= 0 )
+						vertex.position(field) = value;
+					continue;
+				}
+
+				// a list: the corners of a face, or skipped
+				double count;
+				if( !readPlyValue(p, end, format, property.count, count) )
+				{
+					error = "the file ends early";
+					break;
+				}
+				bool corners = isFace && (strcmp(property.name, "vertex_indices") == 0 ||
+										  strcmp(property.name, "vertex_index") == 0);
+				for( unsigned int j = 0; j < (unsigned int)count; ++j )
+				{
+					if( !readPlyValue(p, end, format, property.type, value) )
+					{
+						error = "the file ends early";
+						break;
+					}
+					if( corners )
+						polygons.corners.push_back((unsigned int)value);
+				}
+				if( corners && error == NULL && !addPolygon(polygons, (unsigned int)count) )
+					error = "face with too few or too many sides";
+			}
+			if( isVertex )
+				vertices.push_back(vertex);
+		}
+	}
+	closeFile(file);
+
+	for( unsigned int i = 0; i < polygons.corners.size() && error == NULL; ++i )
+	{
+		if( polygons.corners[i] >= vertices.size() )
+			error = "face uses a missing vertex";
+	}
+	if( error == NULL && polygons.sides.empty() )
+		error = "no faces";
+	if( error != NULL )
+	{
+		fprintf(stderr, "%s: %s\n", path, error);
+		return false;
+	}
+
+	std::vector<Quad> quads;
+	fillNormals(vertices, polygons);
+	polygonsToQuads(vertices, polygons, quads);
+
+	reset();
+	_vertices.swap(vertices);
+	_quads.swap(quads);
+	return true;
+}
+
+
+// whether path ends in extension, in any case
+static bool
+hasExtension(const char *path, const char *extension)
+{
+	size_t length = strlen(path), extensionLength = strlen(extension);
+	if( length < extensionLength )
+		return false;
+
+	const char *end = path + length - extensionLength;
+	for( size_t i = 0; i < extensionLength; ++i )
+	{
+		char c = end[i];
+		if( c >= 'A' && c <= 'Z' )
+			c += 'a' - 'A';
+		if( c != extension[i] )
+			return false;
+	}
+	return true;
+}
+
+
+// read the mesh from an OBJ or a PLY file
+bool
+Mesh::load(const char *path)
+{
+	if( hasExtension(path, ".obj") )
+		return loadOBJ(path);
+	if( hasExtension(path, ".ply") )
+		return loadPLY(path);
+
+	fprintf(stderr, "%s: not an .obj or a .ply file\n", path);
+	return false;
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// writing files
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// a buffer that is written to a file as it fills up
+typedef struct FileWriter
+{
+	FILE *file;
+	std::vector<char> buffer;
+	size_t used;
+	bool failed;
+} FileWriter;
+
+
+// open path to be written through writer
+static bool
+openWriter(const char *path, FileWriter &writer)
+{
+	writer.file = fopen(path, "wb");
+	writer.buffer.resize(WRITE_BUFFER);
+	writer.used = 0;
+	writer.failed = writer.file == NULL;
+	return !writer.failed;
+}
+
+
+// write out what is in the buffer
+static void
+flushWriter(FileWriter &writer)
+{
+	if( !writer.failed && writer.used > 0 &&
+		fwrite(&writer.buffer[0], 1, writer.used, writer.file) != writer.used )
+		writer.failed = true;
+	writer.used = 0;
+
+  return;
+}
+
+
+// make room for bytes more in the buffer and return where they go
+static inline char *
+reserveSpace(FileWriter &writer, size_t bytes)
+{
+	if( writer.used + bytes > writer.buffer.size() )
+		flushWriter(writer);
+	return &writer.buffer[writer.used];
+}
+
+
+// write out the rest and close the file, false if anything failed
+static bool
+closeWriter(FileWriter &writer)
+{
+	flushWriter(writer);
+	if( writer.file != NULL && fclose(writer.file) != 0 )
+		writer.failed = true;
+	return !writer.failed;
+}
+
+
+// write n in decimal at out and move out past it
+static inline void
+formatUnsigned(char *&out, unsigned int n)
+{
+	char digits[10];
+	int count = 0;
+	do
+	{
+		digits[count++] = '0' + n%10;
+		n /= 10;
+	} while( n > 0 );
+	while( count > 0 )
+		*out++ = digits[--count];
+}
+
+
+// write value at out with nine significant digits, enough
+// to read back the very same float, and move out past it.
+// this is what %.9g writes, but several times faster
+static void
+formatFloat(char *&out, float value)
+{
+	if( value != value || value - value != 0.0f )
+	{
+		out += sprintf(out, "%.9g", value);
+		return;
+	}
+	if( value == 0.0f )
+	{
+		*out++ = '0';
+		return;
+	}
+	if( value < 0.0f )
+	{
+		*out++ = '-';
+		value = -value;
+	}
+
+	// the nine digits, as an integer from 10^8 up to 10^9
+	int exponent = (int)floor(log10((double)value));
+	double scaled = exponent <= 8 ? value*powerOfTen(8 - exponent)
+								  : value/powerOfTen(exponent - 8);
+	unsigned int digits = (unsigned int)(scaled + 0.5);
+	if( digits >= 1000000000u )
+	{
+		digits = (digits + 5)/10;
+		exponent++;
+	}
+	else if( digits < 100000000u )
+	{
+		digits = (unsigned int)(scaled*10.0 + 0.5);
+		exponent--;
+	}
+
+	char text[9];
+	for( int i = 8; i >= 0; --i )
+	{
+		text[i] = '0' + digits%10;
+		digits /= 10;
+	}
+	int length = 9;
+	while( length > 1 && text[length - 1] == '0' )
+		length--;
+
+	if( exponent >= -5 && exponent < 9 )
+	{
+		if( exponent < 0 )
+		{
+			*out++ = '0';
+			*out++ = '.';
+			for( int i = -1; i > exponent; --i )
+				*out++ = '0';
+			for( int i = 0; i < length; ++i )
+				*out++ = text[i];
+			return;
+		}
+		for( int i = 0; i <= exponent; ++i )
+			*out++ = i < length ? text[i] : '0';
+		if( length > exponent + 1 )
+		{
+			*out++ = '.';
+			for( int i = exponent + 1; i < length; ++i )
+				*out++ = text[i];
+		}
+		return;
+	}
+
+	*out++ = text[0];
+	if( length > 1 )
+	{
+		*out++ = '.';
+		for( int i = 1; i < length; ++i )
+			*out++ = text[i];
+	}
+	*out++ = 'e';
+	*out++ = exponent < 0 ? '-' : '+';
+	if( exponent < 0 )
+		exponent = -exponent;
+	if( exponent < 10 )
+		*out++ = '0';
+	formatUnsigned(out, exponent);
+}
+
+
+// write three floats at out, each after a space
+static inline void
+formatTriple(char *&out, const XVec3f &value)
+{
+	for( int i = 0; i < 3; ++i )
+	{
+		*out++ = ' ';
+		formatFloat(out, value(i));
+	}
+}
+
+
+// the longest a line of an OBJ file written here can be
+#define OBJ_LINE 256
+
+
+// write the mesh to an OBJ file, with the color after each
+// position and a normal for every vertex. the numbers are
+// written with all of their digits so the mesh is just the
+// same, and welds the same, when it is read back
+bool
+Mesh::saveOBJ(const char *path) const
+{
+	FileWriter writer;
+	if( !openWriter(path, writer) )
+	{
+		fprintf(stderr, "%s: can't write the file\n", path);
+		return false;
+	}
+
+	char *out = reserveSpace(writer, OBJ_LINE);
+	out += sprintf(out, "# %u vertices, %u quads\n", (unsigned int)_vertices.size(),
+				   (unsigned int)_quads.size());
+	writer.used = out - &writer.buffer[0];
+
+	for( unsigned int i = 0; i < _vertices.size(); ++i )
+	{
+		out = reserveSpace(writer, OBJ_LINE);
+		char *start = out;
+		*out++ = 'v';
+		formatTriple(out, _vertices[i].position);
+		formatTriple(out, _vertices[i].color);
+		*out++ = '\n';
+		writer.used += out - start;
+	}
+	for( unsigned int i = 0; i < _vertices.size(); ++i )
+	{
+		out = reserveSpace(writer, OBJ_LINE);
+		char *start = out;
+		*out++ = 'v';
+		*out++ = 'n';
+		formatTriple(out, _vertices[i].normal);
+		*out++ = '\n';
+		writer.used += out - start;
+	}
+	for( unsigned int i = 0; i < _quads.size(); ++i )
+	{
+		out = reserveSpace(writer, OBJ_LINE);
+		char *start = out;
+		*out++ = 'f';
+		for( int j = 0; j < 4; ++j )
+		{
+			unsigned int index = _quads[i](j) + 1;
+			*out++ = ' ';
+			formatUnsigned(out, index);
+			*out++ = '/';
+			*out++ = '/';
+			formatUnsigned(out, index);
+		}
+		*out++ = '\n';
+		writer.used += out - start;
+	}
+
+	if( !closeWriter(writer) )
+	{
+		fprintf(stderr, "%s: can't write the file\n", path);
+		return false;
+	}
+	return true;
+}
+
+
+// color c as a byte
+static unsigned char
+colorByte(float c)
+{
+	if( c <= 0.0f )
+		return 0;
+	if( c >= 1.0f )
+		return 255;
+	return (unsigned char)(255.0f*c + 0.5f);
+}
+
+
+// write the mesh to a binary PLY file in the byte order of this
+// machine, with a float position and normal and a byte color
+// per vertex, and four int corners per face
+bool
+Mesh::savePLY(const char *path) const
+{
+	FileWriter writer;
+	if( !openWriter(path, writer) )
+	{
+		fprintf(stderr, "%s: can't write the file\n", path);
+		return false;
+	}
+
+	unsigned int one = 1;
+	bool littleEndian = *(unsigned char *)&one == 1;
+	char *out = reserveSpace(writer, PLY_LINE*16);
+	out += sprintf(out, "ply\nformat %s 1.0\n"
+				   "element vertex %u\n"
+				   "property float x\nproperty float y\nproperty float z\n"
+				   "property float nx\nproperty float ny\nproperty float nz\n"
+				   "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+				   "element face %u\n"
+				   "property list uchar int vertex_indices\nend_header\n",
+				   littleEndian ? "binary_little_endian" : "binary_big_endian",
+				   (unsigned int)_vertices.size(), (unsigned int)_quads.size());
+	writer.used = out - &writer.buffer[0];
+
+	const size_t vertexSize = 6*sizeof(float) + 3;
+	for( unsigned int i = 0; i < _vertices.size(); ++i )
+	{
+		out = reserveSpace(writer, vertexSize);
+		const Vertex &v = _vertices[i];
+		float values[6] = { v.position(0), v.position(1), v.position(2),
+							v.normal(0), v.normal(1), v.normal(2) };
+		memcpy(out, values, sizeof(values));
+		out += sizeof(values);
+		for( int c = 0; c < 3; ++c )
+			*out++ = (char)colorByte(v.color(c));
+		writer.used += vertexSize;
+	}
+
+	const size_t quadSize = 1 + 4*sizeof(int);
+	for( unsigned int i = 0; i < _quads.size(); ++i )
+	{
+		out = reserveSpace(writer, quadSize);
+		int corners[4] = { (int)_quads[i](0), (int)_quads[i](1),
+						   (int)_quads[i](2), (int)_quads[i](3) };
+		*out++ = 4;
+		memcpy(out, corners, sizeof(corners));
+		writer.used += quadSize;
+	}
+
+	if( !closeWriter(writer) )
+	{
+		fprintf(stderr, "%s: can't write the file\n", path);
+		return false;
+	}
+	return true;
+}
+
+
+// write the mesh to an OBJ or a PLY file
+bool
+Mesh::save(const char *path) const
+{
+	if( hasExtension(path, ".obj") )
+		return saveOBJ(path);
+	if( hasExtension(path, ".ply") )
+		return savePLY(path);
+
+	fprintf(stderr, "%s: not an .obj or a .ply file\n", path);
+	return false;
+}
@@ -17,6 +17,7 @@
  * Authors: Ari Grant
  *
 */
+#include <cstdio>
 #include <cstdlib>
 #include <cmath>
 
@@ -37,16 +38,52 @@
 // the mesh that will be subdivided
 Mesh cube;
 
+// the file the mesh is read from, a cube if none
+const char *meshPath = NULL;
+
+// the files the mesh is written to
+#define EXPORT_OBJ "subdivided.obj"
+#define EXPORT_PLY "subdivided.ply"
+
 // whether the mesh is displayed with wireframe
 bool meshHasWireframe = true;
 
 // global rotation values
 float rotX = 0.0f, rotY = 0.0f, rotZ = 0.0f;
 
+// how far the eye is from the middle of the mesh
+float viewDistance = 1.6f;
+
+// how deep adaptive subdivision goes, 0 when
+// the mesh is not adaptively subdivided
+unsigned int adaptiveLevel = 0;
+
+// whether the level shown follows the distance
+// to the mesh, and the deepest level it goes to
+bool levelByDistance = false;
+#define MAX_DISTANCE_LEVEL 6
+
+// how many pixels long the edges of the mesh should look
+// when the level follows the distance, and how many pixels
+// something one unit long covers one unit away (the
+// frustum is one unit wide at the near plane)
+#define EDGE_PIXELS 12.0f
+#define PIXEL_SCALE 800.0f
+
+// start over with the mesh from the file, or the cube
+void
+resetMesh()
+{
+	if( meshPath == NULL || !cube.load(meshPath) )
+		cube.toCube();
+
+  return;
+}
+
 void 
 initGL()
 {
-	cube.toCube();
+	resetMesh();
 	
 	// clear with a dark, pale blue
 	glClearColor(0.2f, 0.3f, 0.4f, 1.0f);
@@ -90,6 +127,40 @@ drawScene()
   return;
 }
 
+// adaptively subdivide the mesh along its silhouette and
+// around its extraordinary points as seen from the eye
+void
+adaptToView()
+{
+	// the eye in the coordinates of the mesh, undoing
+	// the transformations in display() and drawScene()
+	XVec3f eye(0.0f, 0.0f, viewDistance);
+	eye = eye.rotate(XVec3f(1.0f, 0.0f, 0.0f), -rotX*M_PI/180.0f);
+	eye = eye.rotate(XVec3f(0.0f, 1.0f, 0.0f), -rotY*M_PI/180.0f);
+	eye = eye.rotate(XVec3f(0.0f, 0.0f, 1.0f), -rotZ*M_PI/180.0f);
+	eye /= 0.3f;
+	
+	AdaptiveCriteria criteria;
+	criteria.maxLevel = adaptiveLevel;
+	criteria.extraordinary = true;
+	criteria.silhouette = true;
+	criteria.eye = eye;
+	cube.subdivideAdaptive(criteria);
+
+  return;
+}
+
+// show the level of the mesh that suits how far away it is
+void
+levelToView()
+{
+	// the mesh is drawn at 0.3 of its size
+	cube.showLevel(cube.levelForDistance(viewDistance/0.3f, PIXEL_SCALE,
+										 EDGE_PIXELS, MAX_DISTANCE_LEVEL));
+
+  return;
+}
+
 void 
 display()
 {		
@@ -100,7 +171,7 @@ display()
 	// prepare the modelview with an offset backward
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
-	glTranslatef(0.0f, 0.0f, -1.6f);
+	glTranslatef(0.0f, 0.0f, -viewDistance);
 	
 	// draw the scene
 	drawScene();
@@ -113,6 +184,9 @@ display()
 
 void kbd(unsigned char key, int x, int y)
 {
+	// whether the view changed, for adaptive subdivision
+	bool viewChanged = false;
+	
 	switch(key)
 	{
 			/* quit on 'escape' */
@@ -124,35 +198,84 @@ void kbd(unsigned char key, int x, int y)
 		case 'x':
 		case 'j':
 			rotX += 3.0f;
+			viewChanged = true;
 			break;
 			
 		case 'X':
 		case 'k':
 			rotX -= 3.0f;
+			viewChanged = true;
 			break;
 			
 		case 'y':
 		case 's':
 			rotY += 3.0f;
+			viewChanged = true;
 			break;
 			
 		case 'Y':
 		case 'w':
 			rotY -= 3.0f;
+			viewChanged = true;
 			break;
 			
 		case 'z':
 		case 'h':
 			rotZ += 3.0f;
+			viewChanged = true;
 			break;
 			
 		case 'Z':
 		case 'l':
 			rotZ -= 3.0f;
+			viewChanged = true;
+			break;
+			
+		case '+':
+		case '=':
+			if( viewDistance > 1.1f )
+				viewDistance -= 0.1f;
+			viewChanged = true;
+			break;
+			
+		case '-':
+		case '_':
+			if( viewDistance < 6.0f )
+				viewDistance += 0.1f;
+			viewChanged = true;
 			break;
 			
 		case 'd':
 			cube.subdivide();
+			adaptiveLevel = 0;
+			levelByDistance = false;
+			break;
+			
+		case 'u':
+			if( cube.level() > 0 )
+				cube.showLevel(cube.level() - 1);
+			adaptiveLevel = 0;
+			levelByDistance = false;
+			break;
+			
+		case '0': case '1': case '2': case '3':
+		case '4': case '5': case '6': case '7':
+			cube.showLevel(key - '0');
+			adaptiveLevel = 0;
+			levelByDistance = false;
+			break;
+			
+		case 'o':
+			levelByDistance = !levelByDistance;
+			adaptiveLevel = 0;
+			if( levelByDistance )
+				levelToView();
+			break;
+			
+		case 'a':
+			levelByDistance = false;
+			adaptiveLevel++;
+			adaptToView();
 			break;
 			
 		case 'r':
@@ -163,15 +286,39 @@ void kbd(unsigned char key, int x, int y)
 			meshHasWireframe = !meshHasWireframe;
 			break;
 			
+		case 'p':
+			cube.setShowLimit(!cube.showsLimit());
+			break;
+			
+		case 'e':
+			if( cube.save(EXPORT_OBJ) )
+				printf("wrote %s\n", EXPORT_OBJ);
+			break;
+			
+		case 'E':
+			if( cube.save(EXPORT_PLY) )
+				printf("wrote %s\n", EXPORT_PLY);
+			break;
+			
 		case ' ':
 		case 'I':
-			cube.toCube();
+			resetMesh();
+			adaptiveLevel = 0;
+			levelByDistance = false;
 			break;
 			
 		default:
 			break;
 	}
 	
+	// keep the silhouette refined as the view turns
+	if( viewChanged && adaptiveLevel > 0 )
+		adaptToView();
+	
+	// and the level in step with the distance
+	if( viewChanged && levelByDistance )
+		levelToView();
+	
 	// ask GLUT to draw again
 	glutPostRedisplay();
 
@@ -202,6 +349,10 @@ main (int argc, char *argv[])
     glutDisplayFunc(display);
     glutKeyboardFunc(kbd);
 	
+	// an OBJ or PLY file to start from instead of the cube
+	if( argc > 1 )
+		meshPath = argv[1];
+	
 	// prepare OpenGL state
 	initGL();
 	
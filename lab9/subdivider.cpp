@@ -0,0 +1,1773 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#include <cstring>
+#include <cmath>
+
+#include "subdivider.h"
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932384626433
+#endif // M_PI
+
+// marks an empty slot or a missing index
+#define NO_INDEX 0xffffffff
+
+
+// since only quads are supported, a face
+// will have 4 vertices and 4 edges
+#define VERTICES_PER_FACE 4
+#define EDGES_PER_FACE VERTICES_PER_FACE
+
+
+// since the mesh is closed, there will be
+// two faces sharing every edge in the mesh
+#define FACES_PER_EDGE 2
+
+
+// the attributes every point has, in the order of
+// the arrays returned by attributesOf()
+#define ATTRIBUTES 3
+
+
+// exchange contents with another level
+void
+SubdivisionLevel::swap(SubdivisionLevel &other)
+{
+	positions.swap(other.positions);
+	normals.swap(other.normals);
+	colors.swap(other.colors);
+	quads.swap(other.quads);
+	cornerNormals.swap(other.cornerNormals);
+	cornerColors.swap(other.cornerColors);
+	quadEdges.swap(other.quadEdges);
+	edgePoints.swap(other.edgePoints);
+	edgeFaces.swap(other.edgeFaces);
+	pointStart.swap(other.pointStart);
+	pointFaces.swap(other.pointFaces);
+	pointEdges.swap(other.pointEdges);
+}
+
+
+// every point is just its own control point
+void
+StencilTable::identity(unsigned int points)
+{
+	controls = points;
+	start.resize(points + 1);
+	index.resize(points);
+	weight.assign(points, 1.0f);
+	for( unsigned int i = 0; i < points; ++i )
+	{
+		start[i] = i;
+		index[i] = i;
+	}
+	start[points] = points;
+}
+
+
+// exchange contents with another table
+void
+StencilTable::swap(StencilTable &other)
+{
+	start.swap(other.start);
+	index.swap(other.index);
+	weight.swap(other.weight);
+
+	unsigned int otherControls = other.controls;
+	other.controls = controls;
+	controls = otherControls;
+}
+
+
+// the attribute arrays of a level, so every
+// pass can treat them the same way
+static inline void
+attributesOf(const SubdivisionLevel &level, const std::vector<XVec3f> *attributes[ATTRIBUTES])
+{
+	attributes[0] = &level.positions;
+	attributes[1] = &level.normals;
+	attributes[2] = &level.colors;
+}
+
+static inline void
+attributesOf(SubdivisionLevel &level, std::vector<XVec3f> *attributes[ATTRIBUTES])
+{
+	attributes[0] = &level.positions;
+	attributes[1] = &level.normals;
+	attributes[2] = &level.colors;
+}
+
+
+// average two or four values
+static inline XVec3f
+average(const XVec3f &a, const XVec3f &b)
+{
+	return (a + b)/2.0f;
+}
+
+static inline XVec3f
+average(const XVec3f &a, const XVec3f &b, const XVec3f &c, const XVec3f &d)
+{
+	return average(average(a, b), average(c, d));
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// building the first level
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// an edge leaving a point, given as the index
+// of the edge and the point at its other end
+typedef struct PointEdge
+{
+	unsigned int edge;
+	unsigned int point;
+
+} PointEdge;
+
+
+// hash a position for welding, with -0 and 0 hashing
+// the same since they are the same location
+static inline unsigned int
+hashPosition(const XVec3f &p)
+{
+	unsigned int h = 2166136261u;
+	for( int i = 0; i < 3; ++i )
+	{
+		float f = p(i) + 0.0f;
+		unsigned int bits;
+		memcpy(&bits, &f, sizeof(bits));
+		h = (h ^ bits) * 16777619u;
+	}
+	return h;
+}
+
+
+// records the edge from point0 to point1 around point0 if
+// it is not already there, and returns the index of the edge.
+// the edges around point p are the first pointEdgeCount[p]
+// of pointEdges[edgeStart[p]]
+static unsigned int
+addPointEdge(unsigned int point0, unsigned int point1,
+			 const std::vector<unsigned int> &edgeStart,
+			 std::vector<unsigned int> &pointEdgeCount,
+			 std::vector<PointEdge> &pointEdges,
+			 SubdivisionLevel &level)
+{
+	// see if the edge was already found around this point
+	PointEdge *edges = &pointEdges[edgeStart[point0]];
+	for( unsigned int s = 0; s < pointEdgeCount[point0]; ++s )
+		if( edges[s].point == point1 )
+			return edges[s].edge;
+
+	// it may still have been found around the other end
+	unsigned int edge = NO_INDEX;
+	PointEdge *others = &pointEdges[edgeStart[point1]];
+	for( unsigned int s = 0; s < pointEdgeCount[point1]; ++s )
+		if( others[s].point == point0 )
+			edge = others[s].edge;
+
+	// otherwise it is a new edge
+	if( edge == NO_INDEX )
+	{
+		edge = level.edgeCount();
+		level.edgePoints.push_back(point0);
+		level.edgePoints.push_back(point1);
+		for( unsigned int f = 0; f < FACES_PER_EDGE; ++f )
+			level.edgeFaces.push_back(NO_INDEX);
+	}
+
+	PointEdge &added = edges[pointEdgeCount[point0]++];
+	added.edge = edge;
+	added.point = point1;
+
+	return edge;
+}
+
+
+// find the faces and edges around every point and the faces
+// along every edge of a level from its quads. returns false
+// unless the level is closed, with two faces along every edge;
+// a level that is not keeps only as many edges around each
+// point as faces, and NO_INDEX for the faces it lacks
+static bool
+findAdjacency(SubdivisionLevel &level)
+{
+	unsigned int nPoints = level.pointCount();
+	unsigned int nQuads = level.quadCount();
+
+	// count the faces around each point, then
+	// fill them in, in the order of the quads
+	level.pointStart.assign(nPoints + 1, 0);
+	for( unsigned int i = 0; i < nQuads; ++i )
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			level.pointStart[level.quads[i](j) + 1]++;
+	for( unsigned int p = 0; p < nPoints; ++p )
+		level.pointStart[p + 1] += level.pointStart[p];
+
+	std::vector<unsigned int> next(level.pointStart.begin(), level.pointStart.end() - 1);
+	level.pointFaces.resize(level.pointStart[nPoints]);
+	for( unsigned int i = 0; i < nQuads; ++i )
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			level.pointFaces[next[level.quads[i](j)]++] = i;
+
+	// every face around a point adds at most
+	// two edges (to the right and to the left)
+	std::vector<unsigned int> edgeStart(nPoints);
+	for( unsigned int p = 0; p < nPoints; ++p )
+		edgeStart[p] = 2*level.pointStart[p];
+	std::vector<unsigned int> pointEdgeCount(nPoints, 0);
+	std::vector<PointEdge> pointEdges(2*level.pointStart[nPoints]);
+
+	level.edgePoints.clear();
+	level.edgeFaces.clear();
+	level.quadEdges.resize(EDGES_PER_FACE*nQuads);
+	std::vector<unsigned int> edgeFaceCount;
+
+	// walk the corners of every quad, recording the edge to the
+	// right and then to the left of the corner around its point
+	for( unsigned int i = 0; i < nQuads; ++i )
+	{
+		const XVec4ui &quad = level.quads[i];
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+		{
+			unsigned int k = (j+1) % VERTICES_PER_FACE;
+			unsigned int l = (j+VERTICES_PER_FACE-1) % VERTICES_PER_FACE;
+
+			unsigned int edge = addPointEdge(quad(j), quad(k), edgeStart,
+											 pointEdgeCount, pointEdges, level);
+			addPointEdge(quad(j), quad(l), edgeStart, pointEdgeCount, pointEdges, level);
+
+			// this quad is along the edge from corner j to k
+			level.quadEdges[EDGES_PER_FACE*i + j] = edge;
+			edgeFaceCount.resize(level.edgeCount(), 0);
+			if( edgeFaceCount[edge] < FACES_PER_EDGE )
+				level.edgeFaces[FACES_PER_EDGE*edge + edgeFaceCount[edge]] = i;
+			edgeFaceCount[edge]++;
+		}
+	}
+
+	// if an edge is not shared by two faces,
+	// it can't be subdivided, the mesh stinks!
+	bool closed = true;
+	for( unsigned int e = 0; e < edgeFaceCount.size(); ++e )
+		if( edgeFaceCount[e] != FACES_PER_EDGE )
+			closed = false;
+
+	// with that, every point has as many edges as faces
+	level.pointEdges.resize(level.pointStart[nPoints]);
+	for( unsigned int p = 0; p < nPoints; ++p )
+	{
+		unsigned int start = level.pointStart[p];
+		unsigned int count = level.pointStart[p+1] - start;
+		if( pointEdgeCount[p] != count )
+			closed = false;
+		if( pointEdgeCount[p] < count )
+			count = pointEdgeCount[p];
+
+		for( unsigned int s = 0; s < count; ++s )
+			level.pointEdges[start + s] = pointEdges[edgeStart[p] + s].edge;
+	}
+
+	return closed;
+}
+
+
+// build a level from a quad mesh given as vertex arrays
+bool
+Subdivider::build(const std::vector<XVec3f> &positions,
+				  const std::vector<XVec3f> &normals,
+				  const std::vector<XVec3f> &colors,
+				  const std::vector<XVec4ui> &quads,
+				  SubdivisionLevel &level)
+{
+	unsigned int nVerts = positions.size();
+	unsigned int nQuads = quads.size();
+
+	// weld the vertices into points; the hash table holds
+	// the first vertex found at each location
+	unsigned int tableSize = 1;
+	while( tableSize < 2*nVerts )
+		tableSize *= 2;
+	std::vector<unsigned int> table(tableSize, NO_INDEX);
+	std::vector<unsigned int> pointVertex;
+	std::vector<unsigned int> vertexPoint(nVerts);
+
+	for( unsigned int i = 0; i < nVerts; ++i )
+	{
+		const XVec3f &position = positions[i];
+		unsigned int slot = hashPosition(position) & (tableSize - 1);
+		while( table[slot] != NO_INDEX && !(positions[table[slot]] == position) )
+			slot = (slot + 1) & (tableSize - 1);
+
+		if( table[slot] == NO_INDEX )
+		{
+			table[slot] = i;
+			pointVertex.push_back(i);
+			vertexPoint[i] = pointVertex.size() - 1;
+		}
+		else
+			vertexPoint[i] = vertexPoint[table[slot]];
+	}
+	unsigned int nPoints = pointVertex.size();
+
+	// each point is at the location of its vertices, with
+	// the average normal and color of the vertices
+	std::vector<unsigned int> welded(nPoints, 0);
+	level.positions.resize(nPoints);
+	level.normals.assign(nPoints, XVec3f(0.0f));
+	level.colors.assign(nPoints, XVec3f(0.0f));
+	for( unsigned int i = 0; i < nVerts; ++i )
+	{
+		level.normals[vertexPoint[i]] += normals[i];
+		level.colors[vertexPoint[i]] += colors[i];
+		welded[vertexPoint[i]]++;
+	}
+	for( unsigned int p = 0; p < nPoints; ++p )
+	{
+		level.positions[p] = positions[pointVertex[p]];
+		level.normals[p] /= (float)welded[p];
+		level.colors[p] /= (float)welded[p];
+	}
+
+	// the quads, now between points, keeping the
+	// normals and colors of their own vertices
+	level.quads.resize(nQuads);
+	level.cornerNormals.resize(VERTICES_PER_FACE*nQuads);
+	level.cornerColors.resize(VERTICES_PER_FACE*nQuads);
+	for( unsigned int i = 0; i < nQuads; ++i )
+	{
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+		{
+			level.quads[i](j) = vertexPoint[quads[i](j)];
+			level.cornerNormals[VERTICES_PER_FACE*i + j] = normals[quads[i](j)];
+			level.cornerColors[VERTICES_PER_FACE*i + j] = colors[quads[i](j)];
+		}
+	}
+
+	// a mesh that is not closed can't be subdivided
+	return findAdjacency(level);
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// refining a level
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// what the passes of refine() work on
+typedef struct RefineContext
+{
+	const SubdivisionLevel *coarse;
+	SubdivisionLevel *fine;
+
+	// where the edge points and the face
+	// points start in the fine level
+	unsigned int firstEdge;
+	unsigned int firstFace;
+
+	// where the edges inside the coarse faces start
+	// among the fine edges, after the split ones
+	unsigned int firstInnerEdge;
+
+	// where the faces and edges around the edge points and
+	// the face points start in the fine level's point lists
+	unsigned int edgePointStart;
+	unsigned int facePointStart;
+
+} RefineContext;
+
+
+// the half of coarse edge e that ends at the given point
+static inline unsigned int
+halfEdge(const SubdivisionLevel &coarse, unsigned int e, unsigned int point)
+{
+	return coarse.edgePoints[2*e] == point ? 2*e : 2*e+1;
+}
+
+
+// which side of quad i edge e is along
+static inline unsigned int
+sideOfQuad(const SubdivisionLevel &level, unsigned int i, unsigned int e)
+{
+	const unsigned int *edges = &level.quadEdges[EDGES_PER_FACE*i];
+	unsigned int j = 0;
+	while( j < EDGES_PER_FACE-1 && edges[j] != e )
+		++j;
+	return j;
+}
+
+
+// which corner of quad i the point is
+static inline unsigned int
+cornerOfQuad(const SubdivisionLevel &level, unsigned int i, unsigned int point)
+{
+	const XVec4ui &quad = level.quads[i];
+	unsigned int j = 0;
+	while( j < VERTICES_PER_FACE-1 && quad(j) != point )
+		++j;
+	return j;
+}
+
+
+// the centers of quads [begin, end) for attribute a, from the
+// corners of each quad if the level has them
+static void
+faceCenters(const SubdivisionLevel &coarse, unsigned int a,
+			unsigned int begin, unsigned int end, XVec3f *result)
+{
+	const std::vector<XVec3f> *from[ATTRIBUTES];
+	attributesOf(coarse, from);
+
+	// the normals and colors of the corners, if the level has them
+	const std::vector<XVec3f> *corners[ATTRIBUTES] = { NULL, NULL, NULL };
+	if( !coarse.cornerNormals.empty() )
+	{
+		corners[1] = &coarse.cornerNormals;
+		corners[2] = &coarse.cornerColors;
+	}
+
+	if( corners[a] )
+	{
+		const XVec3f *values = &(*corners[a])[0];
+		for( unsigned int i = begin; i < end; ++i )
+		{
+			const XVec3f *corner = &values[VERTICES_PER_FACE*i];
+			result[i] = average(corner[0], corner[1], corner[2], corner[3]);
+		}
+	}
+	else
+	{
+		const XVec3f *values = &(*from[a])[0];
+		for( unsigned int i = begin; i < end; ++i )
+		{
+			const XVec4ui &quad = coarse.quads[i];
+			result[i] = average(values[quad(0)], values[quad(1)],
+								values[quad(2)], values[quad(3)]);
+		}
+	}
+}
+
+
+// the edge point of edge e, the average of its two endpoints
+// and the centers of the two faces containing it
+static inline XVec3f
+edgeRule(const SubdivisionLevel &coarse, unsigned int e,
+		 const XVec3f *values, const XVec3f *facePoints)
+{
+	const unsigned int *ends = &coarse.edgePoints[2*e];
+	const unsigned int *faces = &coarse.edgeFaces[FACES_PER_EDGE*e];
+	return average(values[ends[0]], values[ends[1]],
+				   facePoints[faces[0]], facePoints[faces[1]]);
+}
+
+
+// the vertex point of point p, a weighted combination of the
+// average of the face centers around it, the average of the
+// midpoints of the edges around it, and its old location
+static inline XVec3f
+vertexRule(const SubdivisionLevel &coarse, unsigned int p,
+		   const XVec3f *values, const XVec3f *facePoints)
+{
+	unsigned int start = coarse.pointStart[p];
+	unsigned int count = coarse.pointStart[p+1] - start;
+
+	XVec3f averageFaces(0.0f);
+	XVec3f averageEdges(0.0f);
+	for( unsigned int s = start; s < start + count; ++s )
+	{
+		unsigned int e = coarse.pointEdges[s];
+		unsigned int other = coarse.edgePoints[2*e] == p ? coarse.edgePoints[2*e+1]
+														 : coarse.edgePoints[2*e];
+		averageFaces += facePoints[coarse.pointFaces[s]];
+		averageEdges += values[p];
+		averageEdges += values[other];
+	}
+	averageFaces /= (float)count;
+	averageEdges /= (float)(count * 2);
+
+	return (averageFaces + 2 * averageEdges
+			+ ((float)count - 3.0f) * values[p]) / (float)count;
+}
+
+
+// the face points, each the center of its quad, and the
+// four quads every coarse quad is split into, around its
+// center f, with corners c0..c3 and edge points e0..e3
+// where edge j runs from corner j to corner j+1
+//
+//      c3      e2      c2
+//       *-------*-------*
+//       |       |       |
+//       |       |       |
+//       |       |f      |
+//    e3 *-------*-------* e1
+//       |       |       |
+//       |       |       |
+//       |       |       |
+//       *-------*-------*
+//      c0      e0      c1
+//
+// the new faces are (f,e0,c1,e1), (f,e1,c2,e2),
+// (f,e2,c3,e3), and (f,e3,c0,e0), and the new
+// edges inside the quad run from f to e0..e3
+static void
+refineFaces(void *arg, unsigned int begin, unsigned int end)
+{
+	RefineContext &context = *(RefineContext *)arg;
+	const SubdivisionLevel &coarse = *context.coarse;
+	SubdivisionLevel &fine = *context.fine;
+
+	std::vector<XVec3f> *to[ATTRIBUTES];
+	attributesOf(fine, to);
+
+	for( unsigned int a = 0; a < ATTRIBUTES; ++a )
+		faceCenters(coarse, a, begin, end, &(*to[a])[context.firstFace]);
+
+	for( unsigned int i = begin; i < end; ++i )
+	{
+		const XVec4ui &quad = coarse.quads[i];
+		const unsigned int *edges = &coarse.quadEdges[EDGES_PER_FACE*i];
+		unsigned int facePoint = context.firstFace + i;
+		unsigned int innerEdges = context.firstInnerEdge + EDGES_PER_FACE*i;
+
+		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+		{
+			unsigned int k = (j+1) % EDGES_PER_FACE;
+			unsigned int l = (j+EDGES_PER_FACE-1) % EDGES_PER_FACE;
+			unsigned int child = EDGES_PER_FACE*i + j;
+
+			fine.quads[child] = XVec4ui(facePoint, context.firstEdge + edges[j],
+										quad(k), context.firstEdge + edges[k]);
+
+			unsigned int *sides = &fine.quadEdges[EDGES_PER_FACE*child];
+			sides[0] = innerEdges + j;
+			sides[1] = halfEdge(coarse, edges[j], quad(k));
+			sides[2] = halfEdge(coarse, edges[k], quad(k));
+			sides[3] = innerEdges + k;
+
+			// the edge from f to ej, between children j and j-1
+			unsigned int inner = innerEdges + j;
+			fine.edgePoints[2*inner] = facePoint;
+			fine.edgePoints[2*inner+1] = context.firstEdge + edges[j];
+			fine.edgeFaces[2*inner] = child;
+			fine.edgeFaces[2*inner+1] = EDGES_PER_FACE*i + l;
+		}
+
+		// the face point is surrounded by the four children
+		unsigned int start = context.facePointStart + EDGES_PER_FACE*i;
+		fine.pointStart[facePoint] = start;
+		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+		{
+			fine.pointFaces[start + j] = EDGES_PER_FACE*i + j;
+			fine.pointEdges[start + j] = innerEdges + j;
+		}
+	}
+}
+
+
+// the edge points, and the two halves
+// every coarse edge is split into
+static void
+refineEdges(void *arg, unsigned int begin, unsigned int end)
+{
+	RefineContext &context = *(RefineContext *)arg;
+	const SubdivisionLevel &coarse = *context.coarse;
+	SubdivisionLevel &fine = *context.fine;
+
+	const std::vector<XVec3f> *from[ATTRIBUTES];
+	std::vector<XVec3f> *to[ATTRIBUTES];
+	attributesOf(coarse, from);
+	attributesOf(fine, to);
+
+	for( unsigned int a = 0; a < ATTRIBUTES; ++a )
+	{
+		const XVec3f *values = &(*from[a])[0];
+		const XVec3f *facePoints = &(*to[a])[context.firstFace];
+		XVec3f *result = &(*to[a])[context.firstEdge];
+		for( unsigned int e = begin; e < end; ++e )
+			result[e] = edgeRule(coarse, e, values, facePoints);
+	}
+
+	for( unsigned int e = begin; e < end; ++e )
+	{
+		unsigned int point0 = coarse.edgePoints[2*e];
+		unsigned int point1 = coarse.edgePoints[2*e+1];
+		unsigned int edgePoint = context.firstEdge + e;
+
+		// half 2e runs from point0 to the edge
+		// point, and half 2e+1 from there to point1
+		fine.edgePoints[4*e] = point0;
+		fine.edgePoints[4*e+1] = edgePoint;
+		fine.edgePoints[4*e+2] = edgePoint;
+		fine.edgePoints[4*e+3] = point1;
+
+		unsigned int start = context.edgePointStart + 4*e;
+		fine.pointStart[edgePoint] = start;
+		fine.pointEdges[start] = 2*e;
+		fine.pointEdges[start+1] = 2*e+1;
+
+		for( unsigned int n = 0; n < FACES_PER_EDGE; ++n )
+		{
+			// in each face along the edge, child j-1 has the
+			// half at corner j and child j the half at corner j+1
+			unsigned int face = coarse.edgeFaces[FACES_PER_EDGE*e + n];
+			unsigned int j = sideOfQuad(coarse, face, e);
+			unsigned int atCorner = EDGES_PER_FACE*face + (j+EDGES_PER_FACE-1) % EDGES_PER_FACE;
+			unsigned int atNext = EDGES_PER_FACE*face + j;
+
+			bool fromPoint0 = coarse.quads[face](j) == point0;
+			fine.edgeFaces[FACES_PER_EDGE*(2*e) + n] = fromPoint0 ? atCorner : atNext;
+			fine.edgeFaces[FACES_PER_EDGE*(2*e+1) + n] = fromPoint0 ? atNext : atCorner;
+
+			fine.pointFaces[start + 2*n] = atCorner;
+			fine.pointFaces[start + 2*n + 1] = atNext;
+			fine.pointEdges[start + 2 + n] = context.firstInnerEdge + EDGES_PER_FACE*face + j;
+		}
+	}
+}
+
+
+// the vertex points, and what is around them
+static void
+refinePoints(void *arg, unsigned int begin, unsigned int end)
+{
+	RefineContext &context = *(RefineContext *)arg;
+	const SubdivisionLevel &coarse = *context.coarse;
+	SubdivisionLevel &fine = *context.fine;
+
+	const std::vector<XVec3f> *from[ATTRIBUTES];
+	std::vector<XVec3f> *to[ATTRIBUTES];
+	attributesOf(coarse, from);
+	attributesOf(fine, to);
+
+	for( unsigned int a = 0; a < ATTRIBUTES; ++a )
+	{
+		const XVec3f *values = &(*from[a])[0];
+		const XVec3f *facePoints = &(*to[a])[context.firstFace];
+		XVec3f *result = &(*to[a])[0];
+		for( unsigned int p = begin; p < end; ++p )
+			result[p] = vertexRule(coarse, p, values, facePoints);
+	}
+
+	// an old point keeps its faces and edges, now the
+	// child at its corner and the half at its end
+	for( unsigned int p = begin; p < end; ++p )
+	{
+		unsigned int start = coarse.pointStart[p];
+		fine.pointStart[p] = start;
+		for( unsigned int s = start; s < coarse.pointStart[p+1]; ++s )
+		{
+			unsigned int face = coarse.pointFaces[s];
+			unsigned int j = cornerOfQuad(coarse, face, p);
+			fine.pointFaces[s] = EDGES_PER_FACE*face + (j+EDGES_PER_FACE-1) % EDGES_PER_FACE;
+			fine.pointEdges[s] = halfEdge(coarse, coarse.pointEdges[s], p);
+		}
+	}
+}
+
+
+// subdivide coarse once into fine
+void
+Subdivider::refine(const SubdivisionLevel &coarse, SubdivisionLevel &fine)
+{
+	unsigned int nPoints = coarse.pointCount();
+	unsigned int nEdges = coarse.edgeCount();
+	unsigned int nQuads = coarse.quadCount();
+
+	// every point, edge, and face becomes a point; every edge
+	// is split in two and every quad adds four more inside it
+	unsigned int fineQuads = EDGES_PER_FACE*nQuads;
+	unsigned int finePoints = nPoints + nEdges + nQuads;
+	unsigned int fineEdges = 2*nEdges + EDGES_PER_FACE*nQuads;
+
+	fine.positions.resize(finePoints);
+	fine.normals.resize(finePoints);
+	fine.colors.resize(finePoints);
+	fine.quads.resize(fineQuads);
+	fine.cornerNormals.clear();
+	fine.cornerColors.clear();
+	fine.quadEdges.resize(EDGES_PER_FACE*fineQuads);
+	fine.edgePoints.resize(2*fineEdges);
+	fine.edgeFaces.resize(FACES_PER_EDGE*fineEdges);
+
+	// the old points keep as many faces as they had, and the
+	// edge and face points all have four, so the point lists
+	// can be laid out up front
+	unsigned int coarseAround = coarse.pointStart[nPoints];
+	unsigned int fineAround = coarseAround + 4*nEdges + 4*nQuads;
+	fine.pointStart.resize(finePoints + 1);
+	fine.pointStart[finePoints] = fineAround;
+	fine.pointFaces.resize(fineAround);
+	fine.pointEdges.resize(fineAround);
+
+	RefineContext context;
+	context.coarse = &coarse;
+	context.fine = &fine;
+	context.firstEdge = nPoints;
+	context.firstFace = nPoints + nEdges;
+	context.firstInnerEdge = 2*nEdges;
+	context.edgePointStart = coarseAround;
+	context.facePointStart = coarseAround + 4*nEdges;
+
+	// the edge and vertex points both need the face points
+	_pool.parallelFor(nQuads, refineFaces, &context);
+	_pool.parallelFor(nEdges, refineEdges, &context);
+	_pool.parallelFor(nPoints, refinePoints, &context);
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// stencils
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// what the passes of refineStencils() work on
+typedef struct StencilContext
+{
+	const SubdivisionLevel *coarse;
+	const StencilTable *from;
+	StencilTable *to;
+
+	// the first pass only counts how many control points
+	// each fine point has, the second fills them in
+	bool fill;
+
+} StencilContext;
+
+
+// the coarse points making up fine point i and their weights,
+// following the rules in refineFaces(), refineEdges(), and
+// refinePoints(). a point may show up more than once
+static void
+stencilTerms(const SubdivisionLevel &coarse, unsigned int i,
+			 std::vector<unsigned int> &points, std::vector<float> &weights)
+{
+	unsigned int nPoints = coarse.pointCount();
+	unsigned int nEdges = coarse.edgeCount();
+
+	points.clear();
+	weights.clear();
+
+	if( i >= nPoints + nEdges )
+	{
+		// a face point is the center of its quad
+		const XVec4ui &quad = coarse.quads[i - nPoints - nEdges];
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+		{
+			points.push_back(quad(j));
+			weights.push_back(0.25f);
+		}
+	}
+	else if( i >= nPoints )
+	{
+		// an edge point is a quarter of each endpoint
+		// and a quarter of each face center
+		unsigned int e = i - nPoints;
+		for( unsigned int n = 0; n < 2; ++n )
+		{
+			points.push_back(coarse.edgePoints[2*e + n]);
+			weights.push_back(0.25f);
+
+			const XVec4ui &quad = coarse.quads[coarse.edgeFaces[FACES_PER_EDGE*e + n]];
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			{
+				points.push_back(quad(j));
+				weights.push_back(0.0625f);
+			}
+		}
+	}
+	else
+	{
+		// a vertex point with n faces and edges around it is
+		// (F + 2E + (n-3)v)/n, which works out to (n-2)/n of
+		// itself, 1/n^2 of every neighbor and 1/4n^2 of every
+		// corner of every face around it
+		unsigned int start = coarse.pointStart[i];
+		unsigned int count = coarse.pointStart[i+1] - start;
+		float n = (float)count;
+
+		points.push_back(i);
+		weights.push_back((n - 2.0f)/n);
+
+		for( unsigned int s = start; s < start + count; ++s )
+		{
+			unsigned int e = coarse.pointEdges[s];
+			points.push_back(coarse.edgePoints[2*e] == i ? coarse.edgePoints[2*e+1]
+														 : coarse.edgePoints[2*e]);
+			weights.push_back(1.0f/(n*n));
+
+			const XVec4ui &quad = coarse.quads[coarse.pointFaces[s]];
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			{
+				points.push_back(quad(j));
+				weights.push_back(0.25f/(n*n));
+			}
+		}
+	}
+}
+
+
+// combine the stencils of the coarse points making up
+// every fine point into the stencil of the fine point
+static void
+refineStencilRows(void *arg, unsigned int begin, unsigned int end)
+{
+	StencilContext &context = *(StencilContext *)arg;
+	const StencilTable &from = *context.from;
+	StencilTable &to = *context.to;
+
+	// the sum for every control point, and which of them
+	// the current point uses, to be cleared for the next
+	std::vector<float> sum(from.controls, 0.0f);
+	std::vector<unsigned char> used(from.controls, 0);
+	std::vector<unsigned int> touched;
+
+	std::vector<unsigned int> points;
+	std::vector<float> weights;
+
+	for( unsigned int i = begin; i < end; ++i )
+	{
+		stencilTerms(*context.coarse, i, points, weights);
+
+		touched.clear();
+		for( unsigned int t = 0; t < points.size(); ++t )
+		{
+			unsigned int k = points[t];
+			for( unsigned int s = from.start[k]; s < from.start[k+1]; ++s )
+			{
+				unsigned int c = from.index[s];
+				if( !used[c] )
+				{
+					used[c] = 1;
+					touched.push_back(c);
+				}
+				sum[c] += weights[t]*from.weight[s];
+			}
+		}
+
+		if( context.fill )
+		{
+			unsigned int out = to.start[i];
+			for( unsigned int t = 0; t < touched.size(); ++t, ++out )
+			{
+				to.index[out] = touched[t];
+				to.weight[out] = sum[touched[t]];
+			}
+		}
+		else
+			to.start[i+1] = touched.size();
+
+		for( unsigned int t = 0; t < touched.size(); ++t )
+		{
+			used[touched[t]] = 0;
+			sum[touched[t]] = 0.0f;
+		}
+	}
+}
+
+
+// the stencils of the points of refine(coarse)
+void
+Subdivider::refineStencils(const SubdivisionLevel &coarse,
+						   const StencilTable &coarseStencils,
+						   StencilTable &fineStencils)
+{
+	unsigned int finePoints = coarse.pointCount() + coarse.edgeCount() + coarse.quadCount();
+
+	StencilContext context;
+	context.coarse = &coarse;
+	context.from = &coarseStencils;
+	context.to = &fineStencils;
+
+	fineStencils.controls = coarseStencils.controls;
+	fineStencils.start.resize(finePoints + 1);
+	fineStencils.start[0] = 0;
+
+	// count the control points of every fine point,
+	// lay the rows out, and then fill them in
+	context.fill = false;
+	_pool.parallelFor(finePoints, refineStencilRows, &context);
+
+	for( unsigned int i = 0; i < finePoints; ++i )
+		fineStencils.start[i+1] += fineStencils.start[i];
+	fineStencils.index.resize(fineStencils.start[finePoints]);
+	fineStencils.weight.resize(fineStencils.start[finePoints]);
+
+	context.fill = true;
+	_pool.parallelFor(finePoints, refineStencilRows, &context);
+}
+
+
+// what applyStencils() works on
+typedef struct ApplyContext
+{
+	const StencilTable *stencils;
+	const XVec3f *controls;
+	XVec3f *result;
+
+} ApplyContext;
+
+
+static void
+applyStencilRows(void *arg, unsigned int begin, unsigned int end)
+{
+	ApplyContext &context = *(ApplyContext *)arg;
+	const StencilTable &stencils = *context.stencils;
+	const unsigned int *index = &stencils.index[0];
+	const float *weight = &stencils.weight[0];
+
+	for( unsigned int i = begin; i < end; ++i )
+	{
+		XVec3f value(0.0f);
+		for( unsigned int s = stencils.start[i]; s < stencils.start[i+1]; ++s )
+			value += weight[s]*context.controls[index[s]];
+		context.result[i] = value;
+	}
+}
+
+
+// evaluate the stencils for the given control values
+void
+Subdivider::applyStencils(const StencilTable &stencils,
+						  const std::vector<XVec3f> &controls,
+						  std::vector<XVec3f> &result)
+{
+	result.resize(stencils.pointCount());
+	if( result.empty() )
+		return;
+
+	ApplyContext context;
+	context.stencils = &stencils;
+	context.controls = &controls[0];
+	context.result = &result[0];
+	_pool.parallelFor(stencils.pointCount(), applyStencilRows, &context);
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// adaptive subdivision
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// the number of quads around a point where the surface is regular
+#define REGULAR_VALENCE 4
+
+
+// a level of adaptive subdivision, which has only the quads
+// refined from the level above, and what became of them
+typedef struct AdaptiveLevel
+{
+	SubdivisionLevel level;
+
+	// the number of quads around each point on the whole
+	// surface, which this level may not have all of
+	std::vector<unsigned int> valence;
+
+	// the cage quad each quad was split off
+	std::vector<unsigned int> cageQuads;
+
+	// the point of the next level each point, edge, and quad
+	// became, or NO_INDEX for those that were not refined
+	std::vector<unsigned int> pointChild;
+	std::vector<unsigned int> edgeChild;
+	std::vector<unsigned int> quadChild;
+
+} AdaptiveLevel;
+
+
+// whether the level has all of the quads around point p
+static inline bool
+isComplete(const AdaptiveLevel &adaptive, unsigned int p)
+{
+	const SubdivisionLevel &level = adaptive.level;
+	return level.pointStart[p+1] - level.pointStart[p] == adaptive.valence[p];
+}
+
+
+// the unit normal of quad i, across its diagonals
+static inline XVec3f
+quadNormal(const SubdivisionLevel &level, unsigned int i)
+{
+	const XVec4ui &quad = level.quads[i];
+	const std::vector<XVec3f> &positions = level.positions;
+	XVec3f normal = (positions[quad(2)] - positions[quad(0)])
+		.cross(positions[quad(3)] - positions[quad(1)]);
+	normal.normalize();
+	return normal;
+}
+
+
+// the quad on the other side of edge e from quad i,
+// or NO_INDEX if the level does not have it
+static inline unsigned int
+otherQuad(const SubdivisionLevel &level, unsigned int e, unsigned int i)
+{
+	const unsigned int *faces = &level.edgeFaces[FACES_PER_EDGE*e];
+	return faces[0] == i ? faces[1] : faces[0];
+}
+
+
+// mark the quads sharing a point with any marked quad
+static void
+growMarks(const SubdivisionLevel &level, const std::vector<unsigned char> &marked,
+		  std::vector<unsigned char> &grown)
+{
+	std::vector<unsigned char> points(level.pointCount(), 0);
+	for( unsigned int i = 0; i < level.quadCount(); ++i )
+		if( marked[i] )
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+				points[level.quads[i](j)] = 1;
+
+	grown.assign(level.quadCount(), 0);
+	for( unsigned int p = 0; p < level.pointCount(); ++p )
+		if( points[p] )
+			for( unsigned int s = level.pointStart[p]; s < level.pointStart[p+1]; ++s )
+				grown[level.pointFaces[s]] = 1;
+}
+
+
+// whether the criteria ask for quad i to be refined
+static bool
+wantsRefining(const AdaptiveLevel &adaptive, unsigned int i,
+			  const AdaptiveCriteria &criteria)
+{
+	const SubdivisionLevel &level = adaptive.level;
+	const XVec4ui &quad = level.quads[i];
+	const std::vector<XVec3f> &positions = level.positions;
+
+	unsigned int cageQuad = adaptive.cageQuads[i];
+	if( cageQuad < criteria.region.size() && criteria.region[cageQuad] )
+		return true;
+
+	if( criteria.extraordinary )
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			if( adaptive.valence[quad(j)] != REGULAR_VALENCE )
+				return true;
+
+	XVec3f center = average(positions[quad(0)], positions[quad(1)],
+							positions[quad(2)], positions[quad(3)]);
+	XVec3f normal = quadNormal(level, i);
+
+	// the longer diagonal against the distance to the eye
+	if( criteria.maxSize > 0.0f )
+	{
+		float size = positions[quad(0)].dist(positions[quad(2)]);
+		float other = positions[quad(1)].dist(positions[quad(3)]);
+		if( other > size )
+			size = other;
+		if( size*criteria.pixelScale > criteria.maxSize*center.dist(criteria.eye) )
+			return true;
+	}
+
+	// the silhouette runs between quads facing the eye and
+	// quads facing away from it
+	if( criteria.silhouette )
+	{
+		bool facing = normal.dot(criteria.eye - center) > 0.0f;
+		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+		{
+			unsigned int other = otherQuad(level, level.quadEdges[EDGES_PER_FACE*i + j], i);
+			if( other == NO_INDEX )
+				continue;
+
+			const XVec4ui &next = level.quads[other];
+			XVec3f nextCenter = average(positions[next(0)], positions[next(1)],
+										positions[next(2)], positions[next(3)]);
+			if( (quadNormal(level, other).dot(criteria.eye - nextCenter) > 0.0f) != facing )
+				return true;
+		}
+	}
+
+	if( criteria.maxBend > 0.0f )
+	{
+		float minCosine = cosf(criteria.maxBend);
+		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+		{
+			unsigned int other = otherQuad(level, level.quadEdges[EDGES_PER_FACE*i + j], i);
+			if( other != NO_INDEX && normal.dot(quadNormal(level, other)) < minCosine )
+				return true;
+		}
+	}
+
+	return false;
+}
+
+
+// pick the quads of a level to refine: those the criteria ask for
+// and the two rings of quads around them. the ring right around a
+// quad has all the quads next to its children, and refining the
+// ring past that completes the points around its children, so the
+// children can be refined again. quads within two rings of a point
+// the level does not have everything around are left alone, since
+// the rings around them can't be refined. returns false if there
+// is nothing to refine
+static bool
+selectQuads(const AdaptiveLevel &adaptive, const AdaptiveCriteria &criteria,
+			std::vector<unsigned char> &selected)
+{
+	const SubdivisionLevel &level = adaptive.level;
+	unsigned int nQuads = level.quadCount();
+
+	std::vector<unsigned char> open(nQuads, 0), near;
+	for( unsigned int i = 0; i < nQuads; ++i )
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			if( !isComplete(adaptive, level.quads[i](j)) )
+				open[i] = 1;
+	growMarks(level, open, near);
+	growMarks(level, near, open);
+
+	std::vector<unsigned char> wanted(nQuads, 0);
+	bool any = false;
+	for( unsigned int i = 0; i < nQuads; ++i )
+	{
+		if( !open[i] && wantsRefining(adaptive, i, criteria) )
+		{
+			wanted[i] = 1;
+			any = true;
+		}
+	}
+	if( !any )
+		return false;
+
+	growMarks(level, wanted, near);
+	growMarks(level, near, selected);
+	return true;
+}
+
+
+// refine the selected quads of coarse into fine, which gets the
+// vertex points, then the edge points, then the face points of
+// the selected quads and the four quads each is split into.
+// everything around the corners of the selected quads must be
+// in coarse
+static void
+refineSelected(AdaptiveLevel &coarse, const std::vector<unsigned char> &selected,
+			   AdaptiveLevel &fine)
+{
+	const SubdivisionLevel &from = coarse.level;
+	SubdivisionLevel &to = fine.level;
+	unsigned int nQuads = from.quadCount();
+
+	// number the new points
+	coarse.pointChild.assign(from.pointCount(), NO_INDEX);
+	coarse.edgeChild.assign(from.edgeCount(), NO_INDEX);
+	coarse.quadChild.assign(nQuads, NO_INDEX);
+	unsigned int nPoints = 0;
+	for( unsigned int i = 0; i < nQuads; ++i )
+		if( selected[i] )
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+				if( coarse.pointChild[from.quads[i](j)] == NO_INDEX )
+					coarse.pointChild[from.quads[i](j)] = nPoints++;
+	for( unsigned int i = 0; i < nQuads; ++i )
+		if( selected[i] )
+			for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+				if( coarse.edgeChild[from.quadEdges[EDGES_PER_FACE*i + j]] == NO_INDEX )
+					coarse.edgeChild[from.quadEdges[EDGES_PER_FACE*i + j]] = nPoints++;
+	for( unsigned int i = 0; i < nQuads; ++i )
+		if( selected[i] )
+			coarse.quadChild[i] = nPoints++;
+
+	// the new points by the same rules as refine(). the edge
+	// points need the centers of the quads next to the selected
+	// ones too, so the centers of all of them are worked out
+	const std::vector<XVec3f> *values[ATTRIBUTES];
+	std::vector<XVec3f> *result[ATTRIBUTES];
+	attributesOf(from, values);
+	attributesOf(to, result);
+
+	std::vector<XVec3f> centers(nQuads);
+	for( unsigned int a = 0; a < ATTRIBUTES; ++a )
+	{
+		faceCenters(from, a, 0, nQuads, &centers[0]);
+
+		const XVec3f *value = &(*values[a])[0];
+		std::vector<XVec3f> &points = *result[a];
+		points.resize(nPoints);
+		for( unsigned int p = 0; p < from.pointCount(); ++p )
+			if( coarse.pointChild[p] != NO_INDEX )
+				points[coarse.pointChild[p]] = vertexRule(from, p, value, &centers[0]);
+		for( unsigned int e = 0; e < from.edgeCount(); ++e )
+			if( coarse.edgeChild[e] != NO_INDEX )
+				points[coarse.edgeChild[e]] = edgeRule(from, e, value, &centers[0]);
+		for( unsigned int i = 0; i < nQuads; ++i )
+			if( coarse.quadChild[i] != NO_INDEX )
+				points[coarse.quadChild[i]] = centers[i];
+	}
+
+	// split the selected quads as refineFaces() does
+	to.quads.clear();
+	to.cornerNormals.clear();
+	to.cornerColors.clear();
+	fine.cageQuads.clear();
+	for( unsigned int i = 0; i < nQuads; ++i )
+	{
+		if( !selected[i] )
+			continue;
+
+		const XVec4ui &quad = from.quads[i];
+		const unsigned int *edges = &from.quadEdges[EDGES_PER_FACE*i];
+		for( unsigned int j = 0; j < EDGES_PER_FACE; ++j )
+		{
+			unsigned int k = (j+1) % EDGES_PER_FACE;
+			to.quads.push_back(XVec4ui(coarse.quadChild[i], coarse.edgeChild[edges[j]],
+									   coarse.pointChild[quad(k)], coarse.edgeChild[edges[k]]));
+			fine.cageQuads.push_back(coarse.cageQuads[i]);
+		}
+	}
+
+	// only the vertex points can be irregular
+	fine.valence.assign(nPoints, REGULAR_VALENCE);
+	for( unsigned int p = 0; p < from.pointCount(); ++p )
+		if( coarse.pointChild[p] != NO_INDEX )
+			fine.valence[coarse.pointChild[p]] = coarse.valence[p];
+
+	findAdjacency(to);
+}
+
+
+// add the values of point p of level to result
+static void
+addPoint(const SubdivisionLevel &level, unsigned int p, SubdivisionLevel &result)
+{
+	result.positions.push_back(level.positions[p]);
+	result.normals.push_back(level.normals[p]);
+	result.colors.push_back(level.colors[p]);
+}
+
+
+// the index in result of point p of level l. a point that was
+// refined is shown where it ended up on the deepest level it
+// reached, so every quad that has it shares the same one
+static unsigned int
+shownPoint(const std::vector<AdaptiveLevel> &levels, unsigned int l, unsigned int p,
+		   std::vector< std::vector<unsigned int> > &shown, SubdivisionLevel &result)
+{
+	while( l+1 < levels.size() && levels[l].pointChild[p] != NO_INDEX )
+	{
+		p = levels[l].pointChild[p];
+		++l;
+	}
+
+	if( shown[l][p] == NO_INDEX )
+	{
+		shown[l][p] = result.pointCount();
+		addPoint(levels[l].level, p, result);
+	}
+	return shown[l][p];
+}
+
+
+// gather the quads that were not refined from every level. the
+// selection keeps quads that touch within a level of each other,
+// so a side of a quad has at most one edge point of a finer quad
+// along it. a quad with some of those is split into a fan of
+// quads around its center, with a triangle, given as a quad
+// with a repeated corner, if an odd number of sides is left
+static void
+stitchLevels(const std::vector<AdaptiveLevel> &levels, SubdivisionLevel &result)
+{
+	std::vector< std::vector<unsigned int> > shown(levels.size());
+	for( unsigned int l = 0; l < levels.size(); ++l )
+		shown[l].assign(levels[l].level.pointCount(), NO_INDEX);
+
+	for( unsigned int l = 0; l < levels.size(); ++l )
+	{
+		const AdaptiveLevel &adaptive = levels[l];
+		const SubdivisionLevel &level = adaptive.level;
+		bool deepest = l+1 == levels.size();
+
+		for( unsigned int i = 0; i < level.quadCount(); ++i )
+		{
+			if( !deepest && adaptive.quadChild[i] != NO_INDEX )
+				continue;
+
+			// walk around the quad, taking in the edge points
+			// of the sides next to refined quads
+			unsigned int around[VERTICES_PER_FACE + EDGES_PER_FACE];
+			unsigned int n = 0;
+			unsigned int first = NO_INDEX;
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			{
+				around[n++] = shownPoint(levels, l, level.quads[i](j), shown, result);
+
+				unsigned int e = level.quadEdges[EDGES_PER_FACE*i + j];
+				if( !deepest && adaptive.edgeChild[e] != NO_INDEX )
+				{
+					if( first == NO_INDEX )
+						first = n;
+					around[n++] = shownPoint(levels, l+1, adaptive.edgeChild[e], shown, result);
+				}
+			}
+
+			if( first == NO_INDEX )
+			{
+				result.quads.push_back(XVec4ui(around[0], around[1], around[2], around[3]));
+				continue;
+			}
+
+			// the center is the average of everything around it
+			unsigned int center = result.pointCount();
+			XVec3f position(0.0f), normal(0.0f), color(0.0f);
+			for( unsigned int s = 0; s < n; ++s )
+			{
+				position += result.positions[around[s]];
+				normal += result.normals[around[s]];
+				color += result.colors[around[s]];
+			}
+			result.positions.push_back(position/(float)n);
+			result.normals.push_back(normal/(float)n);
+			result.colors.push_back(color/(float)n);
+
+			// starting from an edge point, so that a quad split
+			// on every side is split just as refine() would
+			for( unsigned int s = 0; s + 1 < n; s += 2 )
+				result.quads.push_back(XVec4ui(center, around[(first + s) % n],
+											   around[(first + s+1) % n],
+											   around[(first + s+2) % n]));
+			if( n % 2 )
+				result.quads.push_back(XVec4ui(center, around[(first + n-1) % n],
+											   around[first], around[first]));
+		}
+	}
+}
+
+
+// subdivide cage only where criteria asks for it
+void
+Subdivider::refineAdaptive(const SubdivisionLevel &cage,
+						   const AdaptiveCriteria &criteria,
+						   SubdivisionLevel &result)
+{
+	std::vector<AdaptiveLevel> levels;
+	levels.reserve(criteria.maxLevel + 1);
+	levels.push_back(AdaptiveLevel());
+
+	// the cage has everything around every point
+	AdaptiveLevel &top = levels[0];
+	top.level = cage;
+	top.valence.resize(cage.pointCount());
+	for( unsigned int p = 0; p < cage.pointCount(); ++p )
+		top.valence[p] = cage.pointStart[p+1] - cage.pointStart[p];
+	top.cageQuads.resize(cage.quadCount());
+	for( unsigned int i = 0; i < cage.quadCount(); ++i )
+		top.cageQuads[i] = i;
+
+	std::vector<unsigned char> selected;
+	for( unsigned int l = 0; l < criteria.maxLevel; ++l )
+	{
+		if( !selectQuads(levels[l], criteria, selected) )
+			break;
+
+		levels.push_back(AdaptiveLevel());
+		refineSelected(levels[l], selected, levels[l+1]);
+	}
+
+	result = SubdivisionLevel();
+	stitchLevels(levels, result);
+}
+
+
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+		// the limit surface
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ //
+
+
+// how many times a quad may be split looking for a regular one
+// around (u,v). nearer than this to an extraordinary corner, where
+// none is ever found, the limit at the corner is used instead, as
+// the points would be too close together to be precise anyway
+#define MAX_LIMIT_STEPS 12
+
+
+// the points around point p in turn, starting with quad face:
+// edges[j] is the other end of edge j and corners[j] the corner
+// across quad j from p, which lies between edges j and j+1. p
+// must have all of its quads around it
+static void
+ringAround(const SubdivisionLevel &level, unsigned int p, unsigned int face,
+		   std::vector<unsigned int> &edges, std::vector<unsigned int> &corners)
+{
+	unsigned int count = level.pointStart[p+1] - level.pointStart[p];
+	edges.clear();
+	corners.clear();
+
+	unsigned int i = face;
+	for( unsigned int n = 0; n < count; ++n )
+	{
+		const XVec4ui &quad = level.quads[i];
+		unsigned int k = cornerOfQuad(level, i, p);
+		edges.push_back(quad((k+1) % VERTICES_PER_FACE));
+		corners.push_back(quad((k+2) % VERTICES_PER_FACE));
+
+		// the next quad shares the side from corner k-1 to p
+		unsigned int side = (k+EDGES_PER_FACE-1) % EDGES_PER_FACE;
+		i = otherQuad(level, level.quadEdges[EDGES_PER_FACE*i + side], i);
+	}
+}
+
+
+// the limit masks of a point with n quads around it: the position
+// is n^2 of the point, 4 of every edge neighbor, and 1 of every
+// corner across, over n(n+5). the tangents weigh the neighbors by
+// the cosine and the sine of their angle around the point, scaled
+// so that a regular point gets the derivatives of its patches
+static void
+limitFromRing(const XVec3f *positions, unsigned int p,
+			  const std::vector<unsigned int> &edges,
+			  const std::vector<unsigned int> &corners, LimitPoint &limit)
+{
+	unsigned int count = edges.size();
+	float n = (float)count;
+
+	XVec3f position = n*n*positions[p];
+	XVec3f du(0.0f), dv(0.0f);
+	float a = 1.0f + cosf(2.0f*M_PI/n) + cosf(M_PI/n)*sqrtf(2.0f*(9.0f + cosf(2.0f*M_PI/n)));
+	for( unsigned int j = 0; j < count; ++j )
+	{
+		float angle = 2.0f*M_PI*j/n;
+		float next = 2.0f*M_PI*(j+1)/n;
+		const XVec3f &edge = positions[edges[j]];
+		const XVec3f &corner = positions[corners[j]];
+
+		position += 4.0f*edge + corner;
+		du += a*cosf(angle)*edge + (cosf(angle) + cosf(next))*corner;
+		dv += a*sinf(angle)*edge + (sinf(angle) + sinf(next))*corner;
+	}
+
+	limit.position = position/(n*(n + 5.0f));
+	limit.du = du/12.0f;
+	limit.dv = dv/12.0f;
+	limit.normal = limit.du.cross(limit.dv);
+	limit.normal.normalize();
+}
+
+
+// the uniform cubic B-spline basis functions and their derivatives at t
+static inline void
+bsplineBasis(float t, float basis[4], float derivative[4])
+{
+	float s = 1.0f - t;
+	basis[0] = s*s*s/6.0f;
+	basis[1] = (3.0f*t*t*t - 6.0f*t*t + 4.0f)/6.0f;
+	basis[2] = (-3.0f*t*t*t + 3.0f*t*t + 3.0f*t + 1.0f)/6.0f;
+	basis[3] = t*t*t/6.0f;
+
+	derivative[0] = -s*s/2.0f;
+	derivative[1] = (3.0f*t*t - 4.0f*t)/2.0f;
+	derivative[2] = (-3.0f*t*t + 2.0f*t + 1.0f)/2.0f;
+	derivative[3] = t*t/2.0f;
+}
+
+
+// whether quad i has only regular points around it, with
+// all of their quads, so that it is a B-spline patch
+static bool
+isRegularQuad(const AdaptiveLevel &adaptive, unsigned int i)
+{
+	for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+	{
+		unsigned int p = adaptive.level.quads[i](j);
+		if( adaptive.valence[p] != REGULAR_VALENCE || !isComplete(adaptive, p) )
+			return false;
+	}
+	return true;
+}
+
+
+// evaluate the B-spline patch of regular quad i at (u,v). its
+// 16 control points are laid out on a grid of rows along v and
+// columns along u, with the corners of the quad in the middle
+static void
+evaluatePatch(const SubdivisionLevel &level, unsigned int i, float u, float v,
+			  LimitPoint &limit)
+{
+	// the row and column of each corner of the quad
+	static const int cornerRow[VERTICES_PER_FACE] = { 1, 1, 2, 2 };
+	static const int cornerColumn[VERTICES_PER_FACE] = { 1, 2, 2, 1 };
+
+	unsigned int grid[4][4];
+	std::vector<unsigned int> edges, corners;
+	const XVec4ui &quad = level.quads[i];
+	for( unsigned int k = 0; k < VERTICES_PER_FACE; ++k )
+	{
+		// the steps toward the next and the previous corner
+		unsigned int next = (k+1) % VERTICES_PER_FACE;
+		unsigned int previous = (k+VERTICES_PER_FACE-1) % VERTICES_PER_FACE;
+		int row = cornerRow[k], column = cornerColumn[k];
+		int nextRow = cornerRow[next] - row, nextColumn = cornerColumn[next] - column;
+		int prevRow = cornerRow[previous] - row, prevColumn = cornerColumn[previous] - column;
+
+		// around the corner from this quad, the edges go next,
+		// previous, then away from those, with the corners between
+		ringAround(level, quad(k), i, edges, corners);
+		grid[row][column] = quad(k);
+		grid[row - nextRow][column - nextColumn] = edges[2];
+		grid[row - prevRow][column - prevColumn] = edges[3];
+		grid[row + prevRow - nextRow][column + prevColumn - nextColumn] = corners[1];
+		grid[row - nextRow - prevRow][column - nextColumn - prevColumn] = corners[2];
+		grid[row + nextRow - prevRow][column + nextColumn - prevColumn] = corners[3];
+	}
+
+	float bu[4], du[4], bv[4], dv[4];
+	bsplineBasis(u, bu, du);
+	bsplineBasis(v, bv, dv);
+
+	limit.position = XVec3f(0.0f);
+	limit.du = XVec3f(0.0f);
+	limit.dv = XVec3f(0.0f);
+	for( int r = 0; r < 4; ++r )
+	{
+		for( int c = 0; c < 4; ++c )
+		{
+			const XVec3f &point = level.positions[grid[r][c]];
+			limit.position += bv[r]*bu[c]*point;
+			limit.du += bv[r]*du[c]*point;
+			limit.dv += dv[r]*bu[c]*point;
+		}
+	}
+	limit.normal = limit.du.cross(limit.dv);
+	limit.normal.normalize();
+}
+
+
+// add point p of level to local if it is not there yet,
+// returning its index in local
+static unsigned int
+localPoint(const SubdivisionLevel &level, unsigned int p,
+		   std::vector<unsigned int> &points, AdaptiveLevel &local)
+{
+	for( unsigned int s = 0; s < points.size(); ++s )
+		if( points[s] == p )
+			return s;
+
+	points.push_back(p);
+	addPoint(level, p, local.level);
+	local.valence.push_back(level.pointStart[p+1] - level.pointStart[p]);
+	return points.size() - 1;
+}
+
+
+// copy the quads within three rings of quad i of a closed level
+// into a level of its own, with quad i first. that is enough for
+// the two rings around quad i to be refined
+static void
+extractRings(const SubdivisionLevel &level, unsigned int i, AdaptiveLevel &local)
+{
+	std::vector<unsigned int> quads(1, i);
+	unsigned int ringStart = 0;
+	for( unsigned int ring = 0; ring < 3; ++ring )
+	{
+		unsigned int ringEnd = quads.size();
+		for( unsigned int q = ringStart; q < ringEnd; ++q )
+		{
+			for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			{
+				unsigned int p = level.quads[quads[q]](j);
+				for( unsigned int s = level.pointStart[p]; s < level.pointStart[p+1]; ++s )
+				{
+					unsigned int face = level.pointFaces[s];
+					bool found = false;
+					for( unsigned int t = 0; t < quads.size() && !found; ++t )
+						found = quads[t] == face;
+					if( !found )
+						quads.push_back(face);
+				}
+			}
+		}
+		ringStart = ringEnd;
+	}
+
+	local = AdaptiveLevel();
+	std::vector<unsigned int> points;
+	for( unsigned int q = 0; q < quads.size(); ++q )
+	{
+		XVec4ui quad;
+		for( unsigned int j = 0; j < VERTICES_PER_FACE; ++j )
+			quad(j) = localPoint(level, level.quads[quads[q]](j), points, local);
+		local.level.quads.push_back(quad);
+	}
+	local.cageQuads.assign(quads.size(), 0);
+	findAdjacency(local.level);
+}
+
+
+// exchange contents with another adaptive level
+static void
+swapLevels(AdaptiveLevel &a, AdaptiveLevel &b)
+{
+	a.level.swap(b.level);
+	a.valence.swap(b.valence);
+	a.cageQuads.swap(b.cageQuads);
+}
+
+
+// where point p of level ends up on the limit surface
+void
+Subdivider::limitOfPoint(const SubdivisionLevel &level, unsigned int p, LimitPoint &limit)
+{
+	std::vector<unsigned int> edges, corners;
+	ringAround(level, p, level.pointFaces[level.pointStart[p]], edges, corners);
+	limitFromRing(&level.positions[0], p, edges, corners, limit);
+}
+
+
+// the limit surface at (u,v) of quad i of level
+void
+Subdivider::limitOfQuad(const SubdivisionLevel &level, unsigned int i,
+						float u, float v, LimitPoint &limit)
+{
+	// where the corners of a quad are in (u,v)
+	static const float cornerU[VERTICES_PER_FACE] = { 0.0f, 1.0f, 1.0f, 0.0f };
+	static const float cornerV[VERTICES_PER_FACE] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+	std::vector<unsigned int> edges, corners;
+	unsigned int k = u < 0.5f ? (v < 0.5f ? 0 : 3) : (v < 0.5f ? 1 : 2);
+	unsigned int corner = level.quads[i](k);
+	float nearby = 1.0f/(1 << MAX_LIMIT_STEPS);
+	if( level.pointStart[corner+1] - level.pointStart[corner] != REGULAR_VALENCE &&
+		fabsf(u - cornerU[k]) < nearby && fabsf(v - cornerV[k]) < nearby )
+	{
+		ringAround(level, corner, i, edges, corners);
+		limitFromRing(&level.positions[0], corner, edges, corners, limit);
+		return;
+	}
+
+	AdaptiveLevel local, fine;
+	extractRings(level, i, local);
+
+	// the quad (u,v) is in, and the derivatives of its
+	// (u,v) along the (u,v) of quad i
+	unsigned int quad = 0;
+	float jacobian[2][2] = { { 1.0f, 0.0f }, { 0.0f, 1.0f } };
+
+	std::vector<unsigned char> marked, near, selected;
+	for( unsigned int step = 0; !isRegularQuad(local, quad); ++step )
+	{
+		// the corner whose child (u,v) is in. past the last step
+		// (u,v) can only be at a corner, left to rounding
+		k = u < 0.5f ? (v < 0.5f ? 0 : 3) : (v < 0.5f ? 1 : 2);
+		if( step > MAX_LIMIT_STEPS )
+		{
+			corner = local.level.quads[quad](k);
+			ringAround(local.level, corner, quad, edges, corners);
+			limitFromRing(&local.level.positions[0], corner, edges, corners, limit);
+			return;
+		}
+
+		// refine the two rings around the quad, as adaptive
+		// subdivision would, so the child can be refined again
+		marked.assign(local.level.quadCount(), 0);
+		marked[quad] = 1;
+		growMarks(local.level, marked, near);
+		growMarks(local.level, near, selected);
+		refineSelected(local, selected, fine);
+
+		// the child at corner k of the quad is child k-1 of
+		// its children, which come in the order of the quads
+		unsigned int j = (k+EDGES_PER_FACE-1) % EDGES_PER_FACE;
+		unsigned int before = 0;
+		for( unsigned int q = 0; q < quad; ++q )
+			before += selected[q];
+		quad = EDGES_PER_FACE*before + j;
+
+		// the child has its first corner at the center of the
+		// quad, and its u and v run toward the midpoints of the
+		// sides of the quad at corner k
+		float au = (cornerU[j] + cornerU[k])/2.0f - 0.5f;
+		float av = (cornerV[j] + cornerV[k])/2.0f - 0.5f;
+		unsigned int l = (k+1) % VERTICES_PER_FACE;
+		float bu = (cornerU[k] + cornerU[l])/2.0f - 0.5f;
+		float bv = (cornerV[k] + cornerV[l])/2.0f - 0.5f;
+
+		float childU = 4.0f*((u - 0.5f)*au + (v - 0.5f)*av);
+		float childV = 4.0f*((u - 0.5f)*bu + (v - 0.5f)*bv);
+		u = childU;
+		v = childV;
+
+		float step0[2] = { 4.0f*(au*jacobian[0][0] + av*jacobian[1][0]),
+						   4.0f*(au*jacobian[0][1] + av*jacobian[1][1]) };
+		float step1[2] = { 4.0f*(bu*jacobian[0][0] + bv*jacobian[1][0]),
+						   4.0f*(bu*jacobian[0][1] + bv*jacobian[1][1]) };
+		jacobian[0][0] = step0[0];
+		jacobian[0][1] = step0[1];
+		jacobian[1][0] = step1[0];
+		jacobian[1][1] = step1[1];
+
+		swapLevels(local, fine);
+	}
+
+	LimitPoint patch;
+	evaluatePatch(local.level, quad, u, v, patch);
+
+	// back to the u and v of quad i
+	limit.position = patch.position;
+	limit.du = jacobian[0][0]*patch.du + jacobian[1][0]*patch.dv;
+	limit.dv = jacobian[0][1]*patch.du + jacobian[1][1]*patch.dv;
+	limit.normal = patch.normal;
+}
+
+
+// what limitPoints() works on
+typedef struct LimitContext
+{
+	const SubdivisionLevel *level;
+	XVec3f *positions;
+	XVec3f *normals;
+
+} LimitContext;
+
+
+static void
+limitPointRange(void *arg, unsigned int begin, unsigned int end)
+{
+	LimitContext &context = *(LimitContext *)arg;
+	const SubdivisionLevel &level = *context.level;
+
+	std::vector<unsigned int> edges, corners;
+	LimitPoint limit;
+	for( unsigned int p = begin; p < end; ++p )
+	{
+		ringAround(level, p, level.pointFaces[level.pointStart[p]], edges, corners);
+		limitFromRing(&level.positions[0], p, edges, corners, limit);
+		context.positions[p] = limit.position;
+		context.normals[p] = limit.normal;
+	}
+}
+
+
+// where every point of level ends up on the limit surface
+void
+Subdivider::limitPoints(const SubdivisionLevel &level,
+						std::vector<XVec3f> &positions,
+						std::vector<XVec3f> &normals)
+{
+	positions.resize(level.pointCount());
+	normals.resize(level.pointCount());
+	if( positions.empty() )
+		return;
+
+	LimitContext context;
+	context.level = &level;
+	context.positions = &positions[0];
+	context.normals = &normals[0];
+	_pool.parallelFor(level.pointCount(), limitPointRange, &context);
+}
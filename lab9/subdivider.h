@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#ifndef __SUBDIVIDER_H__
+#define __SUBDIVIDER_H__
+
+#include <vector>
+#include "xvec.h"
+#include "threadpool.h"
+
+// one level of a subdivided mesh: a welded, closed quad mesh
+// kept as separate arrays of positions, normals, and colors,
+// along with the adjacency needed to subdivide it again
+struct SubdivisionLevel
+{
+	// one of each per point
+	std::vector<XVec3f> positions;
+	std::vector<XVec3f> normals;
+	std::vector<XVec3f> colors;
+
+	// four point indices per quad
+	std::vector<XVec4ui> quads;
+
+	// the normal and color at each corner of each quad (four
+	// per quad) for a level built from vertices that differed
+	// at the same point, like the faces of a cube. the face
+	// centers average these instead of the welded points
+	std::vector<XVec3f> cornerNormals;
+	std::vector<XVec3f> cornerColors;
+
+	// the edge along each side of each quad, where side
+	// j of quad i runs from quads[i](j) to quads[i](j+1)
+	std::vector<unsigned int> quadEdges;
+
+	// the two points at the ends of edge e are edgePoints[2*e]
+	// and edgePoints[2*e+1], and the two faces sharing it are
+	// edgeFaces[2*e] and edgeFaces[2*e+1]
+	std::vector<unsigned int> edgePoints;
+	std::vector<unsigned int> edgeFaces;
+
+	// the faces and the edges around point p are at
+	// pointStart[p] up to pointStart[p+1] in pointFaces
+	// and pointEdges; a closed mesh has as many of one
+	// as of the other
+	std::vector<unsigned int> pointStart;
+	std::vector<unsigned int> pointFaces;
+	std::vector<unsigned int> pointEdges;
+
+	unsigned int pointCount() const { return positions.size(); }
+	unsigned int edgeCount() const { return edgePoints.size()/2; }
+	unsigned int quadCount() const { return quads.size(); }
+
+	// exchange contents with another level
+	void swap(SubdivisionLevel &other);
+};
+
+// the weights of the control points that make up every point of
+// a subdivided level: point i is the sum of weight[s] times control
+// point index[s] for s from start[i] up to start[i+1]. since the
+// weights depend only on the topology, the level can follow the
+// control points as they move without being subdivided again
+struct StencilTable
+{
+	std::vector<unsigned int> start;
+	std::vector<unsigned int> index;
+	std::vector<float> weight;
+
+	// the number of control points
+	unsigned int controls;
+
+	StencilTable() : controls(0) {}
+
+	unsigned int pointCount() const { return start.empty() ? 0 : start.size() - 1; }
+
+	// every point is just its own control point
+	void identity(unsigned int points);
+
+	// exchange contents with another table
+	void swap(StencilTable &other);
+};
+
+// what decides which quads adaptive subdivision refines: a quad
+// is refined while it is above maxLevel and any of these ask for it
+struct AdaptiveCriteria
+{
+	// the deepest level any quad is refined to
+	unsigned int maxLevel;
+
+	// refine the quads around points without four quads
+	// around them, where the surface is least regular
+	bool extraordinary;
+
+	// refine quads that look bigger than maxSize pixels from eye,
+	// where pixelScale is how many pixels something one unit long
+	// covers one unit away. a maxSize of 0 turns this off
+	float maxSize;
+	XVec3f eye;
+	float pixelScale;
+
+	// refine the quads along the silhouette seen from eye
+	bool silhouette;
+
+	// refine quads that bend more than this many radians
+	// away from a neighbor; 0 turns this off
+	float maxBend;
+
+	// refine the quads split off cage quad i for which
+	// region[i] is not 0, to select part of the surface
+	std::vector<unsigned char> region;
+
+	AdaptiveCriteria()
+		: maxLevel(0), extraordinary(true), maxSize(0.0f), eye(0.0f),
+		  pixelScale(0.0f), silhouette(false), maxBend(0.0f) {}
+};
+
+// a point on the limit surface, with the derivatives of the
+// position along u and v of the quad it was found on, and the
+// unit normal there
+struct LimitPoint
+{
+	XVec3f position;
+	XVec3f du;
+	XVec3f dv;
+	XVec3f normal;
+};
+
+// Catmull-Clark subdivision of closed quad meshes. every
+// level computes the face, edge, and vertex points each in
+// one pass spread over a pool of threads, and builds the
+// adjacency of the next level directly from this one
+class Subdivider
+{
+public:
+	// threads is the number of threads to use,
+	// 0 means one per processor
+	Subdivider(unsigned int threads = 0) : _pool(threads) {}
+
+	// change the number of threads, 0 means one per processor
+	void setThreads(unsigned int threads) { _pool.setThreads(threads); }
+	unsigned int threads() const { return _pool.threads(); }
+
+	// build a level from a quad mesh given as vertex arrays.
+	// vertices at the same location are welded into a single
+	// point with the average normal and color. returns false
+	// if the mesh is not closed with every edge shared by
+	// two faces, since then it cannot be subdivided
+	bool build(const std::vector<XVec3f> &positions,
+			   const std::vector<XVec3f> &normals,
+			   const std::vector<XVec3f> &colors,
+			   const std::vector<XVec4ui> &quads,
+			   SubdivisionLevel &level);
+
+	// subdivide coarse once into fine. fine has one point
+	// for every point, then every edge, then every face of
+	// coarse, and every quad of coarse is split into four
+	void refine(const SubdivisionLevel &coarse, SubdivisionLevel &fine);
+
+	// the stencils of the points of refine(coarse) from the
+	// stencils of the points of coarse
+	void refineStencils(const SubdivisionLevel &coarse,
+						const StencilTable &coarseStencils,
+						StencilTable &fineStencils);
+
+	// evaluate the stencils for the given control values
+	void applyStencils(const StencilTable &stencils,
+					   const std::vector<XVec3f> &controls,
+					   std::vector<XVec3f> &result);
+
+	// subdivide cage only where criteria asks for it. each level
+	// refines just the chosen quads and the two rings around them
+	// they need, and result gets the quads that were not refined
+	// further from every level, with those next to finer ones
+	// split so that they meet without cracks. result has only
+	// points and quads, no adjacency
+	void refineAdaptive(const SubdivisionLevel &cage,
+						const AdaptiveCriteria &criteria,
+						SubdivisionLevel &result);
+
+	// where point p of level ends up on the limit surface, from
+	// the limit masks. du runs toward the first point p shares an
+	// edge with in the first quad around it, and dv a quarter turn
+	// on. at an extraordinary point they only give the tangent plane
+	void limitOfPoint(const SubdivisionLevel &level, unsigned int p, LimitPoint &limit);
+
+	// the limit surface at (u,v) of quad i of level, where corner
+	// j of the quad is at (0,0), (1,0), (1,1), and (0,1) for j from
+	// 0 to 3. a quad with only regular points around it is a bicubic
+	// B-spline patch; any other is split around (u,v) until it lands
+	// in one, except right at an extraordinary point
+	void limitOfQuad(const SubdivisionLevel &level, unsigned int i,
+					 float u, float v, LimitPoint &limit);
+
+	// where every point of level ends up on the limit
+	// surface, and the normal there
+	void limitPoints(const SubdivisionLevel &level,
+					 std::vector<XVec3f> &positions,
+					 std::vector<XVec3f> &normals);
+
+private:
+	ThreadPool _pool;
+};
+
+#endif /* __SUBDIVIDER_H__ */
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "mesh.h"
+
+/*
+ * Subdivision benchmark: subdivides the cube and the randomized
+ * cube to levels 1 through 7 on one thread and on all of them,
+ * and prints the best time of a few runs for each, along with how
+ * long the first edit of the cage takes (which works out the stencils)
+ * and how long the subdivided mesh takes to follow later edits. then
+ * it does the same for adaptive subdivision along the silhouette
+ * and around the extraordinary points, seen from EYE, and how long
+ * showing each level takes the first time and once it is kept.
+ */
+
+// the deepest level to subdivide to
+#define MAX_LEVEL 7
+
+// time for the best of this many runs
+#define RUNS 5
+
+// where adaptive subdivision is seen from
+#define EYE XVec3f(2.0f, 3.0f, 4.5f)
+
+
+// wall clock time in seconds
+static double
+nowSeconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec*1e-6;
+}
+
+
+// best time in seconds to subdivide the cube, randomized
+// or not, to the given level on the given number of threads.
+// stencils and edit are set to the best times to move the cage
+// the first time and from then on
+static double
+timeSubdivide(Mesh &mesh, bool randomized, unsigned int level,
+			  unsigned int threads, int runs, double &stencils, double &edit)
+{
+	double best = 0.0;
+	mesh.setSubdivisionThreads(threads);
+	for( int r = 0; r < runs; ++r )
+	{
+		mesh.toCube();
+		if( randomized )
+			mesh.randomize();
+
+		double start = nowSeconds();
+		mesh.subdivide(level);
+		double elapsed = nowSeconds() - start;
+		if( r == 0 || elapsed < best )
+			best = elapsed;
+
+		start = nowSeconds();
+		mesh.randomize();
+		elapsed = nowSeconds() - start;
+		if( r == 0 || elapsed < stencils )
+			stencils = elapsed;
+
+		start = nowSeconds();
+		mesh.randomize();
+		elapsed = nowSeconds() - start;
+		if( r == 0 || elapsed < edit )
+			edit = elapsed;
+	}
+	return best;
+}
+
+
+// best time in seconds to adaptively subdivide the
+// cube, randomized or not, with the given criteria
+static double
+timeAdaptive(Mesh &mesh, bool randomized, const AdaptiveCriteria &criteria, int runs)
+{
+	double best = 0.0;
+	for( int r = 0; r < runs; ++r )
+	{
+		mesh.toCube();
+		if( randomized )
+			mesh.randomize();
+
+		double start = nowSeconds();
+		mesh.subdivideAdaptive(criteria);
+		double elapsed = nowSeconds() - start;
+		if( r == 0 || elapsed < best )
+			best = elapsed;
+	}
+	return best;
+}
+
+
+static void
+usage(char const *name)
+{
+	fprintf(stderr, "usage: %s [-j threads] [-l max level] [-r runs]\n", name);
+	exit(1);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	unsigned int threads = 0;
+	unsigned int maxLevel = MAX_LEVEL;
+	int runs = RUNS;
+
+	int c;
+	while( (c = getopt(argc, argv, "j:l:r:")) != -1 )
+	{
+		switch( c )
+		{
+			case 'j':
+				threads = atoi(optarg);
+				break;
+			case 'l':
+				maxLevel = atoi(optarg);
+				break;
+			case 'r':
+				runs = atoi(optarg);
+				if( runs < 1 )
+					usage(argv[0]);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	Mesh mesh;
+	mesh.setSubdivisionThreads(threads);
+	threads = mesh.subdivisionThreads();
+
+	printf("%-10s %5s %9s %9s %12s %12s %8s %12s %9s\n", "mesh", "level", "quads",
+		   "vertices", "1 thread ms", "threads ms", "speedup", "stencils ms", "edit ms");
+
+	for( int randomized = 0; randomized < 2; ++randomized )
+	{
+		for( unsigned int level = 1; level <= maxLevel; ++level )
+		{
+			// the edits are timed on all of the threads
+			double stencils = 0.0, edit = 0.0;
+			double serial = timeSubdivide(mesh, randomized, level, 1, runs, stencils, edit);
+			double parallel = timeSubdivide(mesh, randomized, level, threads, runs, stencils, edit);
+
+			printf("%-10s %5u %9u %9u %12.3f %12.3f %7.2fx %12.3f %9.3f\n",
+				   randomized ? "randomized" : "cube", level,
+				   mesh.quadCount(), mesh.vertexCount(),
+				   serial*1000.0, parallel*1000.0,
+				   parallel > 0.0 ? serial/parallel : 0.0,
+				   stencils*1000.0, edit*1000.0);
+		}
+	}
+	printf("(%u threads)\n", threads);
+
+	printf("\n%-10s %5s %9s %9s %12s %15s\n", "adaptive", "level", "quads",
+		   "vertices", "ms", "uniform quads");
+
+	AdaptiveCriteria criteria;
+	criteria.extraordinary = true;
+	criteria.silhouette = true;
+	criteria.eye = EYE;
+	for( int randomized = 0; randomized < 2; ++randomized )
+	{
+		unsigned int uniformQuads = 6;
+		for( unsigned int level = 1; level <= maxLevel; ++level )
+		{
+			uniformQuads *= 4;
+			criteria.maxLevel = level;
+			double elapsed = timeAdaptive(mesh, randomized, criteria, runs);
+
+			printf("%-10s %5u %9u %9u %12.3f %15u\n",
+				   randomized ? "randomized" : "cube", level,
+				   mesh.quadCount(), mesh.vertexCount(),
+				   elapsed*1000.0, uniformQuads);
+		}
+	}
+
+	printf("\n%-10s %5s %9s %12s %12s %10s\n", "pyramid", "level", "quads",
+		   "first ms", "kept ms", "kept MB");
+	
+	for( int randomized = 0; randomized < 2; ++randomized )
+	{
+		mesh.toCube();
+		if( randomized )
+			mesh.randomize();
+		
+		for( unsigned int level = 1; level <= maxLevel; ++level )
+		{
+			// each level is subdivided from the kept one above it
+			double start = nowSeconds();
+			mesh.showLevel(level);
+			double first = nowSeconds() - start;
+			unsigned int quads = mesh.quadCount();
+			
+			double kept = 0.0;
+			for( int r = 0; r < runs; ++r )
+			{
+				mesh.showLevel(0);
+				start = nowSeconds();
+				mesh.showLevel(level);
+				double elapsed = nowSeconds() - start;
+				if( r == 0 || elapsed < kept )
+					kept = elapsed;
+			}
+			
+			printf("%-10s %5u %9u %12.3f %12.3f %10.2f\n",
+				   randomized ? "randomized" : "cube", level, quads,
+				   first*1000.0, kept*1000.0, mesh.levelBytes()/1048576.0);
+		}
+	}
+	
+	return 0;
+}
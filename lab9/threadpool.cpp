@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#include <unistd.h>
+
+#include "threadpool.h"
+
+// loops shorter than this are run on the calling
+// thread, waking the workers would cost more
+#define MIN_PARALLEL_COUNT 2048
+
+// each thread takes about this many chunks of a loop,
+// so threads that finish early can help the others
+#define CHUNKS_PER_THREAD 8
+
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: _threadCount(1), _generation(0), _startGeneration(0), _active(0), _quit(false),
+	  _task(NULL), _arg(NULL), _count(0), _chunk(1), _next(0)
+{
+	pthread_mutex_init(&_lock, NULL);
+	pthread_cond_init(&_wake, NULL);
+	pthread_cond_init(&_finished, NULL);
+	setThreads(threads);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	stop();
+	pthread_cond_destroy(&_finished);
+	pthread_cond_destroy(&_wake);
+	pthread_mutex_destroy(&_lock);
+}
+
+
+// change the number of threads
+void
+ThreadPool::setThreads(unsigned int threads)
+{
+	if( threads == 0 )
+	{
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = processors > 0 ? (unsigned int)processors : 1;
+	}
+
+	// the workers are restarted on the next big loop
+	stop();
+	_threadCount = threads;
+}
+
+
+// start the worker threads
+void
+ThreadPool::start()
+{
+	_quit = false;
+	_startGeneration = _generation;
+	_workers.resize(_threadCount - 1);
+	for( unsigned int i = 0; i < _workers.size(); ++i )
+	{
+		if( pthread_create(&_workers[i], NULL, workerMain, this) != 0 )
+		{
+			// run with however many did start
+			_workers.resize(i);
+			break;
+		}
+	}
+}
+
+
+// stop the worker threads
+void
+ThreadPool::stop()
+{
+	if( _workers.empty() )
+		return;
+
+	pthread_mutex_lock(&_lock);
+	_quit = true;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_lock);
+
+	for( unsigned int i = 0; i < _workers.size(); ++i )
+		pthread_join(_workers[i], NULL);
+	_workers.clear();
+}
+
+
+// run task over [0, count) spread across the threads
+void
+ThreadPool::parallelFor(unsigned int count, ParallelTask task, void *arg)
+{
+	if( count == 0 )
+		return;
+
+	// not worth splitting up
+	if( _threadCount == 1 || count < MIN_PARALLEL_COUNT )
+	{
+		task(arg, 0, count);
+		return;
+	}
+
+	if( _workers.empty() )
+		start();
+
+	// publish the loop and wake the workers
+	pthread_mutex_lock(&_lock);
+	_task = task;
+	_arg = arg;
+	_count = count;
+	_chunk = count / (_threadCount*CHUNKS_PER_THREAD) + 1;
+	_next = 0;
+	_active = _workers.size();
+	_generation++;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_lock);
+
+	// help out, then wait for the workers to finish
+	work();
+
+	pthread_mutex_lock(&_lock);
+	while( _active > 0 )
+		pthread_cond_wait(&_finished, &_lock);
+	pthread_mutex_unlock(&_lock);
+}
+
+
+// take chunks of the current loop until there are none left
+void
+ThreadPool::work()
+{
+	for( ;; )
+	{
+		unsigned int begin = __sync_fetch_and_add(&_next, _chunk);
+		if( begin >= _count )
+			return;
+
+		unsigned int end = begin + _chunk;
+		if( end > _count )
+			end = _count;
+		_task(_arg, begin, end);
+	}
+}
+
+
+// the body of every worker thread
+void *
+ThreadPool::workerMain(void *arg)
+{
+	ThreadPool *pool = (ThreadPool *)arg;
+	unsigned int seen = pool->_startGeneration;
+
+	pthread_mutex_lock(&pool->_lock);
+	for( ;; )
+	{
+		// wait for a new loop, or to be told to quit
+		while( !pool->_quit && pool->_generation == seen )
+			pthread_cond_wait(&pool->_wake, &pool->_lock);
+		if( pool->_quit )
+			break;
+		seen = pool->_generation;
+		pthread_mutex_unlock(&pool->_lock);
+
+		pool->work();
+
+		pthread_mutex_lock(&pool->_lock);
+		if( --pool->_active == 0 )
+			pthread_cond_signal(&pool->_finished);
+	}
+	pthread_mutex_unlock(&pool->_lock);
+
+	return NULL;
+}
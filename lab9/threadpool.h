@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2009 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University
+ * may not be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Ari Grant
+ *
+*/
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <pthread.h>
+
+// a loop body, called with the range [begin, end) of the loop
+typedef void (*ParallelTask)(void *arg, unsigned int begin, unsigned int end);
+
+// a fixed set of worker threads that split loops between them.
+// the threads are started on the first loop big enough to be
+// worth splitting and wait for work in between loops
+class ThreadPool
+{
+public:
+	// threads is the number of threads to run loops on,
+	// counting the calling thread; 0 means one per processor
+	ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	// change the number of threads, see the constructor
+	void setThreads(unsigned int threads);
+
+	// the number of threads loops are run on
+	unsigned int threads() const { return _threadCount; }
+
+	// run task over [0, count) in chunks spread across the
+	// threads, and return once all of them are done
+	void parallelFor(unsigned int count, ParallelTask task, void *arg);
+
+private:
+	// start and stop the worker threads
+	void start();
+	void stop();
+
+	// take chunks of the current loop until there are none left
+	void work();
+
+	// the body of every worker thread
+	static void *workerMain(void *pool);
+
+
+	// the number of threads, counting the caller
+	unsigned int _threadCount;
+
+	// the worker threads, empty until the first big loop
+	std::vector<pthread_t> _workers;
+
+	// guards everything below; workers wait on _wake for a new
+	// loop, the caller waits on _finished for them to be done
+	pthread_mutex_t _lock;
+	pthread_cond_t _wake;
+	pthread_cond_t _finished;
+
+	// bumped for every loop so workers can tell a new one
+	// started, the loop count when the workers were started,
+	// and the number of workers still in the loop
+	unsigned int _generation;
+	unsigned int _startGeneration;
+	unsigned int _active;
+	bool _quit;
+
+	// the current loop; _next is the start of the
+	// next chunk and is taken with an atomic add
+	ParallelTask _task;
+	void *_arg;
+	unsigned int _count;
+	unsigned int _chunk;
+	unsigned int _next;
+};
+
+#endif /* __THREADPOOL_H__ */
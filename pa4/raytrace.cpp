@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Igor Guskov, Sugih Jamin
+ *
+ */
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+#include "scene.h"
+#include "raytrace.h"
+
+// Leaves of the BVH hold at most this many triangles.
+#define BVH_LEAF_SIZE 4
+
+// Offset of secondary ray origins off the surface, to avoid
+// self-intersection.
+#define RAY_EPSILON 1.0e-4f
+
+double
+now_seconds()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec*1.0e-6;
+}
+
+static inline XVec3f
+xyz(const XVec4f& v)
+{
+  return XVec3f(v(0), v(1), v(2));
+}
+
+static inline XVec3f
+centroid(const Triangle& tri)
+{
+  return (tri.v[0] + tri.v[1] + tri.v[2]) / 3.0f;
+}
+
+Colorf 
+Light::pt(XVec3f const& p, XVec3f const& n, Material const& mat) const
+{
+  double const d = p.dist(o);
+  double const att = 1.0/(T0+T1*d+T2*d*d);
+  XVec3f L = o-p;
+  L.normalize();
+  return (att*max(L.dot(n),0.0f)) * (diff * mat.diff);
+}
+
+/*
+ * Flattening of the X3D scene graph. Each node adds its geometry in
+ * its own coordinates and the ray tracing scene transforms it to
+ * world coordinates with the accumulated model matrix.
+ */
+
+void
+X3GroupingNode::Flatten(const XMat4f& model, int material, 
+                        X3RayScene* rt) const
+{
+  for (int i = 0; i < (int)children_.size(); ++i) {
+    children_[i]->Flatten(model, material, rt);
+  }
+}
+
+void
+X3Scene::Flatten(const XMat4f& model, int material, X3RayScene* rt) const
+{
+  // Evaluate all the interpolators so that we trace the scene
+  // as it is at time_, like Render() would draw it.
+  EvaluateLinks();
+  X3GroupingNode::Flatten(model, material, rt);
+}
+
+void
+X3Transform::Flatten(const XMat4f& model, int material, 
+                     X3RayScene* rt) const
+{
+  X3GroupingNode::Flatten(model * LocalMatrix(), material, rt);
+}
+
+void
+X3Shape::Flatten(const XMat4f& model, int material, X3RayScene* rt) const
+{
+  if (geometry_) {
+    material = rt->AddMaterial(appearance_ ? appearance_->material() : NULL);
+    geometry_->Flatten(model, material, rt);
+  }
+}
+
+void
+X3Box::Flatten(const XMat4f& model, int material, X3RayScene* rt) const
+{
+  XVec3f const h = 0.5f*size_;
+
+  rt->SetTransform(model);
+  // two faces per axis, spanned by the other two axes
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int sign = -1; sign <= 1; sign += 2) {
+      XVec3f n(0.0f, 0.0f, 0.0f), a(0.0f, 0.0f, 0.0f), b(0.0f, 0.0f, 0.0f);
+      n(axis) = (float)sign;
+      a((axis+1)%3) = h((axis+1)%3);
+      b((axis+2)%3) = h((axis+2)%3);
+      XVec3f const o = h(axis)*n;
+      rt->AddTriangle(o-a-b, o+a-b, o+a+b, n, n, n, material);
+      rt->AddTriangle(o-a-b, o+a+b, o-a+b, n, n, n, material);
+    }
+  }
+}
+
+void
+X3Cone::Flatten(const XMat4f& model, int material, X3RayScene* rt) const
+{
+  const int N = 10;
+  const float step = 2.0f * M_PI / N;
+  XVec3f const apex(0.0f, 0.5f*height_, 0.0f);
+  XVec3f const center(0.0f, -0.5f*height_, 0.0f);
+  XVec3f const down(0.0f, -1.0f, 0.0f);
+
+  rt->SetTransform(model);
+  for (int k = 0; k < N; ++k) {
+    XVec3f p0(-bottom_radius_*sin(k*step), -0.5f*height_, 
+              -bottom_radius_*cos(k*step));
+    XVec3f p1(-bottom_radius_*sin((k+1)*step), -0.5f*height_, 
+              -bottom_radius_*cos((k+1)*step));
+    if (side_) {
+      XVec3f n0(-height_*sin(k*step), bottom_radius_, -height_*cos(k*step));
+      XVec3f n1(-height_*sin((k+1)*step), bottom_radius_, 
+                -height_*cos((k+1)*step));
+      n0.normalize();
+      n1.normalize();
+      XVec3f na = n0 + n1;
+      na.normalize();
+      rt->AddTriangle(apex, p0, p1, na, n0, n1, material);
+    }
+    if (bottom_) {
+      rt->AddTriangle(center, p1, p0, down, down, down, material);
+    }
+  }
+}
+
+void
+X3Cylinder::Flatten(const XMat4f& model, int material, 
+                    X3RayScene* rt) const
+{
+  const int N = 20;
+  const float step = 2.0f * M_PI / N;
+  XVec3f const top(0.0f, 0.5f*height_, 0.0f);
+  XVec3f const bottom(0.0f, -0.5f*height_, 0.0f);
+  XVec3f const up(0.0f, 1.0f, 0.0f);
+  XVec3f const down(0.0f, -1.0f, 0.0f);
+
+  rt->SetTransform(model);
+  for (int k = 0; k < N; ++k) {
+    XVec3f n0(-sin(k*step), 0.0f, -cos(k*step));
+    XVec3f n1(-sin((k+1)*step), 0.0f, -cos((k+1)*step));
+    XVec3f t0 = top + radius_*n0, t1 = top + radius_*n1;
+    XVec3f b0 = bottom + radius_*n0, b1 = bottom + radius_*n1;
+    if (top_) {
+      rt->AddTriangle(top, t0, t1, up, up, up, material);
+    }
+    if (bottom_) {
+      rt->AddTriangle(bottom, b1, b0, down, down, down, material);
+    }
+    if (side_) {
+      rt->AddTriangle(t0, b0, b1, n0, n0, n1, material);
+      rt->AddTriangle(t0, b1, t1, n0, n1, n1, material);
+    }
+  }
+}
+
+void
+X3IndexedFaceSet::Flatten(const XMat4f& model, int material, 
+                          X3RayScene* rt) const
+{
+  if (!coordinate_) {
+    return;
+  }
+
+  rt->SetTransform(model);
+  for (int k = 0; k < (int)triangles_.size(); ++k) {
+    XVec3i const& tri = triangles_[k];
+    rt->AddTriangle(coordinate_->point(tri(0)), coordinate_->point(tri(1)),
+                    coordinate_->point(tri(2)), normals_[tri(0)],
+                    normals_[tri(1)], normals_[tri(2)], material);
+  }
+  for (int k = 0; k < (int)quads_.size(); ++k) {
+    XVec4i const& quad = quads_[k];
+    rt->AddTriangle(coordinate_->point(quad(0)), coordinate_->point(quad(1)),
+                    coordinate_->point(quad(2)), normals_[quad(0)],
+                    normals_[quad(1)], normals_[quad(2)], material);
+    rt->AddTriangle(coordinate_->point(quad(0)), coordinate_->point(quad(2)),
+                    coordinate_->point(quad(3)), normals_[quad(0)],
+                    normals_[quad(2)], normals_[quad(3)], material);
+  }
+}
+
+void
+X3PointLight::Flatten(const XMat4f& model, int material, 
+                      X3RayScene* rt) const
+{
+  XVec4f const o = model * XVec4f(location_(0), location_(1), 
+                                  location_(2), 1.0f);
+  Colorf const amb = ambient_intensity() * xyz(color());
+  Colorf const diff = intensity() * xyz(color());
+  rt->AddLight(Light(xyz(o), amb, diff, diff, 
+                     attenuation_(0), attenuation_(1), attenuation_(2)));
+}
+
+/*
+ * The ray tracing scene proper.
+ */
+
+void
+X3RayScene::SetTransform(const XMat4f& model)
+{
+  model_ = model;
+  normal_matrix_ = model.inverse().transpose();
+}
+
+void
+X3RayScene::AddTriangle(const XVec3f& p0, const XVec3f& p1, 
+                        const XVec3f& p2, const XVec3f& n0, 
+                        const XVec3f& n1, const XVec3f& n2, int material)
+{
+  XVec3f const* p[3] = { &p0, &p1, &p2 };
+  XVec3f const* n[3] = { &n0, &n1, &n2 };
+  Triangle tri;
+
+  for (int i = 0; i < 3; ++i) {
+    tri.v[i] = xyz(model_ * XVec4f((*p[i])(0), (*p[i])(1), (*p[i])(2), 1.0f));
+    tri.n[i] = xyz(normal_matrix_ * 
+                   XVec4f((*n[i])(0), (*n[i])(1), (*n[i])(2), 0.0f));
+    tri.n[i].normalize();
+  }
+  tri.material = material;
+  triangles_.push_back(tri);
+}
+
+int
+X3RayScene::AddMaterial(const X3Material* material)
+{
+  map<const X3Material*, int>::iterator mi = material_index_.find(material);
+  if (mi != material_index_.end()) {
+    return mi->second;
+  }
+
+  // Same defaults as X3Material for shapes without a material.
+  X3Material const defaults;
+  X3Material const* m = material ? material : &defaults;
+  Colorf const diff = xyz(m->diffuse_color());
+  materials_.push_back(Material(m->ambient_intensity() * diff, diff,
+                                xyz(m->specular_color()),
+                                128.0f*m->shininess()));
+  material_index_[material] = (int)materials_.size()-1;
+  return (int)materials_.size()-1;
+}
+
+void
+X3RayScene::Build(const X3Scene* scene)
+{
+  double t0 = now_seconds();
+  XMat4f identity;
+
+  triangles_.clear();
+  nodes_.clear();
+  materials_.clear();
+  material_index_.clear();
+  lights_.clear();
+
+  scene->Flatten(identity, -1, this);
+  if (!triangles_.empty()) {
+    nodes_.reserve(2*triangles_.size()/BVH_LEAF_SIZE + 1);
+    BuildNode(0, (int)triangles_.size());
+  }
+  stats_.build_time += now_seconds() - t0;
+}
+
+/* Orders triangles by their centroid along one axis */
+struct CentroidLess {
+  int axis;
+  CentroidLess(int a) : axis(a) {}
+  bool operator()(const Triangle& a, const Triangle& b) const {
+    return centroid(a)(axis) < centroid(b)(axis);
+  }
+};
+
+// Builds the subtree over triangles_[first, first+count) by splitting
+// at the median centroid along the longest axis of the centroid
+// bounds. Returns the index of the subtree's root.
+int
+X3RayScene::BuildNode(int first, int count)
+{
+  XVec3f lo(HUGE_VAL), hi(-HUGE_VAL);
+  XVec3f clo(HUGE_VAL), chi(-HUGE_VAL);
+  for (int i = first; i < first+count; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      triangles_[i].v[k].bbox(lo, hi);
+    }
+    centroid(triangles_[i]).bbox(clo, chi);
+  }
+
+  BVHNode node;
+  node.lo = lo;
+  node.hi = hi;
+  node.right = -1;
+  node.first = first;
+  node.count = count;
+  int const index = (int)nodes_.size();
+  nodes_.push_back(node);
+
+  if (count <= BVH_LEAF_SIZE) {
+    return index;
+  }
+
+  XVec3f const extent = chi - clo;
+  int axis = 0;
+  if (extent(1) > extent(axis)) axis = 1;
+  if (extent(2) > extent(axis)) axis = 2;
+
+  int const half = count/2;
+  nth_element(triangles_.begin()+first, triangles_.begin()+first+half,
+              triangles_.begin()+first+count, CentroidLess(axis));
+
+  BuildNode(first, half);
+  int const right = BuildNode(first+half, count-half);
+  // nodes_ may have been reallocated by the recursion
+  nodes_[index].right = right;
+  nodes_[index].first = first;
+  nodes_[index].count = 0;
+  return index;
+}
+
+// Slab test of the ray against the box, with inv_d = 1/ray.d
+static inline bool
+hits_box(const XVec3f& lo, const XVec3f& hi, const Ray& ray, 
+         const XVec3f& inv_d, float tmin, float tmax)
+{
+  for (int k = 0; k < 3; ++k) {
+    float t0 = (lo(k) - ray.e(k)) * inv_d(k);
+    float t1 = (hi(k) - ray.e(k)) * inv_d(k);
+    if (t0 > t1) {
+      swap(t0, t1);
+    }
+    tmin = max(tmin, t0);
+    tmax = min(tmax, t1);
+    if (tmin > tmax) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Moller-Trumbore ray-triangle intersection
+bool
+X3RayScene::IntersectTriangle(const Triangle& tri, const Ray& ray,
+                              float tmin, float tmax, Hit* hit)
+{
+  XVec3f const e1 = tri.v[1] - tri.v[0];
+  XVec3f const e2 = tri.v[2] - tri.v[0];
+  XVec3f const p = ray.d.cross(e2);
+  float const det = e1.dot(p);
+  if (fabs(det) < 1.0e-12f) {
+    return false; // ray parallel to the triangle
+  }
+  float const inv_det = 1.0f/det;
+
+  XVec3f const s = ray.e - tri.v[0];
+  float const u = s.dot(p) * inv_det;
+  if (u < 0.0f || u > 1.0f) {
+    return false;
+  }
+  XVec3f const q = s.cross(e1);
+  float const v = ray.d.dot(q) * inv_det;
+  if (v < 0.0f || u+v > 1.0f) {
+    return false;
+  }
+  float const t = e2.dot(q) * inv_det;
+  if (t <= tmin || t >= tmax) {
+    return false;
+  }
+
+  hit->t = t;
+  hit->u = u;
+  hit->v = v;
+  return true;
+}
+
+bool
+X3RayScene::Intersect(const Ray& ray, float tmin, float tmax, Hit* hit) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  XVec3f const inv_d(1.0f/ray.d(0), 1.0f/ray.d(1), 1.0f/ray.d(2));
+  int stack[64];
+  int top = 0;
+  bool found = false;
+
+  stack[top++] = 0;
+  while (top > 0) {
+    BVHNode const& node = nodes_[stack[--top]];
+    if (!hits_box(node.lo, node.hi, ray, inv_d, tmin, tmax)) {
+      continue;
+    }
+    if (node.right < 0) {
+      for (int i = node.first; i < node.first+node.count; ++i) {
+        if (IntersectTriangle(triangles_[i], ray, tmin, tmax, hit)) {
+          hit->triangle = i;
+          tmax = hit->t;
+          found = true;
+        }
+      }
+    } else {
+      stack[top++] = node.right;
+      stack[top++] = &node - &nodes_[0] + 1;
+    }
+  }
+  return found;
+}
+
+bool
+X3RayScene::Occluded(const XVec3f& p, const XVec3f& q) const
+{
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  // parameterize the segment so that t=1 is at q
+  Ray const ray(p, q-p);
+  XVec3f const inv_d(1.0f/ray.d(0), 1.0f/ray.d(1), 1.0f/ray.d(2));
+  float const tmin = RAY_EPSILON, tmax = 1.0f - RAY_EPSILON;
+  int stack[64];
+  int top = 0;
+  Hit hit;
+
+  stack[top++] = 0;
+  while (top > 0) {
+    BVHNode const& node = nodes_[stack[--top]];
+    if (!hits_box(node.lo, node.hi, ray, inv_d, tmin, tmax)) {
+      continue;
+    }
+    if (node.right < 0) {
+      for (int i = node.first; i < node.first+node.count; ++i) {
+        if (IntersectTriangle(triangles_[i], ray, tmin, tmax, &hit)) {
+          return true;
+        }
+      }
+    } else {
+      stack[top++] = node.right;
+      stack[top++] = &node - &nodes_[0] + 1;
+    }
+  }
+  return false;
+}
+
+Colorf
+X3RayScene::Trace(const Ray& ray)
+{
+  Hit hit;
+
+  stats_.primary++;
+  if (!Intersect(ray, 0.0f, HUGE_VAL, &hit)) {
+    return background_;
+  }
+
+  Triangle const& tri = triangles_[hit.triangle];
+  Material const& mat = materials_[tri.material];
+  float const w = 1.0f - hit.u - hit.v;
+  XVec3f n = w*tri.n[0] + hit.u*tri.n[1] + hit.v*tri.n[2];
+  n.normalize();
+  // faces are two-sided, as with view3D's lighting
+  if (n.dot(ray.d) > 0.0f) {
+    n = -n;
+  }
+  XVec3f const p = ray.pt(hit.t) + RAY_EPSILON*n;
+
+  Colorf result(0.0f, 0.0f, 0.0f);
+  for (int i = 0; i < (int)lights_.size(); ++i) {
+    result += lights_[i].amb * mat.amb;
+    stats_.shadow++;
+    if (!Occluded(p, lights_[i].o)) {
+      result += lights_[i].pt(p, n, mat);
+    }
+  }
+  return result;
+}
+
+void
+X3RayScene::Render(const X3Viewpoint& viewpoint, int w, int h, Colorf* fb)
+{
+  double t0 = now_seconds();
+
+  // Inverse of the viewing transform set up by X3Viewpoint::Render()
+  XMat4f t, rx, ry;
+  t.translation(XVec3f(0.0f, 0.0f, -viewpoint.zoff()));
+  rx.rotate(XVec4f(1.0f, 0.0f, 0.0f, viewpoint.theta()*M_PI/180.0f));
+  ry.rotate(XVec4f(0.0f, 1.0f, 0.0f, viewpoint.phi()*M_PI/180.0f));
+  XMat4f const view_inverse = (t * rx * ry).inverse();
+  XVec3f const eye = xyz(view_inverse * XVec4f(0.0f, 0.0f, 0.0f, 1.0f));
+
+  // Without lights in the scene, use a headlight like view3D's
+  // default light.
+  bool const headlight = lights_.empty();
+  if (headlight) {
+    lights_.push_back(Light(eye, Colorf(0.0f, 0.0f, 0.0f),
+                            Colorf(1.0f, 1.0f, 1.0f), 
+                            Colorf(1.0f, 1.0f, 1.0f)));
+  }
+
+  float const tan_half = tan(0.5f*45.0f*M_PI/180.0f);
+  float const aspect = float(w)/h;
+  for (int j = 0; j < h; ++j) {
+    for (int i = 0; i < w; ++i) {
+      XVec4f const d_eye((2.0f*(i+0.5f)/w - 1.0f)*aspect*tan_half,
+                         (2.0f*(j+0.5f)/h - 1.0f)*tan_half, -1.0f, 0.0f);
+      Ray const ray(eye, xyz(view_inverse * d_eye));
+      fb[j*w+i] = Trace(ray);
+    }
+  }
+
+  if (headlight) {
+    lights_.clear();
+  }
+  stats_.render_time += now_seconds() - t0;
+}
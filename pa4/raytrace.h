@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Igor Guskov, Sugih Jamin
+ *
+ */
+#ifndef __RAYTRACE_H__
+#define __RAYTRACE_H__
+
+#include <map>
+#include <vector>
+
+#include "xvec.h"
+#include "xmat.h"
+#include "scene.h"
+
+/*
+ * Offline ray tracing backend for X3D scenes.  X3Scene::Flatten()
+ * collects all the geometry, transformed to world space and
+ * tessellated into triangles, together with the point lights, into
+ * an X3RayScene.  The triangles are kept in a bounding volume
+ * hierarchy and shaded with the same diffuse point light model as
+ * the lab ray tracer (Light::pt()), with hard shadows.
+ */
+
+/*! Represents a ray passing through point e with direction d */
+struct Ray {
+  XVec3f e;
+  XVec3f d;
+
+  Ray(XVec3f const& e0, XVec3f const& d0) : e(e0), d(d0) {}
+  XVec3f pt(float t) const { 
+    XVec3f const tempd = t*d;
+    return e+tempd; 
+  }
+};
+
+typedef XVec3f Colorf;
+
+/* Represents a material, like in OpenGL */
+struct Material {
+
+  Colorf amb, diff, spec;
+  double s; // shininess
+
+  Material(Colorf const& a,
+           Colorf const& d,
+           Colorf const& sp,
+           double s0=0) :
+           amb(a), diff(d), spec(sp), s(s0) {}
+};
+
+/* Represents a positional, non-directional, point light-source */
+struct Light {
+
+  XVec3f o; // position
+  Colorf amb, diff, spec; // light components
+  double T0, T1, T2; // attenuation parameters
+  
+  Light(XVec3f const& o0,
+        Colorf const& a,
+        Colorf const& d,
+        Colorf const& s,
+        double const& t0=1,
+        double const& t1=0,
+        double const& t2=0) :
+        o(o0), amb(a), diff(d), spec(s), T0(t0), T1(t1), T2(t2) {}
+  
+  // Color at point p due to this light, given normal and material
+  // At present, performs diffuse calculations only.
+  Colorf pt(XVec3f const& p, XVec3f const& n, Material const& mat) const;
+};
+
+/* A world space triangle with per-vertex normals */
+struct Triangle {
+  XVec3f v[3];
+  XVec3f n[3];
+  int material;
+};
+
+/* Ray-triangle intersection: ray parameter and barycentric coordinates */
+struct Hit {
+  float t;
+  float u, v;
+  int triangle;
+};
+
+/* Ray counts and wall-clock times (in seconds) */
+struct RayStats {
+  unsigned long primary;    // rays from the eye
+  unsigned long shadow;     // rays toward the lights
+  double build_time;        // flattening the scene and building the BVH
+  double render_time;       // tracing the image
+
+  RayStats() { reset(); }
+  void reset() {
+    primary = shadow = 0;
+    build_time = render_time = 0.0;
+  }
+  unsigned long total() const { return primary+shadow; }
+};
+
+// Wall-clock time in seconds
+double now_seconds();
+
+class X3RayScene {
+ public:
+  X3RayScene() : background_(0.0f, 0.0f, 0.4f) {
+  }
+
+  // Flattens the scene at its current time and builds the BVH.
+  void Build(const X3Scene* scene);
+
+  // Render a w x h image as seen from the viewpoint, with the same
+  // 45 degree vertical field of view as view3D. The image is stored
+  // row by row, bottom row first: pixel (i, j) is fb[j*w+i].
+  void Render(const X3Viewpoint& viewpoint, int w, int h, Colorf* fb);
+
+  // Color seen along the given ray.
+  Colorf Trace(const Ray& ray);
+
+  // Closest intersection of the ray within (tmin, tmax).
+  bool Intersect(const Ray& ray, float tmin, float tmax, Hit* hit) const;
+
+  // Is there anything between points p and q? Stops at the first
+  // triangle found, which need not be the closest one.
+  bool Occluded(const XVec3f& p, const XVec3f& q) const;
+
+  // The following are called by the X3Node::Flatten() methods.
+
+  // Sets the model transform for subsequent AddTriangle() calls.
+  void SetTransform(const XMat4f& model);
+  // Adds a triangle given in the current model coordinates.
+  void AddTriangle(const XVec3f& p0, const XVec3f& p1, const XVec3f& p2,
+                   const XVec3f& n0, const XVec3f& n1, const XVec3f& n2,
+                   int material);
+  // Returns the material index for the X3D material, NULL for the
+  // default material.
+  int AddMaterial(const X3Material* material);
+  void AddLight(const Light& light) {
+    lights_.push_back(light);
+  }
+
+  size_t triangle_count() const {
+    return triangles_.size();
+  }
+  size_t light_count() const {
+    return lights_.size();
+  }
+  const RayStats& stats() const {
+    return stats_;
+  }
+
+ private:
+  // Node of the bounding volume hierarchy. The left child of an
+  // interior node immediately follows it, the right child is at
+  // index right. A leaf holds count triangles starting at first.
+  struct BVHNode {
+    XVec3f lo, hi;
+    int right;
+    int first, count;
+  };
+
+  int BuildNode(int first, int count);
+  static bool IntersectTriangle(const Triangle& tri, const Ray& ray,
+                                float tmin, float tmax, Hit* hit);
+
+ private:
+  std::vector<Triangle> triangles_;
+  std::vector<BVHNode> nodes_;
+  std::vector<Material> materials_;
+  std::map<const X3Material*, int> material_index_;
+  std::vector<Light> lights_;
+
+  XMat4f model_;
+  XMat4f normal_matrix_;  // inverse transpose of model_
+  Colorf background_;
+  RayStats stats_;
+};
+
+#endif // __RAYTRACE_H__
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Igor Guskov, Sugih Jamin
+ *
+ */
+#include <algorithm>
+using namespace std;
+
+#ifdef __APPLE__
+#include <GLUT/glut.h>
+#else
+#ifdef _WIN32
+#include <GL/glew.h>
+#endif
+#include <GL/glut.h>
+#endif
+
+#include "scene.h"
+#include "renderqueue.h"
+
+/*
+ * Flattening of the X3D scene graph into the render queue. Grouping
+ * nodes pass the accumulated model matrix on to their children and
+ * shapes add themselves with it. Grouping nodes test their children's
+ * bounds against the frustum and leave out the children outside it.
+ */
+
+void
+X3GroupingNode::Enqueue(const XMat4f& model, X3RenderQueue* queue) const
+{
+  if (!queue->culling()) {
+    for (int i = 0; i < (int)children_.size(); ++i) {
+      children_[i]->Enqueue(model, queue);
+    }
+    return;
+  }
+
+  // The children's bounds are in this node's coordinates, so bring the
+  // frustum into them once rather than every box out to the world.
+  frustum_t frustum = queue->frustum().Transformed(model);
+  for (int i = 0; i < (int)children_.size(); ++i) {
+    bounds_t bounds = children_[i]->Bounds();
+    if (bounds.empty()) {
+      // nothing to draw, e.g. a sensor or an interpolator
+      continue;
+    }
+    switch(frustum.Classify(bounds)) {
+    case frustum_t::OUTSIDE:
+      queue->Cull();
+      break;
+    case frustum_t::INSIDE:
+      // and so is everything below, which need not be tested then
+      queue->set_culling(false);
+      children_[i]->Enqueue(model, queue);
+      queue->set_culling(true);
+      break;
+    default:
+      children_[i]->Enqueue(model, queue);
+      break;
+    }
+  }
+}
+
+void
+X3Transform::Enqueue(const XMat4f& model, X3RenderQueue* queue) const
+{
+  // model is the parent's world matrix, see X3Scene::Render()
+  X3GroupingNode::Enqueue(WorldMatrix(model), queue);
+}
+
+void
+X3Shape::Enqueue(const XMat4f& model, X3RenderQueue* queue) const
+{
+  if (geometry_) {
+    queue->Add(model, appearance_, geometry_);
+  }
+}
+
+/*
+ * Sorting and drawing the queue.
+ */
+
+void
+X3RenderQueue::Add(const XMat4f& model, const X3Appearance* appearance,
+                   const X3GeometryNode* geometry)
+{
+  items_.push_back(draw_item_t(model, appearance, geometry));
+  // A shape without an appearance is drawn recursively with the default
+  // texture and texture transform, but whatever material the shape before
+  // it left, and scenes count on that.
+  if (!appearance && items_.size() > 1) {
+    items_.back().material_ = items_[items_.size()-2].material_;
+  }
+}
+
+// Orders the opaque items by their state, most expensive change first,
+// and keeps the blended ones behind them in the order they came in.
+static bool
+state_less(const draw_item_t& a, const draw_item_t& b)
+{
+  if (a.blended_!=b.blended_) {
+    return b.blended_;
+  }
+  if (a.blended_) {
+    return false;
+  }
+  if (a.texture_!=b.texture_) {
+    return a.texture_ < b.texture_;
+  }
+  if (a.material_!=b.material_) {
+    return a.material_ < b.material_;
+  }
+  if (a.texture_transform_!=b.texture_transform_) {
+    return a.texture_transform_ < b.texture_transform_;
+  }
+  return a.geometry_ < b.geometry_;
+}
+
+int
+X3RenderQueue::CountStateChanges() const
+{
+  int changes = 0;
+  for (int i = 0; i < (int)items_.size(); ++i) {
+    const draw_item_t& item = items_[i];
+    if (i==0) {
+      changes += 3;
+      continue;
+    }
+    const draw_item_t& last = items_[i-1];
+    changes += (item.texture_!=last.texture_)
+      + (item.material_!=last.material_)
+      + (item.texture_transform_!=last.texture_transform_);
+  }
+  return changes;
+}
+
+void
+X3RenderQueue::Sort()
+{
+  scene_order_changes_ = CountStateChanges();
+  stable_sort(items_.begin(), items_.end(), state_less);
+  state_changes_ = CountStateChanges();
+}
+
+void
+X3RenderQueue::Render()
+{
+  XMat4f view;
+  glGetFloatv(GL_MODELVIEW_MATRIX, view);
+
+  for (int i = 0; i < (int)items_.size(); ++i) {
+    const draw_item_t& item = items_[i];
+    const draw_item_t* last = i > 0 ? &items_[i-1] : NULL;
+
+    if (!last || item.texture_!=last->texture_) {
+      if (item.texture_) {
+        item.texture_->Render();
+      } else {
+        X3ImageTexture::DefaultRender();
+      }
+    }
+    if (!last || item.material_!=last->material_) {
+      if (item.material_) {
+        item.material_->Render();
+      } else {
+        X3Material::DefaultRender();
+      }
+    }
+    if (!last || item.texture_transform_!=last->texture_transform_) {
+      if (item.texture_transform_) {
+        item.texture_transform_->Render();
+      } else {
+        X3TextureTransform::DefaultRender();
+      }
+      // which leaves the texture matrix current
+      glMatrixMode(GL_MODELVIEW);
+    }
+
+    glLoadMatrixf(view * item.model_);
+    item.geometry_->Render();
+  }
+
+  glLoadMatrixf(view);
+}
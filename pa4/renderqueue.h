@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Igor Guskov, Sugih Jamin
+ *
+ */
+#ifndef __RENDERQUEUE_H__
+#define __RENDERQUEUE_H__
+
+#include <vector>
+
+#include "xvec.h"
+#include "xmat.h"
+#include "scene.h"
+
+/*
+ * Render queue for X3D scenes.  X3Scene::Render() flattens the scene
+ * graph into a list of draw items with X3Node::Enqueue(), each a
+ * geometry node with its appearance and world matrix, skipping the
+ * subtrees whose bounds are outside the view frustum.  The items are
+ * then sorted so that shapes sharing a texture and material are drawn
+ * one after the other, and drawn in one loop that only changes the
+ * texture, material, and texture transform when they differ from the
+ * previous item's.
+ */
+
+struct draw_item_t {
+draw_item_t(const XMat4f& model, const X3Appearance* appearance,
+            const X3GeometryNode* geometry)
+: model_(model), geometry_(geometry), material_(NULL), texture_(NULL),
+  texture_transform_(NULL), blended_(false) {
+  if (appearance) {
+    material_ = appearance->material();
+    texture_ = appearance->texture();
+    texture_transform_ = appearance->texture_transform();
+    blended_ = texture_ && texture_->has_alpha();
+  }
+}
+  XMat4f model_;
+  const X3GeometryNode* geometry_;
+  // NULL stands for the default of each.
+  const X3Material* material_;
+  const X3ImageTexture* texture_;
+  const X3TextureTransform* texture_transform_;
+  bool blended_; // texture is alpha blended, so is drawn in scene order
+};
+
+class X3RenderQueue {
+ public:
+  X3RenderQueue()
+    : culling_(true), culled_count_(0),
+      scene_order_changes_(0), state_changes_(0) {
+  }
+
+  // Empties the queue for a frame whose shapes outside the given frustum,
+  // in world coordinates, are to be left out.
+  void Clear(const frustum_t& frustum) {
+    items_.clear();
+    frustum_ = frustum;
+    culling_ = true;
+    culled_count_ = 0;
+  }
+
+  // The following are called by the X3Node::Enqueue() methods.
+
+  const frustum_t& frustum() const {
+    return frustum_;
+  }
+  // Whether the nodes being added need to be tested against the frustum,
+  // false inside a subtree known to be entirely in it.
+  bool culling() const {
+    return culling_;
+  }
+  void set_culling(bool culling) {
+    culling_ = culling;
+  }
+  // Counts a subtree left out.
+  void Cull() {
+    ++culled_count_;
+  }
+  // Adds a shape, in scene order.
+  void Add(const XMat4f& model, const X3Appearance* appearance,
+           const X3GeometryNode* geometry);
+
+  // Sorts the items by texture, then material, then texture transform.
+  // Blended items go last, in the order they were added.
+  void Sort();
+
+  // Draws the items, each with its world matrix loaded on top of the
+  // viewing transform currently on the modelview stack.
+  void Render();
+
+  // Statistics of the last frame: the number of draws, and the number of
+  // times the texture, material, or texture transform was changed. Drawing
+  // the shapes recursively applies all three for every draw.
+  int draw_count() const {
+    return (int)items_.size();
+  }
+  int culled_count() const {
+    return culled_count_;
+  }
+  int scene_order_changes() const {
+    return scene_order_changes_;
+  }
+  int state_changes() const {
+    return state_changes_;
+  }
+ private:
+  // The number of state changes needed to draw the items in their current
+  // order.
+  int CountStateChanges() const;
+ private:
+  std::vector<draw_item_t> items_;
+  frustum_t frustum_;
+  bool culling_;
+  int culled_count_; // subtrees left out
+  int scene_order_changes_; // what the items would need unsorted
+  int state_changes_;
+};
+
+#endif // __RENDERQUEUE_H__
@@ -24,6 +24,12 @@
 #include <sstream>
 using namespace std;
 
+// the buffer functions are part of OpenGL 1.5, but
+// linux headers only declare them when asked to
+#if !defined(__APPLE__) && !defined(_WIN32)
+#define GL_GLEXT_PROTOTYPES
+#endif
+
 #ifdef __APPLE__
 #include <GLUT/glut.h>
 #else
@@ -38,6 +44,7 @@ using namespace std;
 
 #include "image.h"
 #include "scene.h"
+#include "renderqueue.h"
 
 static inline void
 erase_char(string& s, char ch)
@@ -51,6 +58,80 @@ erase_char(string& s, char ch)
   return;
 }
 
+bounds_t
+bounds_t::Transformed(const XMat4f& m) const
+{
+  bounds_t result;
+  if (empty()) {
+    return result;
+  }
+  for (int corner = 0; corner < 8; ++corner) {
+    XVec4f p(corner & 1 ? hi_(0) : lo_(0),
+             corner & 2 ? hi_(1) : lo_(1),
+             corner & 4 ? hi_(2) : lo_(2), 1.0f);
+    XVec4f q = m * p;
+    result.Include(XVec3f(q(0), q(1), q(2)));
+  }
+  return result;
+}
+
+frustum_t::frustum_t()
+{
+  for (int i = 0; i < 6; ++i) {
+    planes_[i] = XVec4f(0.0f, 0.0f, 0.0f, 0.0f);
+  }
+}
+
+frustum_t::frustum_t(const XMat4f& clip)
+{
+  // A point is inside if -w <= x, y, z <= w in clip coordinates, i.e.
+  // if w+x, w-x, w+y, w-y, w+z, and w-z are all non-negative.
+  XVec4f w = clip.row(3);
+  for (int i = 0; i < 3; ++i) {
+    planes_[2*i] = w + clip.row(i);
+    planes_[2*i+1] = w - clip.row(i);
+  }
+}
+
+frustum_t
+frustum_t::Transformed(const XMat4f& model) const
+{
+  // p . (model * x) = (p * model) . x
+  frustum_t result;
+  for (int i = 0; i < 6; ++i) {
+    for (int j = 0; j < 4; ++j) {
+      result.planes_[i](j) = planes_[i].dot(model.column(j));
+    }
+  }
+  return result;
+}
+
+int
+frustum_t::Classify(const bounds_t& bounds) const
+{
+  if (bounds.empty()) {
+    return OUTSIDE;
+  }
+  XVec3f center = 0.5f*(bounds.lo_ + bounds.hi_);
+  XVec3f half = 0.5f*(bounds.hi_ - bounds.lo_);
+  int result = INSIDE;
+  for (int i = 0; i < 6; ++i) {
+    const XVec4f& p = planes_[i];
+    // distance of the center and the largest distance of a corner from
+    // it, both scaled by the length of the plane normal
+    float d = p(0)*center(0) + p(1)*center(1) + p(2)*center(2) + p(3);
+    float r = fabsf(p(0))*half(0) + fabsf(p(1))*half(1)
+      + fabsf(p(2))*half(2);
+    if (d + r < 0.0f) {
+      return OUTSIDE;
+    }
+    if (d - r < 0.0f) {
+      result = INTERSECTING;
+    }
+  }
+  return result;
+}
+
 void
 X3Appearance::Add(X3NodeType type, X3Node* node)
 {
@@ -111,7 +192,8 @@ X3Appearance::Print(std::ostream& ost, int offset) const
   return;
 }
 
-X3Box::X3Box(const char **atts) : size_(2.0f, 2.0f, 2.0f)
+X3Box::X3Box(const char **atts)
+  : size_(2.0f, 2.0f, 2.0f), tessellation_(NULL)
 {
   if (atts==0) {
     return;
@@ -133,72 +215,17 @@ X3Box::X3Box(const char **atts) : size_(2.0f, 2.0f, 2.0f)
 void
 X3Box::Render() const
 {
-  glBegin(GL_QUADS);
-  glNormal3f(0.0f, 0.0f, 1.0f);
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-        
-  glNormal3f(0.0f, 0.0f, -1.0f);
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-        
-  glNormal3f(1.0f, 0.0f, 0.0f);
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-        
-  glNormal3f(-1.0f, 0.0f, 0.0f);
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-        
-  glNormal3f(0.0f, 1.0f, 0.0f);
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0),  0.5f*size_(1),  0.5f*size_(2));
-        
-  glNormal3f(0.0f, -1.0f, 0.0f);
-  glTexCoord2f(0.0f, 1.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-  glTexCoord2f(0.0f, 0.0f);
-  glVertex3f(-0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 0.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1), -0.5f*size_(2));
-  glTexCoord2f(1.0f, 1.0f);
-  glVertex3f( 0.5f*size_(0), -0.5f*size_(1),  0.5f*size_(2));
-  glEnd();
+  tessellation_key_t key(X3NODE_BOX, size_(0), size_(1), size_(2), 0, 0);
+  if (!tessellation_ || !(tessellation_->key()==key)) {
+    X3Tessellation::Acquire(key, &tessellation_);
+  }
+  tessellation_->Render();
 }
 
 X3Cone::X3Cone(const char** atts) 
   : bottom_(true), side_(true),
-    height_(2.0f), bottom_radius_(1.0f) 
+    height_(2.0f), bottom_radius_(1.0f),
+    tessellation_(NULL)
 {
   if (atts==0) {
     return;
@@ -230,37 +257,15 @@ X3Cone::X3Cone(const char** atts)
 void
 X3Cone::Render() const
 {
-  const int N = 10;
-  const float step = 2.0f * M_PI / N;
-  const float step_tex = 1.0f / N;
-
-  if (side_) {
-    glBegin(GL_QUAD_STRIP);
-    for (int k = 0; k < N+1; ++k) {
-      //glNormal3f(-sin(k*step), bottom_radius_ / height_, -cos(k*step));
-      glNormal3f(cos(k*step), bottom_radius_ / height_, sin(k*step));
-      glTexCoord2f(k*step_tex, 1.0f);
-      glVertex3f(0.0f, 0.5f*height_, 0.0f);
-      glTexCoord2f(k*step_tex, 0.0f);
-      glVertex3f(-bottom_radius_*sin(k*step), -0.5f*height_, 
-                 -bottom_radius_*cos(k*step));
-    }
-    glEnd();
-  }
-
-  if (bottom_) {
-    glFrontFace(GL_CW);
-    glBegin(GL_TRIANGLE_FAN);
-    glNormal3f(0.0f, -1.0f, 0.0f);
-    glTexCoord2f(0.5, 0.5f);
-    glVertex3f(0.0f, -0.5f*height_, 0.0f);
-    for (int k = 0; k < N+1; ++k) {
-      glTexCoord2f(0.5f - 0.5f * sin(k*step), 0.5f - 0.5f * cos(k*step));
-      glVertex3f(-bottom_radius_*sin(k*step), -0.5f*height_, -bottom_radius_*cos(k*step));
-    }
-    glEnd();
-    glFrontFace(GL_CCW);
+  // bottom_radius_ may be animated, in which case the cone trades its
+  // tessellation in for the one with the new radius.
+  tessellation_key_t key(X3NODE_CONE, bottom_radius_, height_, 0.0f, 10,
+                         (side_ ? X3Tessellation::PART_SIDE : 0)
+                         | (bottom_ ? X3Tessellation::PART_BOTTOM : 0));
+  if (!tessellation_ || !(tessellation_->key()==key)) {
+    X3Tessellation::Acquire(key, &tessellation_);
   }
+  tessellation_->Render();
 }
 
 void*
@@ -326,6 +331,18 @@ X3Curve::Add(X3NodeType type, X3Node* node)
 {
   if (type==X3NODE_POSITIONINTERPOLATOR) {
     position_interpolator_ = reinterpret_cast<X3PositionInterpolator*>(node);
+    // The interpolator is not animated, so neither are the bounds.
+    bounds_ = bounds_t();
+    float t = position_interpolator_->start_key();
+    float tend = position_interpolator_->end_key();
+    float step = (tend-t)/steps_;
+    for (int k=0; k<steps_+1; ++k) {
+      XVec3f pt;
+      position_interpolator_->Evaluate(t, &pt);
+      bounds_.Include(pt);
+      t += step;
+    }
+    InvalidateBounds();
   } else {
     X3Node::Add(type, node);
   }
@@ -337,6 +354,9 @@ X3Curve::Render() const
   if (position_interpolator_==NULL) {
     return;
   }
+  // Restore lighting and color afterwards, since the render queue may
+  // draw a shape with the same appearance next.
+  glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
   glDisable(GL_LIGHTING);
   glColor3f(1.0f, 0.2f, 0.2f);
   float t = position_interpolator_->start_key();
@@ -350,12 +370,13 @@ X3Curve::Render() const
     t += step;
   }
   glEnd();
-  glEnable(GL_LIGHTING);
+  glPopAttrib();
 }
 
 X3Cylinder::X3Cylinder(const char** atts) 
   : top_(true), bottom_(true), side_(true),
-    height_(2.0f), radius_(1.0f) 
+    height_(2.0f), radius_(1.0f),
+    tessellation_(NULL)
 {
   if (atts==0) {
     return;
@@ -395,75 +416,67 @@ X3Cylinder::X3Cylinder(const char** atts)
 void
 X3Cylinder::Render() const
 {
-  /* YOUR CODE HERE TASK 2
-   *
-   * Specify texture coordinates to enable textured cylinders.  The
-   * texture coordinates assignments MUST follow the X3D spec, "When a
-   * texture is applied to a cylinder, it is applied differently to
-   * the sides, top, and bottom. On the sides, the texture wraps
-   * counterclockwise (from above) starting at the back of the
-   * cylinder. The texture has a vertical seam at the back,
-   * intersecting the X=0 plane. For the top and bottom caps, a circle
-   * is cut out of the unit texture squares centred at (0, +-height/2,
-   * 0) with dimensions 2*radius by 2*radius. The top texture
-   * appears right side up when the top of the cylinder is tilted
-   * toward the +Z-axis, and the bottom texture appears right side up
-   * when the top of the cylinder is tilted toward the -Z-axis."
-   * (http://www.web3d.org/documents/specifications/19775-1/V3.2/Part01/components/geometry3D.html#Cylinder)
-   * You may want to consult X3Box::Render() and X3Cone::Render()
-   * to see how the texture image is oriented vis-a-vis the object.
-   */
-  const int N = 20;
-  const float step = 2.0f * M_PI / N;
-  const float step_tex = 1.0f / N;
+  tessellation_key_t key(X3NODE_CYLINDER, radius_, height_, 0.0f, 20,
+                         (side_ ? X3Tessellation::PART_SIDE : 0)
+                         | (top_ ? X3Tessellation::PART_TOP : 0)
+                         | (bottom_ ? X3Tessellation::PART_BOTTOM : 0));
+  if (!tessellation_ || !(tessellation_->key()==key)) {
+    X3Tessellation::Acquire(key, &tessellation_);
+  }
+  tessellation_->Render();
+}
 
-  if (top_) {
-    glBegin(GL_TRIANGLE_FAN);
-    glNormal3f(0.0f, 1.0f, 0.0f);
-    glTexCoord2f(0.5f, 0.5f);
-    glVertex3f(0.0f, 0.5f*height_, 0.0f);
-    for (int k = 0; k < N+1; ++k) {
-      glTexCoord2f(0.5f - 0.5f * sin(k*step), 0.5f + 0.5f * cos(k*step));
-      glVertex3f(-radius_*sin(k*step), 0.5f*height_, -radius_*cos(k*step));
-    }
-    glEnd();
+void
+X3GroupingNode::Print(std::ostream& ost, int offset) const
+{
+  ost << std::string(offset, ' ') << "{" << std::endl;
+  for (int i = 0; i < (int)children_.size(); ++i) {
+    children_[i]->Print(ost, offset+2);
   }
-        
-  if (bottom_) {
-    glFrontFace(GL_CW);
-    glBegin(GL_TRIANGLE_FAN);
-    glNormal3f(0.0f, -1.0f, 0.0f);
-    glTexCoord2f(0.5f, 0.5f);
-    glVertex3f(0.0f, -0.5f*height_, 0.0f);
-    for (int k = 0; k < N+1; ++k) {
-      glTexCoord2f(0.5f - 0.5f * sin(k*step), 0.5f - 0.5f * cos(k*step));
-      glVertex3f(-radius_*sin(k*step), -0.5f*height_, -radius_*cos(k*step));
+  ost << std::string(offset, ' ') << "}" << std::endl;
+}
+
+bounds_t
+X3GroupingNode::Bounds() const
+{
+  if (!bounds_valid_) {
+    bounds_ = bounds_t();
+    for (int i = 0; i < (int)children_.size(); ++i) {
+      bounds_.Include(children_[i]->Bounds());
     }
-    glEnd();
-    glFrontFace(GL_CCW);
+    bounds_valid_ = true;
   }
-        
-  if (side_) {
-    glBegin(GL_QUAD_STRIP);
-    for (int k = 0; k < N+1; ++k) {
-      glNormal3f(-sin(k*step), 0.0f, -cos(k*step));
-      glTexCoord2f(k*step_tex, 1.0f);
-      glVertex3f(-radius_*sin(k*step), 0.5f*height_, -radius_*cos(k*step));
-      glTexCoord2f(k*step_tex, 0.0f);
-      glVertex3f(-radius_*sin(k*step), -0.5f*height_, -radius_*cos(k*step));
+  return bounds_;
+}
+
+void
+X3GroupingNode::InvalidateBounds()
+{
+  // If the bounds are not valid, neither are the parents', since they
+  // were invalidated along with these or have not been computed yet.
+  if (bounds_valid_) {
+    bounds_valid_ = false;
+    X3Node::InvalidateBounds();
+  }
+}
+
+void
+X3GroupingNode::MarkShared()
+{
+  if (!shared_) {
+    shared_ = true;
+    for (int i = 0; i < (int)children_.size(); ++i) {
+      children_[i]->MarkShared();
     }
-    glEnd();
   }
 }
 
 void
-X3GroupingNode::Print(std::ostream& ost, int offset) const
+X3GroupingNode::InvalidateWorld()
 {
-  ost << std::string(offset, ' ') << "{" << std::endl;
   for (int i = 0; i < (int)children_.size(); ++i) {
-    children_[i]->Print(ost, offset+2);
+    children_[i]->InvalidateWorld();
   }
-  ost << std::string(offset, ' ') << "}" << std::endl;
 }
 
 void
@@ -627,7 +640,9 @@ X3ImageTexture::SetupTexture(const Image* image)
 }
 
 X3IndexedFaceSet::X3IndexedFaceSet(const char** atts) 
-  : coordinate_(NULL), texture_coordinate_(NULL)
+  : coordinate_(NULL), texture_coordinate_(NULL),
+    buffers_dirty_(false), vertex_buffer_(0), index_buffer_(0),
+    index_count_(0)
 {
   std::vector<int> coord_index;
   std::vector<int> tex_coord_index;
@@ -710,75 +725,156 @@ X3IndexedFaceSet::X3IndexedFaceSet(const char** atts)
   }
 }
 
+X3IndexedFaceSet::~X3IndexedFaceSet()
+{
+  // The buffers only exist once the face set has been rendered, so there is
+  // no need for a GL context here otherwise.
+  if (vertex_buffer_) {
+    glDeleteBuffers(1, &vertex_buffer_);
+    glDeleteBuffers(1, &index_buffer_);
+  }
+}
+
 void
-X3IndexedFaceSet::Render() const
+X3IndexedFaceSet::BuildVertexArrays()
 {
+  vertices_.clear();
+  indices_.clear();
   if (!coordinate_) {
     return;
   }
-        
-  if (!texture_coordinate_) {
-    // If texture_coordinate==NULL no need to specify texture coordinates.
-        
-    glBegin(GL_TRIANGLES);
-    for (int k = 0; k < (int)triangles_.size(); ++k) {
-      glNormal3fv(normals_[triangles_[k](0)]);
-      glVertex3fv(coordinate_->point(triangles_[k](0)));
-      glNormal3fv(normals_[triangles_[k](1)]);
-      glVertex3fv(coordinate_->point(triangles_[k](1)));
-      glNormal3fv(normals_[triangles_[k](2)]);
-      glVertex3fv(coordinate_->point(triangles_[k](2)));
-    }
-    glEnd();
-    glBegin(GL_QUADS);
-    for (int k = 0; k < (int)quads_.size(); ++k) {
-      glNormal3fv(normals_[quads_[k](0)]);
-      glVertex3fv(coordinate_->point(quads_[k](0)));
-      glNormal3fv(normals_[quads_[k](1)]);
-      glVertex3fv(coordinate_->point(quads_[k](1)));
-      glNormal3fv(normals_[quads_[k](2)]);
-      glVertex3fv(coordinate_->point(quads_[k](2)));
-      glNormal3fv(normals_[quads_[k](3)]);
-      glVertex3fv(coordinate_->point(quads_[k](3)));
-    }
-    glEnd();
 
-  } else {
+  // Texture coordinates are looked up by the texCoordIndex faces if there
+  // are as many of them as faces, otherwise by the coordIndex faces.
+  bool textured = texture_coordinate_ != NULL;
+  bool tex_faces = textured && tex_triangles_.size()==triangles_.size()
+    && tex_quads_.size()==quads_.size();
+
+  // Corners that share both indices share a vertex. The vertices made from
+  // each coordinate are chained through next_vertex, starting at
+  // first_vertex[coordinate], since a coordinate seldom has more than a
+  // couple of texture coordinates.
+  std::vector<int> first_vertex(coordinate_->size(), -1);
+  std::vector<int> next_vertex;
+  std::vector<int> vertex_tex;
+  std::vector<int> face(4), tex_face(4);
+  int ntriangles = (int)triangles_.size();
+
+  for (int k = 0; k < ntriangles + (int)quads_.size(); ++k) {
+    int corners = k < ntriangles ? 3 : 4;
+    for (int c = 0; c < corners; ++c) {
+      if (k < ntriangles) {
+        face[c] = triangles_[k](c);
+        tex_face[c] = tex_faces ? tex_triangles_[k](c) : face[c];
+      } else {
+        face[c] = quads_[k-ntriangles](c);
+        tex_face[c] = tex_faces ? tex_quads_[k-ntriangles](c) : face[c];
+      }
+      if (!textured) {
+        tex_face[c] = 0;
+      }
 
-    glBegin(GL_TRIANGLES);
-    for(int k = 0; k < (int)triangles_.size(); ++k) {
-      glNormal3fv(normals_[triangles_[k](0)]);
-      //if( tex_triangles_.empty() == false ) {
-      glTexCoord2fv(texture_coordinate_->point(tex_triangles_[k](0)));
-      glVertex3fv(coordinate_->point(triangles_[k](0)));
-      glNormal3fv(normals_[triangles_[k](1)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_triangles_[k](1)));
-      glVertex3fv(coordinate_->point(triangles_[k](1)));
-      glNormal3fv(normals_[triangles_[k](2)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_triangles_[k](2)));
-      glVertex3fv(coordinate_->point(triangles_[k](2)));
-      //}
+      int v = first_vertex[face[c]];
+      while (v >= 0 && vertex_tex[v]!=tex_face[c]) {
+        v = next_vertex[v];
+      }
+      if (v < 0) {
+        v = (int)next_vertex.size();
+        next_vertex.push_back(first_vertex[face[c]]);
+        vertex_tex.push_back(tex_face[c]);
+        first_vertex[face[c]] = v;
+
+        const XVec3f& point = coordinate_->point(face[c]);
+        const XVec3f& normal = normals_[face[c]];
+        XVec2f st(0.0f, 0.0f);
+        if (textured) {
+          st = texture_coordinate_->point(tex_face[c]);
+        }
+        vertices_.push_back(point(0));
+        vertices_.push_back(point(1));
+        vertices_.push_back(point(2));
+        vertices_.push_back(normal(0));
+        vertices_.push_back(normal(1));
+        vertices_.push_back(normal(2));
+        vertices_.push_back(st(0));
+        vertices_.push_back(st(1));
+      }
+      face[c] = v;
     }
-    glEnd();
-    glBegin(GL_QUADS);
-    for(int k = 0; k < (int)quads_.size(); ++k) {
-      //if( tex_quads_.empty() == false ) {
-      glNormal3fv(normals_[quads_[k](0)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_quads_[k](0)));
-      glVertex3fv(coordinate_->point(quads_[k](0)));
-      glNormal3fv(normals_[quads_[k](1)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_quads_[k](1)));
-      glVertex3fv(coordinate_->point(quads_[k](1)));
-      glNormal3fv(normals_[quads_[k](2)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_quads_[k](2)));
-      glVertex3fv(coordinate_->point(quads_[k](2)));
-      glNormal3fv(normals_[quads_[k](3)]);
-      glTexCoord2fv(texture_coordinate_->point(tex_quads_[k](3)));
-      glVertex3fv(coordinate_->point(quads_[k](3)));
-      //}
+
+    // a quad becomes the triangles 0 1 2 and 0 2 3, both wound as the quad
+    indices_.push_back(face[0]);
+    indices_.push_back(face[1]);
+    indices_.push_back(face[2]);
+    if (corners==4) {
+      indices_.push_back(face[0]);
+      indices_.push_back(face[2]);
+      indices_.push_back(face[3]);
     }
-    glEnd();
   }
+
+  buffers_dirty_ = true;
+}
+
+void
+X3IndexedFaceSet::UploadBuffers() const
+{
+  if (vertex_buffer_==0) {
+    glGenBuffers(1, &vertex_buffer_);
+    glGenBuffers(1, &index_buffer_);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, vertices_.size()*sizeof(float),
+               vertices_.empty() ? NULL : &vertices_[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int),
+               indices_.empty() ? NULL : &indices_[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  index_count_ = (int)indices_.size();
+
+  // the buffers hold the only copy we need from now on
+  std::vector<float>().swap(vertices_);
+  std::vector<unsigned int>().swap(indices_);
+  buffers_dirty_ = false;
+}
+
+void
+X3IndexedFaceSet::Render() const
+{
+  if (!coordinate_) {
+    return;
+  }
+  if (buffers_dirty_) {
+    UploadBuffers();
+  }
+  if (index_count_==0) {
+    return;
+  }
+
+  // The vertex attributes are interleaved, so each pointer is an offset
+  // into the buffer with the stride of a whole vertex. If
+  // texture_coordinate_==NULL no need to specify texture coordinates.
+  const GLsizei stride = VERTEX_FLOATS*sizeof(float);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (char*)NULL);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, stride, (char*)NULL + 3*sizeof(float));
+  if (texture_coordinate_) {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, stride, (char*)NULL + 6*sizeof(float));
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glDrawElements(GL_TRIANGLES, index_count_, GL_UNSIGNED_INT, NULL);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 }
 
 void
@@ -819,9 +915,17 @@ X3IndexedFaceSet::Add(X3NodeType type, X3Node* node)
     for (int i = 0; i < (int)normals_.size(); ++i) {
       normals_[i].normalize();
     }
-                
+
+    bounds_ = bounds_t();
+    for (int i = 0; i < (int)coordinate_->size(); ++i) {
+      bounds_.Include(coordinate_->point(i));
+    }
+    InvalidateBounds();
+
+    BuildVertexArrays();
   } else if (type==X3NODE_TEXTURECOORDINATE) {
     texture_coordinate_ = reinterpret_cast<X3TextureCoordinate*>(node);
+    BuildVertexArrays();
   } else {
     X3Node::Add(type, node);
   }
@@ -966,6 +1070,24 @@ X3PointLight::SetupLights(int* light_count) const
   X3LightNode::SetupLights(light_count);
 }
 
+X3Scene::X3Scene()
+  : use_render_queue_(true), use_culling_(true)
+{
+  viewpoint_ = new X3Viewpoint;
+  render_queue_ = new X3RenderQueue;
+}
+
+X3Scene::~X3Scene()
+{
+  std::cout << "Scene will delete "
+            << registered_nodes_.size() << " nodes." << std::endl;
+  for(std::vector<X3Node*>::iterator ni = registered_nodes_.begin();
+      ni != registered_nodes_.end(); ++ni) {
+    delete *ni;
+  }
+  delete render_queue_;
+}
+
 void
 X3Scene::Add(X3NodeType type, X3Node* node)
 {
@@ -985,7 +1107,7 @@ X3Scene::AddLink(X3InterpolatorNode* src_node, X3Timer* timer_node,
   void* dest_field = dest_node->GetFieldPointer(dest_field_name, 
                                                 src_node->ValueTypeId());
   if (dest_field) {
-    links_.push_back(link_t(timer_node, src_node, dest_field));
+    links_.push_back(link_t(timer_node, src_node, dest_node, dest_field));
     return true;
   }
   return false;
@@ -993,20 +1115,43 @@ X3Scene::AddLink(X3InterpolatorNode* src_node, X3Timer* timer_node,
 
 // Look inside this function to see how interpolators are called and used.
 void
-X3Scene::Render() const
+X3Scene::EvaluateLinks() const
 {
-  // First of all:
-  // Evaluate all the interpolators and assign linked fields.
   for (int i=0; i<(int)links_.size(); ++i) {
     links_[i].interpolator_->Evaluate(links_[i].timer_->ConvertTime(time_), 
                                       links_[i].field_);
+    links_[i].node_->FieldChanged();
   }
+}
+
+void
+X3Scene::Render() const
+{
+  // First of all:
+  // Evaluate all the interpolators and assign linked fields.
+  EvaluateLinks();
   // Setup viewing transform
   if (viewpoint_) {
     viewpoint_->Render();
   }
-  // Render all the children now.
-  X3GroupingNode::Render();
+  // Render all the children now, either by collecting them into the
+  // render queue and drawing that, or recursively. The queue leaves
+  // out the subtrees outside the view frustum.
+  if (use_render_queue_) {
+    frustum_t frustum;
+    if (use_culling_) {
+      XMat4f projection, view;
+      glGetFloatv(GL_PROJECTION_MATRIX, projection);
+      glGetFloatv(GL_MODELVIEW_MATRIX, view);
+      frustum = frustum_t(projection * view);
+    }
+    render_queue_->Clear(frustum);
+    X3GroupingNode::Enqueue(XMat4f(), render_queue_);
+    render_queue_->Sort();
+    render_queue_->Render();
+  } else {
+    X3GroupingNode::Render();
+  }
 }
 
 void
@@ -1047,6 +1192,8 @@ X3Shape::Add(X3NodeType type, X3Node* node)
       || type==X3NODE_CONE || type==X3NODE_INDEXEDFACESET
       || type==X3NODE_CURVE) {
     geometry_ = reinterpret_cast<X3GeometryNode*>(node);
+    geometry_->AddParent(this);
+    InvalidateBounds();
   } else if (type==X3NODE_APPEARANCE) {
     appearance_ = reinterpret_cast<X3Appearance*>(node);
   } else {
@@ -1054,6 +1201,15 @@ X3Shape::Add(X3NodeType type, X3Node* node)
   }
 }
 
+bounds_t
+X3Shape::Bounds() const
+{
+  if (geometry_) {
+    return geometry_->Bounds();
+  }
+  return bounds_t();
+}
+
 void
 X3Shape::Render() const
 {
@@ -1068,6 +1224,311 @@ X3Shape::Render() const
   }
 }
 
+bool
+tessellation_key_t::operator<(const tessellation_key_t& other) const
+{
+  if (type_!=other.type_) {
+    return type_ < other.type_;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (size_(i)!=other.size_(i)) {
+      return size_(i) < other.size_(i);
+    }
+  }
+  if (slices_!=other.slices_) {
+    return slices_ < other.slices_;
+  }
+  return parts_ < other.parts_;
+}
+
+bool
+tessellation_key_t::operator==(const tessellation_key_t& other) const
+{
+  return type_==other.type_ && size_(0)==other.size_(0)
+    && size_(1)==other.size_(1) && size_(2)==other.size_(2)
+    && slices_==other.slices_ && parts_==other.parts_;
+}
+
+std::map<tessellation_key_t, X3Tessellation*> X3Tessellation::cache_;
+
+void
+X3Tessellation::Acquire(const tessellation_key_t& key,
+                        X3Tessellation** tessellation)
+{
+  Release(tessellation);
+  std::map<tessellation_key_t, X3Tessellation*>::iterator ti
+    = cache_.find(key);
+  if (ti==cache_.end()) {
+    ti = cache_.insert(std::make_pair(key, new X3Tessellation(key))).first;
+  }
+  *tessellation = ti->second;
+  ++(*tessellation)->references_;
+}
+
+void
+X3Tessellation::Release(X3Tessellation** tessellation)
+{
+  if (*tessellation==NULL) {
+    return;
+  }
+  if (--(*tessellation)->references_==0) {
+    cache_.erase((*tessellation)->key_);
+    delete *tessellation;
+  }
+  *tessellation = NULL;
+}
+
+X3Tessellation::X3Tessellation(const tessellation_key_t& key)
+  : key_(key), references_(0), vertex_buffer_(0), index_buffer_(0),
+    index_count_(0)
+{
+  switch(key_.type_) {
+  case X3NODE_BOX:
+    TessellateBox();
+    break;
+  case X3NODE_CYLINDER:
+    TessellateCylinder();
+    break;
+  case X3NODE_CONE:
+    TessellateCone();
+    break;
+  default:
+    break;
+  }
+
+  glGenBuffers(1, &vertex_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, vertices_.size()*sizeof(float),
+               vertices_.empty() ? NULL : &vertices_[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glGenBuffers(1, &index_buffer_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_.size()*sizeof(unsigned int),
+               indices_.empty() ? NULL : &indices_[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  index_count_ = (int)indices_.size();
+
+  // the buffers hold the only copy we need from now on
+  std::vector<float>().swap(vertices_);
+  std::vector<unsigned int>().swap(indices_);
+}
+
+X3Tessellation::~X3Tessellation()
+{
+  glDeleteBuffers(1, &vertex_buffer_);
+  glDeleteBuffers(1, &index_buffer_);
+}
+
+int
+X3Tessellation::AddVertex(const XVec3f& position, const XVec3f& normal,
+                          const XVec2f& tex_coord)
+{
+  vertices_.push_back(position(0));
+  vertices_.push_back(position(1));
+  vertices_.push_back(position(2));
+  vertices_.push_back(normal(0));
+  vertices_.push_back(normal(1));
+  vertices_.push_back(normal(2));
+  vertices_.push_back(tex_coord(0));
+  vertices_.push_back(tex_coord(1));
+  return (int)vertices_.size()/VERTEX_FLOATS - 1;
+}
+
+void
+X3Tessellation::AddTriangle(int v0, int v1, int v2)
+{
+  indices_.push_back(v0);
+  indices_.push_back(v1);
+  indices_.push_back(v2);
+}
+
+void
+X3Tessellation::AddFan(int center, int first, int count, bool ccw)
+{
+  for (int k = first; k < first+count-1; ++k) {
+    if (ccw) {
+      AddTriangle(center, k, k+1);
+    } else {
+      AddTriangle(center, k+1, k);
+    }
+  }
+}
+
+void
+X3Tessellation::AddStrip(int first, int count)
+{
+  for (int k = first; k < first+count-2; k += 2) {
+    AddTriangle(k, k+1, k+3);
+    AddTriangle(k, k+3, k+2);
+  }
+}
+
+void
+X3Tessellation::TessellateBox()
+{
+  // Each face lists its normal, then the corners of the unit cube and
+  // their texture coordinates counterclockwise.
+  static const float faces[6][3+4*5] = {
+    { 0, 0, 1,   1, 1, 1, 1, 1,  -1, 1, 1, 0, 1,
+                -1,-1, 1, 0, 0,   1,-1, 1, 1, 0 },
+    { 0, 0,-1,   1,-1,-1, 0, 0,  -1,-1,-1, 1, 0,
+                -1, 1,-1, 1, 1,   1, 1,-1, 0, 1 },
+    { 1, 0, 0,   1, 1, 1, 0, 1,   1,-1, 1, 0, 0,
+                 1,-1,-1, 1, 0,   1, 1,-1, 1, 1 },
+    {-1, 0, 0,  -1, 1,-1, 0, 1,  -1,-1,-1, 0, 0,
+                -1,-1, 1, 1, 0,  -1, 1, 1, 1, 1 },
+    { 0, 1, 0,   1, 1, 1, 1, 0,   1, 1,-1, 1, 1,
+                -1, 1,-1, 0, 1,  -1, 1, 1, 0, 0 },
+    { 0,-1, 0,  -1,-1, 1, 0, 1,  -1,-1,-1, 0, 0,
+                 1,-1,-1, 1, 0,   1,-1, 1, 1, 1 },
+  };
+  const XVec3f& size = key_.size_;
+
+  for (int f = 0; f < 6; ++f) {
+    XVec3f normal(faces[f][0], faces[f][1], faces[f][2]);
+    int first = 0;
+    for (int c = 0; c < 4; ++c) {
+      const float* corner = &faces[f][3+5*c];
+      int v = AddVertex(XVec3f(0.5f*size(0)*corner[0],
+                               0.5f*size(1)*corner[1],
+                               0.5f*size(2)*corner[2]),
+                        normal, XVec2f(corner[3], corner[4]));
+      if (c==0) {
+        first = v;
+      }
+    }
+    AddTriangle(first, first+1, first+2);
+    AddTriangle(first, first+2, first+3);
+  }
+}
+
+void
+X3Tessellation::TessellateCylinder()
+{
+  /* YOUR CODE HERE TASK 2
+   *
+   * Specify texture coordinates to enable textured cylinders.  The
+   * texture coordinates assignments MUST follow the X3D spec, "When a
+   * texture is applied to a cylinder, it is applied differently to
+   * the sides, top, and bottom. On the sides, the texture wraps
+   * counterclockwise (from above) starting at the back of the
+   * cylinder. The texture has a vertical seam at the back,
+   * intersecting the X=0 plane. For the top and bottom caps, a circle
+   * is cut out of the unit texture squares centred at (0, +-height/2,
+   * 0) with dimensions 2*radius by 2*radius. The top texture
+   * appears right side up when the top of the cylinder is tilted
+   * toward the +Z-axis, and the bottom texture appears right side up
+   * when the top of the cylinder is tilted toward the -Z-axis."
+   * (http://www.web3d.org/documents/specifications/19775-1/V3.2/Part01/components/geometry3D.html#Cylinder)
+   * You may want to consult TessellateBox() and TessellateCone()
+   * to see how the texture image is oriented vis-a-vis the object.
+   */
+  const int N = key_.slices_;
+  const float radius = key_.size_(0);
+  const float height = key_.size_(1);
+  const float step = 2.0f * M_PI / N;
+  const float step_tex = 1.0f / N;
+
+  if (key_.parts_ & PART_TOP) {
+    XVec3f normal(0.0f, 1.0f, 0.0f);
+    int center = AddVertex(XVec3f(0.0f, 0.5f*height, 0.0f), normal,
+                           XVec2f(0.5f, 0.5f));
+    for (int k = 0; k < N+1; ++k) {
+      AddVertex(XVec3f(-radius*sin(k*step), 0.5f*height, -radius*cos(k*step)),
+                normal,
+                XVec2f(0.5f - 0.5f * sin(k*step), 0.5f + 0.5f * cos(k*step)));
+    }
+    AddFan(center, center+1, N+1, true);
+  }
+
+  if (key_.parts_ & PART_BOTTOM) {
+    XVec3f normal(0.0f, -1.0f, 0.0f);
+    int center = AddVertex(XVec3f(0.0f, -0.5f*height, 0.0f), normal,
+                           XVec2f(0.5f, 0.5f));
+    for (int k = 0; k < N+1; ++k) {
+      AddVertex(XVec3f(-radius*sin(k*step), -0.5f*height, -radius*cos(k*step)),
+                normal,
+                XVec2f(0.5f - 0.5f * sin(k*step), 0.5f - 0.5f * cos(k*step)));
+    }
+    AddFan(center, center+1, N+1, false);
+  }
+
+  if (key_.parts_ & PART_SIDE) {
+    int first = (int)vertices_.size()/VERTEX_FLOATS;
+    for (int k = 0; k < N+1; ++k) {
+      XVec3f normal(-sin(k*step), 0.0f, -cos(k*step));
+      AddVertex(XVec3f(-radius*sin(k*step), 0.5f*height, -radius*cos(k*step)),
+                normal, XVec2f(k*step_tex, 1.0f));
+      AddVertex(XVec3f(-radius*sin(k*step), -0.5f*height, -radius*cos(k*step)),
+                normal, XVec2f(k*step_tex, 0.0f));
+    }
+    AddStrip(first, 2*(N+1));
+  }
+}
+
+void
+X3Tessellation::TessellateCone()
+{
+  const int N = key_.slices_;
+  const float bottom_radius = key_.size_(0);
+  const float height = key_.size_(1);
+  const float step = 2.0f * M_PI / N;
+  const float step_tex = 1.0f / N;
+
+  if (key_.parts_ & PART_SIDE) {
+    int first = (int)vertices_.size()/VERTEX_FLOATS;
+    for (int k = 0; k < N+1; ++k) {
+      //XVec3f normal(-sin(k*step), bottom_radius / height, -cos(k*step));
+      XVec3f normal(cos(k*step), bottom_radius / height, sin(k*step));
+      AddVertex(XVec3f(0.0f, 0.5f*height, 0.0f), normal,
+                XVec2f(k*step_tex, 1.0f));
+      AddVertex(XVec3f(-bottom_radius*sin(k*step), -0.5f*height,
+                       -bottom_radius*cos(k*step)),
+                normal, XVec2f(k*step_tex, 0.0f));
+    }
+    AddStrip(first, 2*(N+1));
+  }
+
+  if (key_.parts_ & PART_BOTTOM) {
+    XVec3f normal(0.0f, -1.0f, 0.0f);
+    int center = AddVertex(XVec3f(0.0f, -0.5f*height, 0.0f), normal,
+                           XVec2f(0.5f, 0.5f));
+    for (int k = 0; k < N+1; ++k) {
+      AddVertex(XVec3f(-bottom_radius*sin(k*step), -0.5f*height,
+                       -bottom_radius*cos(k*step)),
+                normal,
+                XVec2f(0.5f - 0.5f * sin(k*step), 0.5f - 0.5f * cos(k*step)));
+    }
+    AddFan(center, center+1, N+1, false);
+  }
+}
+
+void
+X3Tessellation::Render() const
+{
+  if (index_count_==0) {
+    return;
+  }
+
+  const GLsizei stride = VERTEX_FLOATS*sizeof(float);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (char*)NULL);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glNormalPointer(GL_FLOAT, stride, (char*)NULL + 3*sizeof(float));
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, stride, (char*)NULL + 6*sizeof(float));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+  glDrawElements(GL_TRIANGLES, index_count_, GL_UNSIGNED_INT, NULL);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
 X3TextureCoordinate::X3TextureCoordinate(const char** atts)
 {
   if (atts==0) {
@@ -1179,7 +1640,9 @@ X3Transform::X3Transform(const char** atts)
   : translation_(0.0f, 0.0f, 0.0f),
     rotation_(1.0f, 0.0f, 0.0f, 0.0f),
     scale_(1.0f, 1.0f, 1.0f),
-    center_(0.0f, 0.0f, 0.0f)
+    center_(0.0f, 0.0f, 0.0f),
+    local_valid_(false),
+    world_valid_(false)
 {
   if (atts==0) {
     return;
@@ -1204,18 +1667,67 @@ X3Transform::X3Transform(const char** atts)
   }
 }
 
+const XMat4f&
+X3Transform::LocalMatrix() const
+{
+  if (!local_valid_) {
+    XMat4f t, c, r, s, minus_c;
+    XVec3f axis = rotation_.axis;
+    axis.normalize();
+    t.translation(translation_);
+    c.translation(center_);
+    r.rotate(XVec4f(axis(0), axis(1), axis(2), rotation_.angle_rad));
+    s.scale(scale_);
+    minus_c.translation(-center_);
+    local_matrix_ = t * c * r * s * minus_c;
+    local_valid_ = true;
+  }
+  return local_matrix_;
+}
+
+const XMat4f&
+X3Transform::WorldMatrix(const XMat4f& parent_world) const
+{
+  if (!world_valid_) {
+    world_matrix_ = parent_world * LocalMatrix();
+    world_valid_ = !shared();
+  }
+  return world_matrix_;
+}
+
+void
+X3Transform::InvalidateWorld()
+{
+  // If the matrix is not valid, neither are the ones below, since they
+  // were invalidated along with it or have not been computed since.
+  if (world_valid_) {
+    world_valid_ = false;
+    X3GroupingNode::InvalidateWorld();
+  }
+}
+
+void
+X3Transform::FieldChanged()
+{
+  local_valid_ = false;
+  InvalidateWorld();
+  // The children's bounds stay the same, only the parents' change.
+  X3Node::InvalidateBounds();
+}
+
+bounds_t
+X3Transform::Bounds() const
+{
+  return X3GroupingNode::Bounds().Transformed(LocalMatrix());
+}
+
 void
 X3Transform::Render() const
 {
   // setup transforms
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
-  glTranslatef(translation_(0), translation_(1), translation_(2));
-  glTranslatef(center_(0), center_(1), center_(2));
-  glRotatef(rotation_.angle_rad * 180.0 / M_PI, 
-            rotation_.axis(0), rotation_.axis(1), rotation_.axis(2));
-  glScalef(scale_(0), scale_(1), scale_(2));
-  glTranslatef(-center_(0), -center_(1), -center_(2));
+  glMultMatrixf(LocalMatrix());
   // then render the group
   X3GroupingNode::Render();
   // then pop the state
@@ -1228,12 +1740,7 @@ X3Transform::SetupLights(int* light_count) const
 {
   glMatrixMode(GL_MODELVIEW);
   glPushMatrix();
-  glTranslatef(translation_(0), translation_(1), translation_(2));
-  glTranslatef(center_(0), center_(1), center_(2));
-  glRotatef(rotation_.angle_rad * 180.0 / M_PI, 
-            rotation_.axis(0), rotation_.axis(1), rotation_.axis(2));
-  glScalef(scale_(0), scale_(1), scale_(2));
-  glTranslatef(-center_(0), -center_(1), -center_(2));
+  glMultMatrixf(LocalMatrix());
   // then render the group
   X3GroupingNode::SetupLights(light_count);
   // then pop the state
@@ -23,13 +23,18 @@
 #include <stdlib.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <map>
 #include <vector>
 #include <string>
 #include <iostream>
 
 #include "xvec.h"
+#include "xmat.h"
 #include "image.h"
 
+class X3RayScene;
+class X3RenderQueue;
+
 enum X3NodeType {
   X3NODE_UNKNOWN = -1,
   X3NODE_X3D,
@@ -65,6 +70,53 @@ enum X3ValueType {
   X3VALUE_ROTATION,
 };
 
+// An axis-aligned bounding box. The default box, with lo_ above hi_, is
+// empty.
+struct bounds_t {
+bounds_t() : lo_(HUGE_VAL), hi_(-HUGE_VAL) {
+}
+bounds_t(const XVec3f& lo, const XVec3f& hi) : lo_(lo), hi_(hi) {
+}
+  bool empty() const {
+    return lo_(0) > hi_(0);
+  }
+  void Include(const XVec3f& p) {
+    p.bbox(lo_, hi_);
+  }
+  void Include(const bounds_t& other) {
+    if (!other.empty()) {
+      Include(other.lo_);
+      Include(other.hi_);
+    }
+  }
+  // The box around this box transformed by m.
+  bounds_t Transformed(const XMat4f& m) const;
+
+  XVec3f lo_, hi_;
+};
+
+// The six planes of a view frustum, each given as (a, b, c, d) with
+// ax + by + cz + d >= 0 on the inside.
+struct frustum_t {
+  enum {
+    OUTSIDE,
+    INTERSECTING,
+    INSIDE,
+  };
+  // The default frustum contains everything.
+  frustum_t();
+  // The frustum of the given projection * modelview matrix, in the
+  // coordinates that the modelview matrix takes to eye coordinates.
+  explicit frustum_t(const XMat4f& clip);
+  // The same frustum in the coordinates that model takes to these.
+  frustum_t Transformed(const XMat4f& model) const;
+  // Whether the box lies outside, across, or inside the frustum. An empty
+  // box is outside.
+  int Classify(const bounds_t& bounds) const;
+
+  XVec4f planes_[6];
+};
+
 // Base class for all the X3D nodes class hierarchy.
 class X3Node {
  public:
@@ -99,6 +151,53 @@ class X3Node {
   // and no light setup.
   virtual void SetupLights(int* light_count) const {
   }
+  // Nor anything to ray trace. Otherwise, the node adds its geometry
+  // and lights, transformed by model, to the ray tracer's scene, using
+  // the given material index (see raytrace.h) for the geometry.
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const {
+  }
+  // Likewise, the node adds the shapes it draws, with their world
+  // matrices, to the render queue (see renderqueue.h).
+  virtual void Enqueue(const XMat4f& model, X3RenderQueue* queue) const {
+  }
+
+  // The box around what the node draws, in the coordinates of its parent.
+  // Nodes that draw nothing are empty.
+  virtual bounds_t Bounds() const {
+    return bounds_t();
+  }
+  // Called when the node's bounds may have changed, e.g. when an animation
+  // link writes one of its fields. Nodes that cache bounds drop them, and
+  // every node passes the call on to its parents.
+  virtual void InvalidateBounds() {
+    for (int i = 0; i < (int)parents_.size(); ++i) {
+      parents_[i]->InvalidateBounds();
+    }
+  }
+  // Called by the parent node when the node is added to it. A node that is
+  // USEd in several places has several parents.
+  void AddParent(X3Node* parent) {
+    parents_.push_back(parent);
+    if (parents_.size() == 2) {
+      MarkShared();
+    }
+  }
+  // Called when the node or one above it gets a second parent, so that
+  // there is more than one path to it from the root. Grouping nodes pass
+  // the call on to their children.
+  virtual void MarkShared() {
+  }
+  // Called when a transform above the node changes. Nodes that cache
+  // their matrix to the scene's coordinates drop it, and grouping nodes
+  // pass the call on to their children.
+  virtual void InvalidateWorld() {
+  }
+  // Called after an animation link has written one of the fields that the
+  // node exposes with GetFieldPointer().
+  virtual void FieldChanged() {
+    InvalidateBounds();
+  }
 
   // Any class may expose its internal fields so that the links can be
   // established between interpolator node outputs and this field.
@@ -110,6 +209,8 @@ class X3Node {
                                 X3ValueType value_type_id) {
     return NULL;
   }
+ private:
+  std::vector<X3Node*> parents_;
 };
 
 class X3GeometryNode : public X3Node {
@@ -129,6 +230,22 @@ class X3Material : public X3Node {
   virtual void Print(std::ostream& ost, int offset) const;
   virtual void Render() const;
   static void DefaultRender();
+
+  float ambient_intensity() const {
+    return ambient_intensity_;
+  }
+  const XVec4f& diffuse_color() const {
+    return diffuse_color_;
+  }
+  const XVec4f& emissive_color() const {
+    return emissive_color_;
+  }
+  float shininess() const {
+    return shininess_;
+  }
+  const XVec4f& specular_color() const {
+    return specular_color_;
+  }
  private:
   float ambient_intensity_;
   XVec4f diffuse_color_;
@@ -154,6 +271,11 @@ class X3ImageTexture : public X3Node {
 
   // This static function is called when no texture is provided.
   static void DefaultRender();
+
+  // True if Render() turns on alpha blending.
+  bool has_alpha() const {
+    return texture_handle_!=0 && image_!=NULL && image_->hasAlpha();
+  }
  private:
   // This function loads an image from a file.
   Image* LoadImage(const std::string& filename);
@@ -205,6 +327,16 @@ class X3Appearance : public X3Node {
   virtual void Print(std::ostream& ost, int offset) const;
   virtual void Render() const;
   static void DefaultRender();
+
+  const X3Material* material() const {
+    return material_;
+  }
+  const X3ImageTexture* texture() const {
+    return texture_;
+  }
+  const X3TextureTransform* texture_transform() const {
+    return texture_transform_;
+  }
  private:
   X3Material* material_;
   X3ImageTexture* texture_;
@@ -213,10 +345,17 @@ class X3Appearance : public X3Node {
 
 class X3GroupingNode: public X3Node {
  public:
+  X3GroupingNode() : bounds_valid_(false), shared_(false) {
+  }
   virtual ~X3GroupingNode() {
   }
   virtual void Add(X3NodeType type, X3Node* node) {
     children_.push_back(node);
+    node->AddParent(this);
+    if (shared_) {
+      node->MarkShared();
+    }
+    InvalidateBounds();
   }
   virtual const char* Name() const {
     return "GroupingNode";
@@ -224,8 +363,25 @@ class X3GroupingNode: public X3Node {
   virtual void Print(std::ostream& ost, int offset) const;
   virtual void Render() const;
   virtual void SetupLights(int* light_count) const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual void Enqueue(const XMat4f& model, X3RenderQueue* queue) const;
+
+  // The union of the children's bounds, kept until a child's bounds change.
+  virtual bounds_t Bounds() const;
+  virtual void InvalidateBounds();
+  virtual void MarkShared();
+  virtual void InvalidateWorld();
+ protected:
+  // Whether the node may be reached by more than one path from the root.
+  bool shared() const {
+    return shared_;
+  }
  private:
   std::vector<X3Node*> children_;
+  mutable bounds_t bounds_;
+  mutable bool bounds_valid_;
+  bool shared_;
 };
 
 struct rotation_t {
@@ -378,27 +534,20 @@ class X3InterpolatorNode : public X3Node {
 // this structure that links together three pieces of data:
 // timer, interpolator and the pointer to the field to be updated.
 struct link_t {
-link_t(X3Timer* timer, X3InterpolatorNode* interpolator, void* field) 
-: timer_(timer), interpolator_(interpolator), field_(field) {
+link_t(X3Timer* timer, X3InterpolatorNode* interpolator, X3Node* node,
+       void* field) 
+: timer_(timer), interpolator_(interpolator), node_(node), field_(field) {
 }
   X3Timer* timer_;
   X3InterpolatorNode* interpolator_;
+  X3Node* node_; // the node that field_ belongs to
   void* field_;
 };
 
 class X3Scene: public X3GroupingNode {
  public:
-  X3Scene() {
-    viewpoint_ = new X3Viewpoint;
-  }
-  virtual ~X3Scene() {
-    std::cout << "Scene will delete "
-              << registered_nodes_.size() << " nodes." << std::endl;
-    for(std::vector<X3Node*>::iterator ni = registered_nodes_.begin();
-        ni != registered_nodes_.end(); ++ni) {
-      delete *ni;
-    }
-  }
+  X3Scene();
+  virtual ~X3Scene();
   virtual void Add(X3NodeType type, X3Node* node);
   virtual const char* Name() const {
     return "Scene";
@@ -406,6 +555,8 @@ class X3Scene: public X3GroupingNode {
   virtual void Print(std::ostream& ost, int offset) const;
   virtual void Render() const;
   virtual void SetupLights(int* light_count) const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
 
   X3Viewpoint* viewpoint() {
     return viewpoint_;
@@ -415,6 +566,27 @@ class X3Scene: public X3GroupingNode {
     time_ = time;
   }
 
+  // Render() draws the scene through the render queue unless this is
+  // turned off, in which case the nodes draw themselves recursively.
+  bool use_render_queue() const {
+    return use_render_queue_;
+  }
+  void set_use_render_queue(bool use_render_queue) {
+    use_render_queue_ = use_render_queue;
+  }
+  // The queue of the last frame drawn, for its statistics.
+  const X3RenderQueue* render_queue() const {
+    return render_queue_;
+  }
+
+  // Turns frustum culling of the render queue on or off.
+  bool use_culling() const {
+    return use_culling_;
+  }
+  void set_use_culling(bool use_culling) {
+    use_culling_ = use_culling;
+  }
+
   // A new function that links together three components of an animation link
   // the timer node that provides time, the interpolator node that produces a 
   // value, and a destination field of some node.
@@ -427,12 +599,19 @@ class X3Scene: public X3GroupingNode {
     registered_nodes_.push_back(node);
   }
  private:
+  // Evaluates all the interpolators at time_ and assigns the linked fields.
+  void EvaluateLinks() const;
+
   X3Viewpoint* viewpoint_;
 
   float time_; // current time of the scene. this is being set externally.
 
   std::vector<link_t> links_; // All the valid animation links.
   std::vector<X3Node*> registered_nodes_;
+
+  bool use_render_queue_;
+  bool use_culling_;
+  X3RenderQueue* render_queue_; // refilled by every Render()
 };
 
 class X3Group: public X3GroupingNode {
@@ -462,15 +641,35 @@ class X3Transform: public X3GroupingNode {
   }
   virtual void Render() const;
   virtual void SetupLights(int* light_count) const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual void Enqueue(const XMat4f& model, X3RenderQueue* queue) const;
+  // The children's bounds, transformed like the children.
+  virtual bounds_t Bounds() const;
+  virtual void InvalidateWorld();
 
   // See this function for example of setting up animated fields.
   virtual void* GetFieldPointer(const std::string& field_name, 
                                 X3ValueType value_type_id);
+  virtual void FieldChanged();
+ private:
+  // The matrix that Render() multiplies onto the modelview matrix:
+  // T * C * R * S * -C, kept until one of the fields changes.
+  const XMat4f& LocalMatrix() const;
+  // The matrix from this node's coordinates to the scene's, given the one
+  // for its parent's, kept until this or a transform above changes. It is
+  // not kept for a shared node, which has one for every path to it.
+  const XMat4f& WorldMatrix(const XMat4f& parent_world) const;
  private:
   XVec3f translation_;
   rotation_t rotation_;
   XVec3f scale_;
   XVec3f center_;
+
+  mutable XMat4f local_matrix_;
+  mutable bool local_valid_;
+  mutable XMat4f world_matrix_;
+  mutable bool world_valid_;
 };
 
 class X3Shape: public X3Node {
@@ -485,15 +684,99 @@ class X3Shape: public X3Node {
   virtual void Print(std::ostream& ost, int offset) const;
   virtual void Add(X3NodeType type, X3Node* node);
   virtual void Render() const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual void Enqueue(const XMat4f& model, X3RenderQueue* queue) const;
+  virtual bounds_t Bounds() const;
  private:
   X3GeometryNode* geometry_;
   X3Appearance* appearance_;
 };
 
+// The parameters that determine a procedural primitive's geometry. Nodes
+// whose keys compare equal draw from the same tessellation.
+struct tessellation_key_t {
+tessellation_key_t(X3NodeType type, float x, float y, float z,
+                   int slices, int parts)
+: type_(type), size_(x, y, z), slices_(slices), parts_(parts) {
+}
+  bool operator<(const tessellation_key_t& other) const;
+  bool operator==(const tessellation_key_t& other) const;
+
+  X3NodeType type_;
+  XVec3f size_;  // box size, or radius, height, and 0 for cylinder and cone
+  int slices_;   // number of sides around a cylinder or cone
+  int parts_;    // which of the side, top, and bottom are drawn
+};
+
+// A Box, Cylinder, or Cone tessellated into triangles, kept in vertex and
+// index buffers shared by every node with the same parameters. The
+// buffers are interleaved like those of X3IndexedFaceSet.
+//
+// Nodes hold a reference to their tessellation, and trade it in when
+// their parameters change, e.g. when an animation link writes a field.
+// The last reference to go deletes the tessellation, so animated fields
+// do not leave a trail of unused buffers behind.
+class X3Tessellation {
+ public:
+  enum {
+    PART_SIDE = 1,
+    PART_TOP = 2,
+    PART_BOTTOM = 4,
+  };
+
+  // Makes *tessellation refer to the tessellation for key, building it if
+  // no other node has the same parameters. Needs a GL context.
+  static void Acquire(const tessellation_key_t& key,
+                      X3Tessellation** tessellation);
+  // Drops the reference held in *tessellation.
+  static void Release(X3Tessellation** tessellation);
+
+  // Draws the tessellation with one glDrawElements call.
+  void Render() const;
+
+  const tessellation_key_t& key() const {
+    return key_;
+  }
+ private:
+  X3Tessellation(const tessellation_key_t& key);
+  ~X3Tessellation();
+
+  void TessellateBox();
+  void TessellateCylinder();
+  void TessellateCone();
+
+  // Appends a vertex and returns its index.
+  int AddVertex(const XVec3f& position, const XVec3f& normal,
+                const XVec2f& tex_coord);
+  void AddTriangle(int v0, int v1, int v2);
+  // Adds the triangles of a fan around center over the ring of vertices
+  // first, first+1, ..., first+count-1. The fan is wound counterclockwise
+  // if ccw is true, otherwise clockwise.
+  void AddFan(int center, int first, int count, bool ccw);
+  // Adds the triangles of a strip whose vertices alternate between the two
+  // sides, first being on the side that the strip is wound from, as for
+  // GL_QUAD_STRIP.
+  void AddStrip(int first, int count);
+ private:
+  static const int VERTEX_FLOATS = 8;
+
+  tessellation_key_t key_;
+  int references_;
+  std::vector<float> vertices_;
+  std::vector<unsigned int> indices_;
+  unsigned int vertex_buffer_;
+  unsigned int index_buffer_;
+  int index_count_;
+
+  static std::map<tessellation_key_t, X3Tessellation*> cache_;
+};
+
 class X3Box: public X3GeometryNode {
  public:
   X3Box(const char **atts = 0);
   virtual ~X3Box() {
+    X3Tessellation::Release(&tessellation_);
   }
   virtual const char* Name() const {
     return "Box";
@@ -503,38 +786,60 @@ class X3Box: public X3GeometryNode {
     ost << ": size=( " << size_ << ")" << std::endl;
   }
   virtual void Render() const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual bounds_t Bounds() const {
+    return bounds_t(-0.5f*size_, 0.5f*size_);
+  }
  private:
   XVec3f size_;
+  mutable X3Tessellation* tessellation_;
 };
 
 class X3Cylinder: public X3GeometryNode {
  public:
   X3Cylinder(const char** atts = 0);
   virtual ~X3Cylinder() {
+    X3Tessellation::Release(&tessellation_);
   }
   virtual const char* Name() const {
     return "Cylinder";
   }
   virtual void Render() const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual bounds_t Bounds() const {
+    return bounds_t(XVec3f(-radius_, -0.5f*height_, -radius_),
+                    XVec3f(radius_, 0.5f*height_, radius_));
+  }
  private:
   bool top_, bottom_, side_;
   float height_, radius_;
+  mutable X3Tessellation* tessellation_;
 };
 
 class X3Cone: public X3GeometryNode {
  public:
   X3Cone(const char** atts = 0);
   virtual ~X3Cone() {
+    X3Tessellation::Release(&tessellation_);
   }
   virtual const char* Name() const {
     return "Cone";
   }
   virtual void Render() const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual bounds_t Bounds() const {
+    return bounds_t(XVec3f(-bottom_radius_, -0.5f*height_, -bottom_radius_),
+                    XVec3f(bottom_radius_, 0.5f*height_, bottom_radius_));
+  }
   virtual void* GetFieldPointer(const std::string& field_name, 
                                 X3ValueType value_type_id);
  private:
   bool bottom_, side_;
   float height_, bottom_radius_;
+  mutable X3Tessellation* tessellation_;
 };
 
 class X3Coordinate: public X3Node {
@@ -578,13 +883,26 @@ class X3TextureCoordinate: public X3Node {
 class X3IndexedFaceSet: public X3GeometryNode {
  public:
   X3IndexedFaceSet(const char** atts = 0);
-  virtual ~X3IndexedFaceSet() {
-  }
+  virtual ~X3IndexedFaceSet();
   virtual const char* Name() const {
     return "IndexedFaceSet";
   }
+  // Draws the faces with one glDrawElements call from the buffer objects.
   virtual void Render() const;
   virtual void Add(X3NodeType type, X3Node* node);
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
+  virtual bounds_t Bounds() const {
+    return bounds_;
+  }
+ private:
+  // Interleaves a position, normal, and texture coordinate for every
+  // distinct (coordinate, texture coordinate) index pair used by the faces,
+  // and lists the triangles, with quads split in two, that index them.
+  void BuildVertexArrays();
+  // Copies the vertex arrays into buffer objects, creating them first if
+  // need be. The client-side copies are released afterwards.
+  void UploadBuffers() const;
  private:
   X3Coordinate* coordinate_;
   X3TextureCoordinate* texture_coordinate_; // texture coords read in from a 
@@ -594,12 +912,24 @@ class X3IndexedFaceSet: public X3GeometryNode {
   std::vector<XVec4i> quads_;
   std::vector<XVec3f> normals_; // We always compute normals ourselves
                                 // when coords are added.
+  bounds_t bounds_; // and the bounds
 
   // The following two fields store indices of texture coordinates
   // If these are empty you need to use the indices of vertices to look into
   // the texture_coordinate_ values.
   std::vector<XVec3i> tex_triangles_;
   std::vector<XVec4i> tex_quads_;
+
+  // Vertex and index arrays waiting to be uploaded, rebuilt whenever the
+  // coordinates or texture coordinates are added. Each vertex is
+  // VERTEX_FLOATS floats: position, normal, then texture coordinate.
+  static const int VERTEX_FLOATS = 8;
+  mutable std::vector<float> vertices_;
+  mutable std::vector<unsigned int> indices_;
+  mutable bool buffers_dirty_;
+  mutable unsigned int vertex_buffer_;
+  mutable unsigned int index_buffer_;
+  mutable int index_count_;
 };
 
 // Light nodes.
@@ -635,6 +965,8 @@ class X3PointLight: public X3LightNode {
     return "PointLight";
   }
   virtual void SetupLights(int* light_count) const;
+  virtual void Flatten(const XMat4f& model, int material, 
+                       X3RayScene* rt) const;
  private:
   XVec3f attenuation_;
   XVec3f location_;
@@ -714,9 +1046,14 @@ class X3Curve : public X3GeometryNode {
   }
   virtual void Add(X3NodeType type, X3Node* node);
   virtual void Render() const;
+  virtual bounds_t Bounds() const {
+    return bounds_;
+  }
  private:
   X3PositionInterpolator* position_interpolator_;
   int steps_;
+  bounds_t bounds_; // of the points Render() draws the curve through
+
 };
 
 
@@ -35,6 +35,7 @@ using namespace std;
 
 #include "parseX3D.h"
 #include "scene.h"
+#include "renderqueue.h"
 
 #ifndef _WIN32
 #include <libgen.h>
@@ -174,6 +175,32 @@ kbd(unsigned char key, int x, int y)
       glutIdleFunc(idle);
     }
     break;
+  case 'r':
+    // toggle between the render queue and recursive rendering
+    if (scene) {
+      scene->set_use_render_queue(!scene->use_render_queue());
+      cerr << (scene->use_render_queue() ? "render queue" : "recursive")
+           << " rendering" << endl;
+    }
+    break;
+  case 'c':
+    // toggle frustum culling
+    if (scene) {
+      scene->set_use_culling(!scene->use_culling());
+      cerr << "culling " << (scene->use_culling() ? "on" : "off") << endl;
+    }
+    break;
+  case 'i':
+    // report the state changes of the last frame
+    if (scene && scene->use_render_queue()) {
+      const X3RenderQueue* queue = scene->render_queue();
+      cerr << queue->draw_count() << " draws, "
+           << queue->culled_count() << " subtrees culled, state changes: "
+           << 3*queue->draw_count() << " recursive, "
+           << queue->scene_order_changes() << " in scene order, "
+           << queue->state_changes() << " sorted" << endl;
+    }
+    break;
   case 'q':
   case 27: // ESC key
     exit(0);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2007, 2011 University of Michigan, Ann Arbor.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms are permitted
+ * provided that the above copyright notice and this paragraph are
+ * duplicated in all such forms and that any documentation,
+ * advertising materials, and other materials related to such
+ * distribution and use acknowledge that the software was developed
+ * by the University of Michigan, Ann Arbor. The name of the University 
+ * may not be used to endorse or promote products derived from this 
+ * software without specific prior written permission.
+ * THIS SOFTWARE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * Authors: Igor Guskov, Sugih Jamin
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include "parseX3D.h"
+#include "scene.h"
+#include "raytrace.h"
+
+/*
+ * Headless X3D ray tracer: renders a still of the scene, as seen
+ * from its viewpoint at the given time, without opening a window.
+ */
+
+static unsigned char
+to_byte(float f)
+{
+  if (f <= 0.0f) return 0;
+  if (f >= 1.0f) return 255;
+  return (unsigned char)(f*255.0f + 0.5f);
+}
+
+// Uncompressed 24-bit TGA, stored bottom row first like fb.
+static bool
+write_tga(char const *path, int w, int h, Colorf const *fb)
+{
+  ofstream file(path, ofstream::out | ofstream::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  unsigned char header[18];
+  memset(header, 0, sizeof(header));
+  header[2] = 2;          // uncompressed, true-color image
+  header[12] = w & 0xff;
+  header[13] = (w >> 8) & 0xff;
+  header[14] = h & 0xff;
+  header[15] = (h >> 8) & 0xff;
+  header[16] = 24;        // bits-per-pixel
+  file.write((char *)header, sizeof(header));
+
+  vector<unsigned char> row(3*w);
+  for (int j = 0; j < h; j++) {
+    for (int i = 0; i < w; i++) {
+      Colorf c = fb[j*w+i];
+      // targa is BGR
+      row[3*i] = to_byte(c.blue());
+      row[3*i+1] = to_byte(c.green());
+      row[3*i+2] = to_byte(c.red());
+    }
+    file.write((char *)&row[0], row.size());
+  }
+  return file.good();
+}
+
+// Binary PPM, which is stored top row first.
+static bool
+write_ppm(char const *path, int w, int h, Colorf const *fb)
+{
+  ofstream file(path, ofstream::out | ofstream::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  file << "P6\n" << w << " " << h << "\n255\n";
+  vector<unsigned char> row(3*w);
+  for (int j = h-1; j >= 0; j--) {
+    for (int i = 0; i < w; i++) {
+      Colorf c = fb[j*w+i];
+      row[3*i] = to_byte(c.red());
+      row[3*i+1] = to_byte(c.green());
+      row[3*i+2] = to_byte(c.blue());
+    }
+    file.write((char *)&row[0], row.size());
+  }
+  return file.good();
+}
+
+static void
+usage(char *prog)
+{
+  cerr << "Usage: " << basename(prog) << " [-w width] [-h height]"
+       << " [-t seconds] [-o image.{tga,ppm}] <input>.x3d" << endl;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat filestat;
+  int opt;
+  int w = 640;
+  int h = 480;
+  float time = 0.0f;
+  char const *outfile = NULL;
+
+  while ((opt = getopt(argc, argv, "w:h:t:o:")) != -1) {
+    switch (opt) {
+    case 'w':
+      w = atoi(optarg);
+      break;
+    case 'h':
+      h = atoi(optarg);
+      break;
+    case 't':
+      time = atof(optarg);
+      break;
+    case 'o':
+      outfile = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      exit(-1);
+    }
+  }
+
+  if (optind >= argc || w <= 0 || h <= 0) {
+    usage(argv[0]);
+    exit(-1);
+  }
+  char *input = argv[optind];
+  if (stat(input, &filestat)) {
+    cerr << basename(argv[0]) << ": " << input 
+         << ": No such file or directory" << endl;
+    exit(-1);
+  }
+
+  ifstream input_stream(input);
+  X3Reader x3reader;
+  string input_copy(input);
+  x3reader.set_dirname(dirname(&input_copy[0]));
+  X3Scene *scene = x3reader.Read(input_stream);
+  if (!scene) {
+    cerr << "Unable to read " << input << endl;
+    exit(-1);
+  }
+  scene->set_time(time);
+
+  X3RayScene rt;
+  rt.Build(scene);
+
+  vector<Colorf> fb(w*h, Colorf(0.0f));
+  rt.Render(*scene->viewpoint(), w, h, &fb[0]);
+
+  double t0 = now_seconds();
+  if (outfile) {
+    size_t len = strlen(outfile);
+    bool ok;
+    if (len > 4 && !strcmp(outfile+len-4, ".ppm")) {
+      ok = write_ppm(outfile, w, h, &fb[0]);
+    } else {
+      ok = write_tga(outfile, w, h, &fb[0]);
+    }
+    if (!ok) {
+      cerr << "Unable to write " << outfile << endl;
+      exit(-1);
+    }
+  }
+  double t1 = now_seconds();
+
+  RayStats const& stats = rt.stats();
+  cout << "image:        " << w << "x" << h << endl;
+  cout << "triangles:    " << rt.triangle_count() << endl;
+  cout << "lights:       " << rt.light_count() << endl;
+  cout << "primary rays: " << stats.primary << endl;
+  cout << "shadow rays:  " << stats.shadow << endl;
+  cout << "build time:   " << stats.build_time << " s" << endl;
+  cout << "render time:  " << stats.render_time << " s" << endl;
+  cout << "write time:   " << t1 - t0 << " s" << endl;
+  cout << "rays/sec:     " << (stats.render_time > 0.0 ? 
+                               stats.total()/stats.render_time : 0.0) << endl;
+
+  delete scene;
+  return 0;
+}